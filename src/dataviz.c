@@ -2,22 +2,167 @@
 #include "fft.h"
 #include "raylib.h"
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 void initDataVisualisation(DataVisualisation *dv, Rectangle imgProps, Rectangle imgMask, Rectangle texProps) {
 	dv->enabled = false;
 	dv->imageWriteIndex = 0;
-	dv->outImage = GenImageColor(imgProps.width, imgProps.height, (Color){ 0, 0, 0, 100 });
-	dv->outTexture = LoadTextureFromImage(dv->outImage);
+	Image image = GenImageColor(imgProps.width, imgProps.height, (Color){ 0, 0, 0, 100 });
+	dv->outTexture = LoadTextureFromImage(image);
+	UnloadImage(image);
+	dv->column = (Color *)malloc(sizeof(Color) * (int)imgProps.height);
 	dv->imgProps = imgProps;
 	dv->imgMask = imgMask;
 	dv->texProps = texProps;
 }
 
+void uploadDataVisualisationColumn(DataVisualisation *dv) {
+	UpdateTextureRec(dv->outTexture, (Rectangle){ dv->imageWriteIndex, 0, 1, dv->imgProps.height }, dv->column);
+	dv->imageWriteIndex++;
+	if(dv->imageWriteIndex >= dv->imgProps.width) {
+		dv->imageWriteIndex -= dv->imgProps.width;
+	}
+}
+
+void drawDataVisualisation(DataVisualisation *dv) {
+	// the ring is unrolled with two quads instead of a wrapping UV offset, texture repeat is not guaranteed on GLES2
+	float width = dv->imgProps.width;
+	float split = dv->texProps.width * (width - dv->imageWriteIndex) / width;
+	Rectangle oldest = { dv->imageWriteIndex, 0, width - dv->imageWriteIndex, dv->imgProps.height };
+	Rectangle newest = { 0, 0, dv->imageWriteIndex, dv->imgProps.height };
+	DrawTexturePro(dv->outTexture, oldest, (Rectangle){ dv->texProps.x, dv->texProps.y, split, dv->texProps.height }, (Vector2){ 0, 0 }, 0.0f, WHITE);
+	if(dv->imageWriteIndex > 0) {
+		DrawTexturePro(dv->outTexture, newest, (Rectangle){ dv->texProps.x + split, dv->texProps.y, dv->texProps.width - split, dv->texProps.height }, (Vector2){ 0, 0 }, 0.0f, WHITE);
+	}
+}
+
+static char *scaleNames[SPEC_SCALE_COUNT] = {
+	"LINEAR",
+	"LOG",
+	"MEL"
+};
+
+static char *aggregateNames[SPEC_AGGREGATE_COUNT] = {
+	"MAX",
+	"MEAN"
+};
+
+static float hzToMel(float hz) {
+	return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float melToHz(float mel) {
+	return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+// frequency at height t of the display, 0 at the bottom and 1 at the top
+static float spectrogramFrequency(SpectrogramScale scale, float t, float nyquist) {
+	switch(scale) {
+		case SPEC_SCALE_LOG:
+			return SPEC_MIN_FREQUENCY * powf(nyquist / SPEC_MIN_FREQUENCY, t);
+		case SPEC_SCALE_MEL: {
+			float low = hzToMel(SPEC_MIN_FREQUENCY);
+			return melToHz(low + t * (hzToMel(nyquist) - low));
+		}
+		default:
+		case SPEC_SCALE_LINEAR:
+			return t * nyquist;
+	}
+}
+
+static void buildSpectrogramPalette(Spectrogram *sp) {
+	for(int i = 0; i < SPEC_PALETTE_SIZE; i++) {
+		float t = i / (SPEC_PALETTE_SIZE - 1.0f);
+		sp->palette[i] = (Color){ (int)(230.0f * sqrtf(t)), (int)(210.0f * t * t), (int)(50.0f + 80.0f * t * (1.0f - t)), 150 };
+	}
+}
+
+void buildSpectrogramMap(Spectrogram *sp) {
+	int height = sp->dv.imgProps.height;
+	float nyquist = PA_SR / 2.0f;
+	int fftSize = sp->multiResolution ? SPEC_MULTIRES_FFT_SIZE : sp->fft.fftSize;
+	int freqCount = fftSize / 2 + 1;
+	// a full scale sine through a hann window peaks at a quarter of the fft size
+	sp->fullScaleDb = 20.0f * log10f(fftSize / 4.0f);
+	for(int c = 0; c < height; c++) {
+		// row 0 is the top of the texture
+		float low = spectrogramFrequency(sp->scale, (float)(height - 1 - c) / height, nyquist);
+		float high = spectrogramFrequency(sp->scale, (float)(height - c) / height, nyquist);
+		// each level covers the octave from 0.2 to 0.4 of its rate, below where its decimator starts to roll off,
+		// except that level 0 goes on up to nyquist and the last level down to DC
+		int level = 0;
+		if(sp->multiResolution) {
+			float centre = 0.5f * (low + high);
+			while(level < FFT_MULTIRES_LEVELS - 1 && centre < 0.2f * getMultiResLevelRate(PA_SR, level)) {
+				level++;
+			}
+		}
+		float binWidth = getMultiResLevelRate(PA_SR, level) / fftSize;
+		int start = (int)(low / binWidth + 0.5f);
+		int end = (int)(high / binWidth + 0.5f);
+		start = start < freqCount - 1 ? start : freqCount - 1;
+		// bands narrower than a bin at the bottom of the log scales still show the nearest bin
+		end = end > start ? end : start + 1;
+		end = end < freqCount ? end : freqCount;
+		sp->rowBinStart[c] = start;
+		sp->rowBinEnd[c] = end;
+		sp->rowLevel[c] = level;
+	}
+}
+
+void incSpectrogramScale(Spectrogram *sp) {
+	sp->scale = (sp->scale + 1) % SPEC_SCALE_COUNT;
+	buildSpectrogramMap(sp);
+}
+
+void toggleSpectrogramAggregate(Spectrogram *sp) {
+	sp->aggregate = (sp->aggregate + 1) % SPEC_AGGREGATE_COUNT;
+}
+
+void toggleSpectrogramMultiResolution(Spectrogram *sp) {
+	sp->multiResolution = !sp->multiResolution;
+	// rows the newly active fft made before it was switched off are stale
+	Fft *rows = sp->multiResolution ? &sp->multiRes.levels[0] : &sp->fft;
+	sp->prevRowCount = atomic_load_explicit(&rows->rowCount, memory_order_acquire);
+	buildSpectrogramMap(sp);
+	atomic_store_explicit(&sp->analysis.multiResolution, sp->multiResolution, memory_order_relaxed);
+}
+
+void pushSpectrogramAudio(Spectrogram *sp, const float *frames, int count) {
+	pushFFTAnalysisBlock(&sp->analysis, frames, count);
+}
+
+void freeSpectrogram(Spectrogram *sp) {
+	stopFFTAnalysis(&sp->analysis);
+	freeFFT(&sp->fft);
+	freeMultiResFFT(&sp->multiRes);
+	free(sp->rowBinStart);
+	free(sp->rowBinEnd);
+	free(sp->rowLevel);
+	free(sp->dv.column);
+}
+
 void initSpectrogram(Spectrogram *sp, int fftSize, int framesPerBuffer, int toAverage, float imageScale) {
-	initFFT(&sp->fft, fftSize, framesPerBuffer, toAverage, true, false);
+	initFFT(&sp->fft, fftSize, framesPerBuffer, toAverage, true, false, FFT_THREAD_ANALYSIS);
+	// a row per hop of the single fft either way, so the display scrolls at the same speed
+	initMultiResFFT(&sp->multiRes, SPEC_MULTIRES_FFT_SIZE, sp->fft.overlapFrames, FFT_ANALYSIS_BLOCK, true, FFT_THREAD_ANALYSIS);
+	sp->multiResolution = false;
+	sp->prevRowCount = 0;
 	initDataVisualisation(&sp->dv, (Rectangle){ 0, 0, 512, fftSize / 2.0 }, (Rectangle){ 0, 0, 512, fftSize / 2.0 }, (Rectangle){ 0, 0, 1024, 512 });
 	sp->cutoffFreq = 5000;
+	sp->scale = SPEC_SCALE_LOG;
+	sp->aggregate = SPEC_AGGREGATE_MAX;
+	sp->rowBinStart = (int *)malloc(sizeof(int) * (int)sp->dv.imgProps.height);
+	sp->rowBinEnd = (int *)malloc(sizeof(int) * (int)sp->dv.imgProps.height);
+	sp->rowLevel = (int *)malloc(sizeof(int) * (int)sp->dv.imgProps.height);
+	if(!sp->rowBinStart || !sp->rowBinEnd || !sp->rowLevel) {
+		printf("could not allocate spectrogram bin map.\n");
+		return;
+	}
+	buildSpectrogramMap(sp);
+	buildSpectrogramPalette(sp);
+	startFFTAnalysis(&sp->analysis, &sp->fft, &sp->multiRes);
 	sp->dv.draw = drawSpectrogram;
 	sp->dv.update = updateSpectrogramData;
 	sp->dv.toggle = toggleSpectrogram;
@@ -26,30 +171,57 @@ void initSpectrogram(Spectrogram *sp, int fftSize, int framesPerBuffer, int toAv
 void updateSpectrogramData(void *self) {
 	Spectrogram *sp = (Spectrogram *)self;
 
-	Color *col = (Color *)sp->dv.outImage.data;
-	const double pi = 3.14159265358979;
-
-	if(sp->fft.prevRowCount < sp->fft.rowCount) { // there's new data to write. rowcount is updated elsewhere, when new data of size sizeof(float)* fft.fftSize is added to fft.vals
-		for(int r = sp->fft.prevRowCount; r < sp->fft.rowCount; r++) {
-			for(int c = 0; c < sp->dv.imgProps.height; c++) {
-				int dataIndex = (c / sp->dv.imgProps.height) * sp->fft.freqCount;
-				// float value = sp->fft.vals[dataIndex] * pi;
-				float tmpCol = sp->fft.vals[r * sp->fft.freqCount + dataIndex] * pi;
-				col[sp->dv.imageWriteIndex + (int)sp->dv.imgProps.width * c] = (Color){
-					(int)(200.0f * fabs(sin(3.0f / 2.0f * tmpCol))),
-					(int)(200.0f * fabs(sin(3.0f / 2.0f * tmpCol))),
-					50,
-					150
-				};
+	Color *col = sp->dv.column;
+	int height = sp->dv.imgProps.height;
+	float paletteScale = (SPEC_PALETTE_SIZE - 1) / -SPEC_MIN_DB;
+
+	// the single fft, or level 0 of the multi-resolution one, decides when there are new rows
+	Fft *rows = sp->multiResolution ? &sp->multiRes.levels[0] : &sp->fft;
+	int levelCount = sp->multiResolution ? FFT_MULTIRES_LEVELS : 1;
+	const float *levelVals[FFT_MULTIRES_LEVELS];
+	unsigned int levelOffset[FFT_MULTIRES_LEVELS];
+
+	// the analysis thread keeps adding rows while this runs, every row below the acquired count is complete
+	unsigned int rowCount = atomic_load_explicit(&rows->rowCount, memory_order_acquire);
+	if(sp->prevRowCount != rowCount) {
+		// the oldest rows are overwritten as new ones come in, if the GUI fell that far behind only the newest half
+		// is drawn so the thread has room to keep writing
+		if(rowCount - sp->prevRowCount > (unsigned int)rows->maxRows / 2) {
+			sp->prevRowCount = rowCount - rows->maxRows / 2;
+		}
+		// every level adds a row per hop, but the decimators can put one a row ahead or behind level 0
+		for(int l = 0; l < levelCount; l++) {
+			Fft *fft = sp->multiResolution ? &sp->multiRes.levels[l] : &sp->fft;
+			levelOffset[l] = atomic_load_explicit(&fft->rowCount, memory_order_acquire) - rowCount;
+		}
+		for(unsigned int r = sp->prevRowCount; r != rowCount; r++) {
+			for(int l = 0; l < levelCount; l++) {
+				Fft *fft = sp->multiResolution ? &sp->multiRes.levels[l] : &sp->fft;
+				levelVals[l] = fft->vals + ((r + levelOffset[l]) % fft->maxRows) * fft->freqCount;
 			}
-			sp->dv.imageWriteIndex++;
-			if(sp->dv.imageWriteIndex > sp->dv.imgProps.width) {
-				sp->dv.imageWriteIndex -= sp->dv.imgProps.width;
+			for(int c = 0; c < height; c++) {
+				const float *vals = levelVals[sp->rowLevel[c]];
+				float power = 0.0f;
+				int start = sp->rowBinStart[c];
+				int end = sp->rowBinEnd[c];
+				if(sp->aggregate == SPEC_AGGREGATE_MEAN) {
+					for(int k = start; k < end; k++) {
+						power += vals[k];
+					}
+					power /= end - start;
+				} else {
+					for(int k = start; k < end; k++) {
+						power = vals[k] > power ? vals[k] : power;
+					}
+				}
+				float db = 10.0f * log10f(power + 1e-20f) - sp->fullScaleDb;
+				int index = (int)((db - SPEC_MIN_DB) * paletteScale);
+				index = index < 0 ? 0 : (index >= SPEC_PALETTE_SIZE ? SPEC_PALETTE_SIZE - 1 : index);
+				col[c] = sp->palette[index];
 			}
+			uploadDataVisualisationColumn(&sp->dv);
 		}
-		sp->fft.prevRowCount = sp->fft.rowCount;
-		UnloadTexture(sp->dv.outTexture);
-		sp->dv.outTexture = LoadTextureFromImage(sp->dv.outImage);
+		sp->prevRowCount = rowCount;
 	}
 }
 
@@ -58,10 +230,10 @@ void drawSpectrogram(void *self) {
 	if(!sp->dv.enabled) {
 		return;
 	}
-	DrawTexturePro(sp->dv.outTexture, sp->dv.imgProps, sp->dv.texProps, (Vector2){ 0, 0 }, 0.0f, WHITE);
+	drawDataVisualisation(&sp->dv);
 	// DrawLine(sp->dv.texProps.x + 1 + sp->dv.imageWriteIndex, sp->dv.texProps.y, sp->dv.texProps.x + 1 + sp->dv.imageWriteIndex, sp->dv.texProps.y + sp->dv.texProps.height, RED);
 	char debugData[255];
-	sprintf(debugData, "Window: %s, writeIndex: %i, rowcount: %i", sp->fft.windowFuncName, sp->dv.imageWriteIndex, sp->fft.rowCount);
+	sprintf(debugData, "Window: %s, scale: %s %s%s, writeIndex: %i, rowcount: %u", sp->fft.windowFuncName, scaleNames[sp->scale], aggregateNames[sp->aggregate], sp->multiResolution ? " MULTI-RES" : "", sp->dv.imageWriteIndex, atomic_load_explicit(&sp->fft.rowCount, memory_order_relaxed));
 	DrawText(debugData, 14, SCREEN_H - 14, 12, WHITE);
 }
 
@@ -69,6 +241,9 @@ void toggleSpectrogram(void *self) {
 	Spectrogram *sp = (Spectrogram *)self;
 	sp->dv.enabled = !sp->dv.enabled;
 	toggleFFTProcessing(&sp->fft);
+	for(int l = 0; l < FFT_MULTIRES_LEVELS; l++) {
+		toggleFFTProcessing(&sp->multiRes.levels[l]);
+	}
 }
 
 void initTimeGraph(TimeGraph *tg, float maxDataPoints, int x, int y, int width, int height) {
@@ -89,7 +264,7 @@ void pushTimeGraphMeasurement(TimeGraph *tg, double measurement) {
 	}
 	tg->timeData[tg->writeIndex] = measurement;
 	tg->writeIndex++;
-	if(tg->writeIndex > tg->maxData) {
+	if(tg->writeIndex >= tg->maxData) {
 		tg->writeIndex -= tg->maxData;
 	}
 }
@@ -99,37 +274,32 @@ void updateTimeGraphData(void *self) {
 	if(!tg->dv.enabled) {
 		return;
 	}
-	Color *col = (Color *)tg->dv.outImage.data;
+	Color *col = tg->dv.column;
+	int height = tg->dv.imgProps.height;
 
-	if(tg->prevWriteIndex < tg->writeIndex) {
-		for(int i = tg->prevWriteIndex; i < tg->writeIndex; i++) {
-			for(int j = 0; j < tg->dv.imgProps.height; j++) {
-				col[tg->dv.imageWriteIndex + (int)tg->dv.imgProps.width * j] = (Color){ 0, 0, 50, 150 };
-			}
-			if(tg->timeData[i] >= tg->clampPoint) {
-				col[tg->dv.imageWriteIndex + (int)tg->dv.imgProps.height - 1] = (Color){ 125, 0, 0, 200 };
-			} else {
-				float scaledDatapoint = tg->timeData[i] / tg->clampPoint;
-				int yoffset = (int)(scaledDatapoint * tg->dv.imgProps.height);
-				col[tg->dv.imageWriteIndex + (int)tg->dv.imgProps.width * yoffset] = (Color){ 0, 125, 0, 200 };
-			}
-
-			tg->dv.imageWriteIndex++;
-			if(tg->dv.imageWriteIndex > tg->dv.imgProps.width) {
-				tg->dv.imageWriteIndex -= tg->dv.imgProps.width;
-			}
+	// timeData is a ring too, so walk it from where the last update stopped
+	for(int i = tg->prevWriteIndex; i != tg->writeIndex; i = (i + 1) % tg->maxData) {
+		for(int j = 0; j < height; j++) {
+			col[j] = (Color){ 0, 0, 50, 150 };
 		}
-		UnloadTexture(tg->dv.outTexture);
-		tg->dv.outTexture = LoadTextureFromImage(tg->dv.outImage);
-		tg->prevWriteIndex = tg->writeIndex;
+		if(tg->timeData[i] >= tg->clampPoint) {
+			col[height - 1] = (Color){ 125, 0, 0, 200 };
+		} else {
+			float scaledDatapoint = tg->timeData[i] / tg->clampPoint;
+			int yoffset = (int)(scaledDatapoint * height);
+			col[yoffset] = (Color){ 0, 125, 0, 200 };
+		}
+		uploadDataVisualisationColumn(&tg->dv);
 	}
+	tg->prevWriteIndex = tg->writeIndex;
 }
+
 void drawTimeGraph(void *self) {
 	TimeGraph *tg = (TimeGraph *)self;
 	if(!tg->dv.enabled) {
 		return;
 	}
-	DrawTexturePro(tg->dv.outTexture, tg->dv.imgProps, tg->dv.texProps, (Vector2){ 0, 0 }, 0.0f, WHITE);
+	drawDataVisualisation(&tg->dv);
 }
 
 void toggleTimeGraph(void *self) {
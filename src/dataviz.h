@@ -7,10 +7,32 @@
 #include "settings.h"
 #include "fft.h"
 
+#define SPEC_PALETTE_SIZE 256
+#define SPEC_MIN_DB -90.0f       // relative to a full scale sine, the bottom of the palette
+#define SPEC_MIN_FREQUENCY 20.0f // lowest frequency shown by the log and mel scales
+#define SPEC_MULTIRES_FFT_SIZE 1024 // per level, the lowest level then resolves like an fft 8 times larger
+
+typedef enum {
+	SPEC_SCALE_LINEAR,
+	SPEC_SCALE_LOG,
+	SPEC_SCALE_MEL,
+	SPEC_SCALE_COUNT
+} SpectrogramScale;
+
+typedef enum {
+	SPEC_AGGREGATE_MAX,
+	SPEC_AGGREGATE_MEAN,
+	SPEC_AGGREGATE_COUNT
+} SpectrogramAggregate;
+
 typedef void (*DvTextureUpdateFunc)(void *self);
 typedef void (*DvDrawFunc)(void *self);
 typedef void (*DvToggleFunc)(void *self);
 
+/**
+ * The texture is a ring of columns: each new column is uploaded over the oldest one at imageWriteIndex, and drawing
+ * starts from there so the newest column ends up on the right.
+ */
 typedef struct {
 	bool enabled;
 	int imageWriteIndex;
@@ -18,7 +40,7 @@ typedef struct {
 	Rectangle imgMask;
 	Rectangle texProps;
 	float imageScale;
-	Image outImage;
+	Color *column; // imgProps.height pixels, filled by the update func and uploaded with uploadDataVisualisationColumn
 	Texture outTexture;
 	DvTextureUpdateFunc update;
 	DvDrawFunc draw;
@@ -28,7 +50,20 @@ typedef struct {
 typedef struct {
 	DataVisualisation dv;
 	Fft fft;
+	MultiResFft multiRes;
+	FftAnalysis analysis;
+	bool multiResolution; // rows come from multiRes, each pixel row from the level that resolves its frequency best
+	unsigned int prevRowCount; // rows of the active fft already drawn, only ever touched by the GUI
 	int cutoffFreq;
+	SpectrogramScale scale;
+	SpectrogramAggregate aggregate;
+	// bins [rowBinStart[c], rowBinEnd[c]) of level rowLevel[c] are combined into pixel row c, rebuilt whenever the
+	// scale or the analysis changes. The level is always 0 for the single fft.
+	int *rowBinStart;
+	int *rowBinEnd;
+	int *rowLevel;
+	float fullScaleDb; // power of a full scale sine in the active fft, in dB
+	Color palette[SPEC_PALETTE_SIZE];
 } Spectrogram;
 
 typedef struct {
@@ -41,11 +76,25 @@ typedef struct {
 } TimeGraph;
 
 void initDataVisualisation(DataVisualisation *dv, Rectangle imgProps, Rectangle imgMask, Rectangle texProps);
+void uploadDataVisualisationColumn(DataVisualisation *dv);
+void drawDataVisualisation(DataVisualisation *dv);
 
 void initSpectrogram(Spectrogram *sp, int fftSize, int framesPerBuffer, int toAverage, float imageScale);
 void updateSpectrogramData(void *self);
 void drawSpectrogram(void *self);
 void toggleSpectrogram(void *self);
+void buildSpectrogramMap(Spectrogram *sp);
+void incSpectrogramScale(Spectrogram *sp);
+void toggleSpectrogramAggregate(Spectrogram *sp);
+void toggleSpectrogramMultiResolution(Spectrogram *sp);
+/**
+ * @brief Hands a block of the output to the analysis thread, realtime safe.
+ */
+void pushSpectrogramAudio(Spectrogram *sp, const float *frames, int count);
+/**
+ * @brief Stops the analysis thread and frees the ffts. The audio callback must have stopped pushing.
+ */
+void freeSpectrogram(Spectrogram *sp);
 
 void initTimeGraph(TimeGraph *tg, float maxDataPoints, int x, int y, int width, int height);
 void pushTimeGraphMeasurement(TimeGraph *tg, double measurement);
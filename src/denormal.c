@@ -0,0 +1,51 @@
+#include "denormal.h"
+
+#include <stdint.h>
+
+#if defined(__SSE__) || defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+
+#define MXCSR_FTZ 0x8000
+#define MXCSR_DAZ 0x0040
+
+bool setFlushDenormals(bool enabled) {
+	unsigned int csr = _mm_getcsr();
+	csr = enabled ? csr | MXCSR_FTZ | MXCSR_DAZ : csr & ~(MXCSR_FTZ | MXCSR_DAZ);
+	_mm_setcsr(csr);
+	return true;
+}
+
+#elif defined(__aarch64__)
+
+// AArch64 has no separate DAZ bit, FZ flushes both inputs and results
+#define FPCR_FZ (1u << 24)
+
+bool setFlushDenormals(bool enabled) {
+	uint64_t fpcr;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+	fpcr = enabled ? fpcr | FPCR_FZ : fpcr & ~(uint64_t)FPCR_FZ;
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+	return true;
+}
+
+#elif defined(__arm__) && defined(__ARM_FP)
+
+// VFP flush-to-zero, NEON arithmetic always flushes regardless
+#define FPSCR_FZ (1u << 24)
+
+bool setFlushDenormals(bool enabled) {
+	uint32_t fpscr;
+	__asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+	fpscr = enabled ? fpscr | FPSCR_FZ : fpscr & ~FPSCR_FZ;
+	__asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+	return true;
+}
+
+#else
+
+bool setFlushDenormals(bool enabled) {
+	(void)enabled;
+	return false;
+}
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef DENORMAL_H
+#define DENORMAL_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Switches flush-to-zero / denormals-are-zero for the calling thread (MXCSR on x86, FPCR/FPSCR FZ on ARM).
+ * Must be called from every thread that runs DSP code, the mode is per thread.
+ * @return false if the target has no way of setting it, denormals are then processed normally.
+ */
+bool setFlushDenormals(bool enabled);
+
+#endif
@@ -1,5 +1,12 @@
 #include "distortion.h"
 
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+typedef unsigned int v4su __attribute__((vector_size(16)));
+
 float fold(float sample, float ampFactor, float foldAttenuation){
 	float overflow, ampsamp = sample * ampFactor;
 	if(ampsamp > 1.0f){
@@ -11,4 +18,110 @@ float fold(float sample, float ampFactor, float foldAttenuation){
 	} else {
 		return ampsamp;
 	}
+}
+
+void initBitcrusher(Bitcrusher *bc) {
+	bc->holdL = 0.0f;
+	bc->holdR = 0.0f;
+	bc->counter = 0.0f;
+	for(int i = 0; i < 4; i++) {
+		bc->seed[i] = 0x9e3779b9u * (i + 1);
+	}
+}
+
+// xorshift32 in every lane, the top 24 bits become a uniform value in [0, 1)
+static v4sf nextDither(v4su *state) {
+	v4su x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return __builtin_convertvector(x >> 8, v4sf) * (1.0f / 16777216.0f);
+}
+
+static v4si v4siMax(v4si a, v4si b) {
+	return (a & (a > b)) | (b & ~(a > b));
+}
+
+/*
+ * whole holds the integer part of the hold counter after each of four frames. A lane takes a new frame when that
+ * goes up, the others repeat the newest earlier lane that did, found with a two step prefix max over lane indices.
+ * -1 means the value held from before the group.
+ */
+static v4si heldSources(v4si whole) {
+	const v4si none = { -1, -1, -1, -1 };
+	v4si before = __builtin_shuffle(whole, (v4si){ 0, 0, 0, 0 }, (v4si){ 4, 0, 1, 2 });
+	v4si crossed = whole > before;
+	v4si source = ((v4si){ 0, 1, 2, 3 } & crossed) | (none & ~crossed);
+	source = v4siMax(source, __builtin_shuffle(source, none, (v4si){ 4, 0, 1, 2 }));
+	source = v4siMax(source, __builtin_shuffle(source, none, (v4si){ 4, 4, 0, 1 }));
+	return source;
+}
+
+void processBitcrusher(Bitcrusher *bc, float *left, float *right, int frameCount, float bits, float increment, bool dither) {
+	bool reduceRate = increment < 1.0f;
+	bool quantise = bits < BITCRUSH_MAX_BITS;
+	if(!reduceRate && !quantise) {
+		return;
+	}
+	float levels = exp2f(bits - 1.0f);
+	float step = 1.0f / levels;
+	const v4sf lanes = { 1.0f, 2.0f, 3.0f, 4.0f };
+	v4su seed;
+	memcpy(&seed, bc->seed, sizeof(seed));
+
+	int i = 0;
+	for(; i + V4SF_LANES <= frameCount; i += V4SF_LANES) {
+		v4sf l;
+		v4sf r;
+		memcpy(&l, left + i, sizeof(l));
+		memcpy(&r, right + i, sizeof(r));
+		if(quantise) {
+			v4sf noiseL = v4sfSet1(0.0f);
+			v4sf noiseR = v4sfSet1(0.0f);
+			if(dither) {
+				noiseL = nextDither(&seed) - nextDither(&seed);
+				noiseR = nextDither(&seed) - nextDither(&seed);
+			}
+			l = v4sfRound(l * levels + noiseL) * step;
+			r = v4sfRound(r * levels + noiseR) * step;
+		}
+		if(reduceRate) {
+			v4sf counter = v4sfSet1(bc->counter) + lanes * increment;
+			v4si whole = __builtin_convertvector(counter, v4si);
+			v4si source = heldSources(whole);
+			v4si held = source >= 0;
+			l = v4sfSelect(held, __builtin_shuffle(l, source & 3), v4sfSet1(bc->holdL));
+			r = v4sfSelect(held, __builtin_shuffle(r, source & 3), v4sfSet1(bc->holdR));
+			bc->holdL = l[3];
+			bc->holdR = r[3];
+			bc->counter = counter[3] - whole[3];
+		}
+		memcpy(left + i, &l, sizeof(l));
+		memcpy(right + i, &r, sizeof(r));
+	}
+	// leftover frames of an odd sized block
+	for(; i < frameCount; i++) {
+		float l = left[i];
+		float r = right[i];
+		if(quantise) {
+			float noiseL = dither ? nextDither(&seed)[0] - nextDither(&seed)[0] : 0.0f;
+			float noiseR = dither ? nextDither(&seed)[0] - nextDither(&seed)[0] : 0.0f;
+			l = roundf(l * levels + noiseL) * step;
+			r = roundf(r * levels + noiseR) * step;
+		}
+		if(reduceRate) {
+			bc->counter += increment;
+			if(bc->counter >= 1.0f) {
+				bc->counter -= 1.0f;
+				bc->holdL = l;
+				bc->holdR = r;
+			}
+			l = bc->holdL;
+			r = bc->holdR;
+		}
+		left[i] = l;
+		right[i] = r;
+	}
+	memcpy(bc->seed, &seed, sizeof(seed));
 }
\ No newline at end of file
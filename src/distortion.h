@@ -1,6 +1,30 @@
 #ifndef DISTORTION_H
 #define DISTORTION_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// at or above this many bits (and full rate) the crusher is bypassed
+#define BITCRUSH_MAX_BITS 24.0f
+
+/**
+ * Sample-and-hold rate reduction plus bit quantisation, processed four frames at a time. The hold counter is
+ * fractional, so any target rate works rather than just integer divisions of the block rate.
+ */
+typedef struct {
+	float holdL;
+	float holdR;
+	float counter;      // fraction of the way to the next held frame
+	uint32_t seed[4];   // one dither generator per lane
+} Bitcrusher;
+
 float fold(float sample, float ampFactor, float foldAttenuation);
+void initBitcrusher(Bitcrusher *bc);
+/**
+ * @param bits quantiser resolution, fractional values are allowed.
+ * @param increment target rate over the rate the block runs at, 1 or more keeps every frame.
+ * @param dither adds TPDF dither of one step before quantising.
+ */
+void processBitcrusher(Bitcrusher *bc, float *left, float *right, int frameCount, float bits, float increment, bool dither);
 
 #endif
\ No newline at end of file
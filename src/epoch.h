@@ -0,0 +1,63 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// threads that read pool memory without taking a lock
+typedef enum {
+	EPOCH_READER_AUDIO,
+	EPOCH_READER_PREFETCH,
+	EPOCH_READER_COUNT
+} EpochReader;
+
+#define EPOCH_IDLE 0u
+
+/**
+ * Epoch based reclamation for memory the audio thread reads lock-free. A reader publishes the global epoch it entered
+ * in and goes back to EPOCH_IDLE when done. A writer publishes the new pointers first, then retires the old memory
+ * with the epoch returned by epochRetire; once no reader is still inside that epoch nobody can hold the old pointer.
+ * All accesses are seq_cst, the publish -> retire -> check ordering relies on it.
+ */
+typedef struct {
+	atomic_uint global;
+	atomic_uint readers[EPOCH_READER_COUNT];
+} EpochDomain;
+
+static inline void initEpochDomain(EpochDomain *ed) {
+	atomic_init(&ed->global, 1u);
+	for(int i = 0; i < EPOCH_READER_COUNT; i++) {
+		atomic_init(&ed->readers[i], EPOCH_IDLE);
+	}
+}
+
+static inline void epochEnter(EpochDomain *ed, EpochReader reader) {
+	atomic_store(&ed->readers[reader], atomic_load(&ed->global));
+}
+
+static inline void epochExit(EpochDomain *ed, EpochReader reader) {
+	atomic_store(&ed->readers[reader], EPOCH_IDLE);
+}
+
+// call after the replacement pointers are visible, returns the epoch to hand to epochReclaimable
+static inline unsigned epochRetire(EpochDomain *ed) {
+	unsigned retired = atomic_fetch_add(&ed->global, 1u);
+	// skip EPOCH_IDLE on wrap-around
+	if(retired + 1u == EPOCH_IDLE) {
+		atomic_fetch_add(&ed->global, 1u);
+	}
+	return retired;
+}
+
+static inline bool epochReclaimable(EpochDomain *ed, unsigned retired) {
+	for(int i = 0; i < EPOCH_READER_COUNT; i++) {
+		unsigned e = atomic_load(&ed->readers[i]);
+		// signed distance so the comparison survives wrap-around
+		if(e != EPOCH_IDLE && (int)(e - retired) <= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -1,8 +1,30 @@
 #include "fft.h"
 
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "denormal.h"
+
+typedef struct {
+	kiss_fftr_cfg cfg;
+	int size;
+	FftDirection direction;
+	FftThread thread;
+	int refCount;
+} FftPlan;
+
+static FftPlan plans[MAX_FFT_PLANS];
+static pthread_mutex_t planLock = PTHREAD_MUTEX_INITIALIZER;
 
 static char *wfNames[WFT_COUNT] = {
 	"TRIANGLE",
@@ -33,14 +55,90 @@ float blackmanWindowExact(int index, int length) {
 	return bw2_alpha0 - bw2_alpha1 * cos((2 * M_PI * index) / length) + bw2_alpha2 * cos((2 * M_PI * index) / length);
 }
 
-void initFFT(Fft *fft, int fftSize, int framesPerBuffer, int toAverage, bool removeDC, bool cpxOut) {
+kiss_fftr_cfg acquireFFTPlan(int size, FftDirection direction, FftThread thread) {
+	kiss_fftr_cfg cfg = NULL;
+	FftPlan *empty = NULL;
+	pthread_mutex_lock(&planLock);
+	for(int i = 0; i < MAX_FFT_PLANS; i++) {
+		FftPlan *plan = &plans[i];
+		if(plan->refCount == 0) {
+			empty = empty ? empty : plan;
+		} else if(thread != FFT_THREAD_WORKER && plan->size == size && plan->direction == direction && plan->thread == thread) {
+			plan->refCount++;
+			cfg = plan->cfg;
+			break;
+		}
+	}
+	if(!cfg) {
+		if(!empty) {
+			printf("error: no room for another fft plan, raise MAX_FFT_PLANS.\n");
+		} else {
+			cfg = kiss_fftr_alloc(size, direction == FFT_INVERSE, 0, 0);
+			if(!cfg) {
+				printf("could not allocate fft plan of size %i.\n", size);
+			} else {
+				empty->cfg = cfg;
+				empty->size = size;
+				empty->direction = direction;
+				empty->thread = thread;
+				empty->refCount = 1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&planLock);
+	return cfg;
+}
+
+void releaseFFTPlan(kiss_fftr_cfg plan) {
+	if(!plan) {
+		return;
+	}
+	pthread_mutex_lock(&planLock);
+	for(int i = 0; i < MAX_FFT_PLANS; i++) {
+		if(plans[i].refCount > 0 && plans[i].cfg == plan) {
+			if(--plans[i].refCount == 0) {
+				kiss_fftr_free(plans[i].cfg);
+				plans[i].cfg = NULL;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&planLock);
+}
+
+void *allocFFTBuffer(size_t size) {
+	size = (size + FFT_ALIGN - 1) / FFT_ALIGN * FFT_ALIGN;
+#ifdef _WIN32
+	return _aligned_malloc(size, FFT_ALIGN);
+#else
+	void *buffer = NULL;
+	return posix_memalign(&buffer, FFT_ALIGN, size) == 0 ? buffer : NULL;
+#endif
+}
+
+void freeFFTBuffer(void *buffer) {
+#ifdef _WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+static void bakeWindow(float *table, WindowFunc window, int length) {
+	for(int i = 0; i < length; i++) {
+		table[i] = window(i, length);
+	}
+}
+
+void initFFT(Fft *fft, int fftSize, int framesPerBuffer, int toAverage, bool removeDC, bool cpxOut, FftThread thread) {
 	fft->fftSize = fftSize;
 	fft->freqCount = fft->fftSize / 2 + 1;
 	fft->navg = toAverage;
 	fft->removeDc = removeDC;
 
-	fft->rowCount = 0;
-	fft->prevRowCount = 0;
+	atomic_init(&fft->rowCount, 0);
+	atomic_init(&fft->enabled, false);
+	atomic_init(&fft->resetRequested, false);
 	fft->maxRows = 128;
 
 	fft->nbuf = 0;
@@ -49,16 +147,30 @@ void initFFT(Fft *fft, int fftSize, int framesPerBuffer, int toAverage, bool rem
 	fft->bufferCount = 4;
 	fft->framesPerBuffer = framesPerBuffer;
 	fft->overlapFrames = (fftSize / fft->bufferCount);
-	fft->cfg = kiss_fftr_alloc(fft->fftSize, 0, 0, 0);
-	fft->tbuf = (kiss_fft_scalar *)malloc(sizeof(kiss_fft_scalar) * fft->fftSize * fft->bufferCount);
-	fft->fbuf = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * fft->freqCount);
+	fft->hopCounter = 0;
+	fft->cpxOut = cpxOut;
+	fft->cfg = acquireFFTPlan(fft->fftSize, FFT_FORWARD, thread);
+	fft->icfg = acquireFFTPlan(fft->fftSize, FFT_INVERSE, thread);
+	fft->ring = (kiss_fft_scalar *)allocFFTBuffer(sizeof(kiss_fft_scalar) * fft->fftSize);
+	fft->fbuf = (kiss_fft_cpx *)allocFFTBuffer(sizeof(kiss_fft_cpx) * fft->freqCount);
 	fft->vals = (float *)malloc(sizeof(float) * fft->maxRows * fft->freqCount);
 	fft->cpxvals = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * fft->freqCount * fft->maxRows);
+	fft->block = (kiss_fft_scalar *)allocFFTBuffer(sizeof(kiss_fft_scalar) * fft->fftSize);
+	fft->spectrum = (kiss_fft_cpx *)allocFFTBuffer(sizeof(kiss_fft_cpx) * fft->freqCount);
+	fft->windowTables[0] = (float *)allocFFTBuffer(sizeof(float) * fft->fftSize);
+	fft->windowTables[1] = (float *)allocFFTBuffer(sizeof(float) * fft->fftSize);
+	if(!fft->cfg || !fft->icfg || !fft->ring || !fft->fbuf || !fft->vals || !fft->cpxvals || !fft->block || !fft->spectrum || !fft->windowTables[0] || !fft->windowTables[1]) {
+		printf("could not allocate fft of size %i.\n", fftSize);
+		return;
+	}
+	memset(fft->ring, 0, sizeof(kiss_fft_scalar) * fft->fftSize);
 	fft->window = hannWindow;
 	fft->selectedWf = WFT_HANN;
 	fft->windowFuncName = wfNames[fft->selectedWf];
+	fft->windowIndex = 0;
+	bakeWindow(fft->windowTables[0], fft->window, fft->fftSize);
 
-	fft->enabled = true;
+	atomic_store_explicit(&fft->enabled, true, memory_order_release);
 }
 
 void incWindowFunc(Fft *fft, bool increment) {
@@ -94,88 +206,259 @@ void incWindowFunc(Fft *fft, bool increment) {
 	}
 
 	fft->windowFuncName = wfNames[fft->selectedWf];
+
+	// the analysis thread may be windowing with the current table, so the new one is baked into the other and published
+	int next = 1 - fft->windowIndex;
+	bakeWindow(fft->windowTables[next], fft->window, fft->fftSize);
+	__atomic_store_n(&fft->windowIndex, next, __ATOMIC_RELEASE);
 }
 
-void pushFrameToFFT(Fft *fft, float frame) {
-	if(!fft->enabled) {
-		return;
+// windows the last fftSize frames of the ring into block, transforms them and stores the result as the newest row
+static void transformRing(Fft *fft) {
+	const float *window = fft->windowTables[__atomic_load_n(&fft->windowIndex, __ATOMIC_ACQUIRE)];
+	int tail = fft->fftSize - fft->frameIndex;
+	const kiss_fft_scalar *older = fft->ring + fft->frameIndex;
+	for(int i = 0; i < tail; i++) {
+		fft->block[i] = older[i] * window[i];
+	}
+	const float *newerWindow = window + tail;
+	kiss_fft_scalar *newerBlock = fft->block + tail;
+	for(int i = 0; i < fft->frameIndex; i++) {
+		newerBlock[i] = fft->ring[i] * newerWindow[i];
 	}
-	for(int i = 0; i < fft->bufferCount; i++) {
-		int index = (fft->frameIndex - (i * fft->overlapFrames));
-		index = index < 0 ? index + fft->fftSize : index;
-		fft->tbuf[index + (i * fft->fftSize)] = frame * fft->window(index, fft->fftSize);
+
+	if(fft->removeDc) {
+		float avg = 0;
+		for(int i = 0; i < fft->fftSize; ++i) {
+			avg += fft->block[i];
+		}
+		avg /= fft->fftSize;
+		for(int i = 0; i < fft->fftSize; ++i) {
+			fft->block[i] -= (kiss_fft_scalar)avg;
+		}
 	}
-	fft->frameIndex++;
-	fft->frameIndex %= fft->fftSize;
+
+	kiss_fftr(fft->cfg, fft->block, fft->fbuf);
+
+	// this thread is the only writer, the count is only published once the row behind it is complete
+	unsigned int rowCount = atomic_load_explicit(&fft->rowCount, memory_order_relaxed);
+	int row = rowCount % fft->maxRows;
+	if(fft->cpxOut) {
+		for(int i = 0; i < fft->freqCount; ++i) {
+			fft->cpxvals[row * fft->freqCount + i] = fft->fbuf[i];
+		}
+	} else {
+		for(int i = 0; i < fft->freqCount; ++i) {
+			fft->vals[row * fft->freqCount + i] = fft->fbuf[i].r * fft->fbuf[i].r + fft->fbuf[i].i * fft->fbuf[i].i;
+		}
+	}
+	atomic_store_explicit(&fft->rowCount, rowCount + 1, memory_order_release);
 }
 
-void processFFTData(Fft *fft) {
-	if(!fft->enabled) {
+void pushBlockToFFT(Fft *fft, const float *frames, int count) {
+	if(!atomic_load_explicit(&fft->enabled, memory_order_acquire)) {
 		return;
 	}
-	kiss_fft_scalar *buffPtr = NULL;
-	int tbufIndex = 0;
-	for(int i = fft->bufferCount - 1; i >= 0; i--) {
-		if((fft->frameIndex + (i * fft->overlapFrames)) == fft->fftSize) {
-			buffPtr = &fft->tbuf[(fft->bufferCount - 1 - i) * fft->fftSize];
-			tbufIndex = fft->bufferCount - 1 - i;
+	if(atomic_exchange_explicit(&fft->resetRequested, false, memory_order_acquire)) {
+		fft->frameIndex = 0;
+		fft->hopCounter = 0;
+	}
+	while(count > 0) {
+		// never past the next hop, so the frame transformed there is exactly the last fftSize
+		int chunk = fft->overlapFrames - fft->hopCounter;
+		chunk = chunk < count ? chunk : count;
+		int first = fft->fftSize - fft->frameIndex;
+		first = first < chunk ? first : chunk;
+		memcpy(fft->ring + fft->frameIndex, frames, sizeof(float) * first);
+		memcpy(fft->ring, frames + first, sizeof(float) * (chunk - first));
+		fft->frameIndex = (fft->frameIndex + chunk) % fft->fftSize;
+		fft->hopCounter += chunk;
+		frames += chunk;
+		count -= chunk;
+		if(fft->hopCounter == fft->overlapFrames) {
+			fft->hopCounter = 0;
+			transformRing(fft);
 		}
 	}
+}
 
-	if(buffPtr) {
-		int i = 0;
+void toggleFFTProcessing(Fft *fft) {
+	bool enabled = !atomic_load_explicit(&fft->enabled, memory_order_relaxed);
+	if(!enabled) {
+		// frameIndex and hopCounter belong to the pushing thread, it is only asked to clear them
+		atomic_store_explicit(&fft->resetRequested, true, memory_order_relaxed);
+	}
+	// release, so a push that sees the fft enabled again also sees the reset request
+	atomic_store_explicit(&fft->enabled, enabled, memory_order_release);
+}
 
-		// for(int i = 0; i < fft->fftSize; i++) {
-		// 	fft->vals[(fft->rowCount - 1) * fft->fftSize + i] = (buffPtr[i]);
-		// }
-		if(fft->removeDc) {
-			float avg = 0;
-			for(i = 0; i < fft->fftSize; ++i) {
-				avg += buffPtr[i];
-			}
-			avg /= fft->fftSize;
-			for(i = 0; i < fft->fftSize; ++i) {
-				buffPtr[i] -= (kiss_fft_scalar)avg;
-			}
+const kiss_fft_cpx *forwardFFTBlock(Fft *fft, const float *in, const float *window) {
+	const kiss_fft_scalar *frames = in;
+	if(window) {
+		for(int i = 0; i < fft->fftSize; i++) {
+			fft->block[i] = in[i] * window[i];
 		}
+		frames = fft->block;
+	}
+	kiss_fftr(fft->cfg, frames, fft->spectrum);
+	return fft->spectrum;
+}
 
-		kiss_fftr(fft->cfg, buffPtr, fft->fbuf);
+const kiss_fft_scalar *inverseFFTBlock(Fft *fft, const kiss_fft_cpx *in) {
+	kiss_fftri(fft->icfg, in, fft->block);
+	return fft->block;
+}
 
-		fft->rowCount++;
-		if(fft->rowCount > fft->maxRows) {
-			fft->rowCount -= fft->maxRows;
-			fft->prevRowCount -= fft->maxRows;
-		}
+void freeFFT(Fft *fft) {
+	releaseFFTPlan(fft->cfg);
+	releaseFFTPlan(fft->icfg);
+	freeFFTBuffer(fft->ring);
+	freeFFTBuffer(fft->fbuf);
+	free(fft->vals);
+	free(fft->cpxvals);
+	freeFFTBuffer(fft->block);
+	freeFFTBuffer(fft->spectrum);
+	freeFFTBuffer(fft->windowTables[0]);
+	freeFFTBuffer(fft->windowTables[1]);
+	fft->cfg = NULL;
+	fft->icfg = NULL;
+	fft->ring = NULL;
+	fft->fbuf = NULL;
+	fft->vals = NULL;
+	fft->cpxvals = NULL;
+	fft->block = NULL;
+	fft->spectrum = NULL;
+	fft->windowTables[0] = NULL;
+	fft->windowTables[1] = NULL;
+	atomic_store_explicit(&fft->enabled, false, memory_order_relaxed);
+}
 
-		if(fft->cpxOut) {
-			for(int i = 0; i < fft->freqCount; ++i) {
-				fft->cpxvals[(fft->rowCount - 1) * fft->freqCount + i] = fft->fbuf[i];
-			}
-		} else {
-			for(int i = 0; i < fft->freqCount; ++i) {
-				fft->vals[(fft->rowCount - 1) * fft->freqCount + i] = fft->fbuf[i].r * fft->fbuf[i].r + fft->fbuf[i].i * fft->fbuf[i].i;
+// feeds a block through the decimator a pair at a time, returns how many frames came out
+static int decimateMultiResLevel(MultiResFft *mr, int level, const float *in, int count, float *out) {
+	int written = 0;
+	int i = 0;
+	if(mr->holding[level] && count > 0) {
+		out[written++] = processHalfbandDecimator(&mr->decimators[level], mr->heldFrame[level], in[0]);
+		mr->holding[level] = false;
+		i = 1;
+	}
+	for(; i + 1 < count; i += 2) {
+		out[written++] = processHalfbandDecimator(&mr->decimators[level], in[i], in[i + 1]);
+	}
+	if(i < count) {
+		mr->heldFrame[level] = in[i];
+		mr->holding[level] = true;
+	}
+	return written;
+}
+
+void initMultiResFFT(MultiResFft *mr, int fftSize, int hop, int maxBlock, bool removeDC, FftThread thread) {
+	for(int l = 0; l < FFT_MULTIRES_LEVELS; l++) {
+		initFFT(&mr->levels[l], fftSize, maxBlock, 1, removeDC, false, thread);
+		// a row per hop of the input, which is hop >> l frames of this level
+		mr->levels[l].overlapFrames = hop >> l;
+		mr->levels[l].bufferCount = fftSize / mr->levels[l].overlapFrames;
+	}
+	for(int l = 0; l < FFT_MULTIRES_LEVELS - 1; l++) {
+		initHalfbandDecimator(&mr->decimators[l], 11);
+		mr->holding[l] = false;
+	}
+	mr->maxBlock = maxBlock;
+	mr->decimated = (float *)allocFFTBuffer(sizeof(float) * (maxBlock / 2 + 1) * 2);
+	if(!mr->decimated) {
+		printf("could not allocate multi-resolution fft scratch.\n");
+	}
+}
+
+void pushBlockToMultiResFFT(MultiResFft *mr, const float *frames, int count) {
+	pushBlockToFFT(&mr->levels[0], frames, count);
+	// each level is decimated from the one above into the other half of the scratch
+	const float *in = frames;
+	float *out = mr->decimated;
+	for(int l = 1; l < FFT_MULTIRES_LEVELS; l++) {
+		count = decimateMultiResLevel(mr, l - 1, in, count, out);
+		pushBlockToFFT(&mr->levels[l], out, count);
+		in = out;
+		out = out == mr->decimated ? mr->decimated + mr->maxBlock / 2 + 1 : mr->decimated;
+	}
+}
+
+float getMultiResLevelRate(float sampleRate, int level) {
+	return sampleRate / (float)(1 << level);
+}
+
+void freeMultiResFFT(MultiResFft *mr) {
+	for(int l = 0; l < FFT_MULTIRES_LEVELS; l++) {
+		freeFFT(&mr->levels[l]);
+	}
+	freeFFTBuffer(mr->decimated);
+	mr->decimated = NULL;
+}
+
+static void sleepMs(int ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void *fftAnalysisThread(void *arg) {
+	FftAnalysis *analysis = (FftAnalysis *)arg;
+	// FTZ/DAZ is per thread, the decimators and windowed transforms run here rather than in the callback
+	setFlushDenormals(true);
+	while(atomic_load_explicit(&analysis->running, memory_order_acquire)) {
+		unsigned int read = atomic_load_explicit(&analysis->read, memory_order_relaxed);
+		unsigned int written = atomic_load_explicit(&analysis->written, memory_order_acquire);
+		while(read != written) {
+			unsigned int index = read & (FFT_ANALYSIS_RING_SIZE - 1);
+			unsigned int count = written - read;
+			count = count < FFT_ANALYSIS_RING_SIZE - index ? count : FFT_ANALYSIS_RING_SIZE - index;
+			count = count < FFT_ANALYSIS_BLOCK ? count : FFT_ANALYSIS_BLOCK;
+			if(atomic_load_explicit(&analysis->multiResolution, memory_order_relaxed)) {
+				pushBlockToMultiResFFT(analysis->multiRes, analysis->ring + index, count);
+			} else {
+				pushBlockToFFT(analysis->fft, analysis->ring + index, count);
 			}
+			read += count;
+			atomic_store_explicit(&analysis->read, read, memory_order_release);
 		}
-		// if(tbufIndex == 0) {
-		// 	fft->vals[(fft->rowCount - 1) * fft->freqCount + 256] = 1.0;
-		// }
+		sleepMs(FFT_ANALYSIS_INTERVAL_MS);
+	}
+	return NULL;
+}
 
-		// if(++fft->avgctr == fft->navg) {
-		// 	fft->avgctr = 0;
-		// 	++fft->rowCount;
-		// 	//fft->vals = (float *)realloc(fft->vals, sizeof(float) * fft->rowCount * fft->freqCount);
-		// 	float eps = 1;
-		// 	for(int i = 0; i < fft->freqCount; ++i) {
-		// 		fft->vals[(fft->rowCount - 1) * fft->freqCount + i] = 10 * log10(fft->mag2buf[i] / fft->navg + eps);
-		// 	}
-		// 	memset(fft->mag2buf, 0, sizeof(fft->mag2buf[0]) * fft->freqCount);
-		// }
+void startFFTAnalysis(FftAnalysis *analysis, Fft *fft, MultiResFft *multiRes) {
+	atomic_init(&analysis->written, 0);
+	atomic_init(&analysis->read, 0);
+	atomic_init(&analysis->multiResolution, false);
+	atomic_init(&analysis->running, true);
+	analysis->fft = fft;
+	analysis->multiRes = multiRes;
+	analysis->threadStarted = pthread_create(&analysis->thread, NULL, fftAnalysisThread, analysis) == 0;
+	if(!analysis->threadStarted) {
+		printf("WARNING: could not start the fft analysis thread, the spectrogram will stay empty.\n");
 	}
 }
 
-void toggleFFTProcessing(Fft *fft) {
-	fft->enabled = !fft->enabled;
-	if(!fft->enabled) {
-		fft->frameIndex = 0;
+void pushFFTAnalysisBlock(FftAnalysis *analysis, const float *frames, int count) {
+	unsigned int written = atomic_load_explicit(&analysis->written, memory_order_relaxed);
+	unsigned int read = atomic_load_explicit(&analysis->read, memory_order_acquire);
+	unsigned int space = FFT_ANALYSIS_RING_SIZE - (written - read);
+	count = (unsigned int)count < space ? count : (int)space;
+	unsigned int index = written & (FFT_ANALYSIS_RING_SIZE - 1);
+	int first = FFT_ANALYSIS_RING_SIZE - index;
+	first = first < count ? first : count;
+	memcpy(analysis->ring + index, frames, sizeof(float) * first);
+	memcpy(analysis->ring, frames + first, sizeof(float) * (count - first));
+	atomic_store_explicit(&analysis->written, written + count, memory_order_release);
+}
+
+void stopFFTAnalysis(FftAnalysis *analysis) {
+	atomic_store_explicit(&analysis->running, false, memory_order_release);
+	if(analysis->threadStarted) {
+		pthread_join(analysis->thread, NULL);
+		analysis->threadStarted = false;
 	}
 }
@@ -1,12 +1,22 @@
 #ifndef FFT_H
 #define FFT_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "kiss_fft.h"
 #include "kiss_fftr.h"
+#include "oversampler.h"
 
 #define SP_MAX_ROWS 128
+#define MAX_FFT_PLANS 16
+#define FFT_ALIGN 32 // bytes, wide enough for AVX loads of the scratch buffers
+#define FFT_MULTIRES_LEVELS 4 // octaves of decimation, the last level sees the input at 1/8 of its rate
+#define FFT_ANALYSIS_RING_SIZE 16384 // frames, a power of two
+#define FFT_ANALYSIS_BLOCK 1024      // most frames handed to the ffts at once
+#define FFT_ANALYSIS_INTERVAL_MS 5
 
 static const float alpha = 0.16f;
 static const float bw1_alpha0 = (1.0 - alpha) / 2.0f;
@@ -27,11 +37,28 @@ typedef enum {
 
 typedef float (*WindowFunc)(int index, int length);
 
+typedef enum {
+	FFT_FORWARD,
+	FFT_INVERSE
+} FftDirection;
+
+/**
+ * kiss_fftr keeps its scratch inside the plan, so a plan can only be shared by callers that never run at the same time.
+ * Plans are shared between callers on the same thread, worker plans are never shared.
+ */
+typedef enum {
+	FFT_THREAD_MAIN,
+	FFT_THREAD_AUDIO,
+	FFT_THREAD_ANALYSIS, // the spectrogram's analysis thread
+	FFT_THREAD_WORKER
+} FftThread;
+
 typedef struct {
 	kiss_fftr_cfg cfg;
+	kiss_fftr_cfg icfg;
 	// kiss_fft_scalar *overlapbuf;
 	// kiss_fft_scalar *obuf;
-	kiss_fft_scalar *tbuf;
+	kiss_fft_scalar *ring; // the last fftSize frames pushed, oldest at frameIndex
 	kiss_fft_cpx *fbuf;
 	// float *mag2buf;
 	int fftSize;
@@ -39,33 +66,135 @@ typedef struct {
 	int navg;
 	int nbuf;
 	int framesPerBuffer;
-	int bufferCount;
+	int bufferCount; // frames overlapping at any one time, a new one is transformed every overlapFrames
 	int overlapFrames;
 	int frameIndex;
-	int rowCount;
-	int prevRowCount;
-	int maxRows;
+	int hopCounter; // frames pushed since the last transform
+	// rows transformed so far, only ever grows. Row n lives at n % maxRows of vals/cpxvals and is complete once a
+	// reader sees rowCount > n, the count is stored with release after the row is written
+	atomic_uint rowCount;
+	int maxRows; // a power of two, so n % maxRows stays continuous when rowCount wraps
 	int avgctr;
-	bool enabled;
+	// set from the GUI, the thread pushing blocks owns the ring and clears it itself once a reset is requested
+	atomic_bool enabled;
+	atomic_bool resetRequested;
 	bool removeDc;
 	bool cpxOut;
 	float *vals;
 	kiss_fft_cpx *cpxvals;
+	// FFT_ALIGN aligned scratch for the block helpers
+	kiss_fft_scalar *block;
+	kiss_fft_cpx *spectrum;
+	// the selected window baked for fftSize, rebuilt into the table not in use and swapped in when it changes
+	float *windowTables[2];
+	int windowIndex;
 	WindowFunc window;
 	int selectedWf;
 	char *windowFuncName;
 } Fft;
 
+/**
+ * Octave-spaced STFTs of one signal. Level l runs the same fft size on the input decimated by 2^l, so its bins are 2^l
+ * times narrower and its window 2^l times longer. Its hop shrinks by the same factor so every level adds one row per hop
+ * of the input. Each level costs as much as level 0, and the decimators less than one level together, so all of them
+ * cost about what a single fft 2^(levels - 1) times larger would.
+ */
+typedef struct {
+	Fft levels[FFT_MULTIRES_LEVELS];
+	HalfbandDecimator decimators[FFT_MULTIRES_LEVELS - 1]; // the 47 tap design the oversampler ends on
+	// decimators take frames in pairs, the odd frame at the end of a block waits here for the next one
+	float heldFrame[FFT_MULTIRES_LEVELS - 1];
+	bool holding[FFT_MULTIRES_LEVELS - 1];
+	float *decimated; // block scratch for the decimated levels
+	int maxBlock;
+} MultiResFft;
+
+/**
+ * Runs an Fft, or a MultiResFft when multiResolution is set, on a thread of its own. The audio thread only copies its
+ * output into the ring, the analysis thread drains it every FFT_ANALYSIS_INTERVAL_MS.
+ */
+typedef struct {
+	float ring[FFT_ANALYSIS_RING_SIZE];
+	atomic_uint written; // frames ever written and read, so written - read is what is waiting
+	atomic_uint read;
+	atomic_bool multiResolution;
+	atomic_bool running;
+	Fft *fft;
+	MultiResFft *multiRes;
+	pthread_t thread;
+	bool threadStarted;
+} FftAnalysis;
+
 float triangularWindow(int index, int length);
 float hannWindow(int index, int length);
 float hammingWindow(int index, int length);
 float blackmanWindowEstimated(int index, int length);
 float blackmanWindowExact(int index, int length);
 
-void initFFT(Fft *fft, int fftSize, int framesPerBuffer, int toAverage, bool removeDC, bool cpxOut);
+/**
+ * @brief Returns the process-wide plan for this size and direction, allocating it on first use. Not realtime safe.
+ * @return NULL if it could not be allocated.
+ */
+kiss_fftr_cfg acquireFFTPlan(int size, FftDirection direction, FftThread thread);
+/**
+ * @brief Drops a reference taken by acquireFFTPlan, the plan is freed with its last user. NULL is ignored.
+ */
+void releaseFFTPlan(kiss_fftr_cfg plan);
+void *allocFFTBuffer(size_t size);
+void freeFFTBuffer(void *buffer);
+
+/**
+ * @brief Takes its plans from the plan cache and allocates every buffer it will use, so nothing is allocated later.
+ * @param thread the thread pushBlockToFFT and the block helpers will run on.
+ */
+void initFFT(Fft *fft, int fftSize, int framesPerBuffer, int toAverage, bool removeDC, bool cpxOut, FftThread thread);
 void incWindowFunc(Fft *fft, bool increment);
-void pushFrameToFFT(Fft *fft, float frame);
-void processFFTData(Fft *fft);
+/**
+ * @brief Appends count frames to the ring. Every overlapFrames frames the last fftSize are windowed and transformed into
+ *        a new row of vals, nothing is allocated. Called from the FFT analysis thread.
+ */
+void pushBlockToFFT(Fft *fft, const float *frames, int count);
+/**
+ * @brief Switches pushBlockToFFT on or off from any thread. Switching off also has the pushing thread start the ring
+ *        over before its next block.
+ */
 void toggleFFTProcessing(Fft *fft);
+/**
+ * @brief Transforms fftSize frames of in, multiplied by window when it is not NULL.
+ * @return the fft's spectrum buffer, freqCount bins valid until the next call.
+ */
+const kiss_fft_cpx *forwardFFTBlock(Fft *fft, const float *in, const float *window);
+/**
+ * @brief Transforms freqCount bins back to fftSize frames. Like kiss_fftri the result is scaled by fftSize.
+ * @return the fft's block buffer, valid until the next call.
+ */
+const kiss_fft_scalar *inverseFFTBlock(Fft *fft, const kiss_fft_cpx *in);
+void freeFFT(Fft *fft);
+
+/**
+ * @param hop input frames between rows, must be a multiple of 2^(FFT_MULTIRES_LEVELS - 1).
+ * @param maxBlock the most frames pushBlockToMultiResFFT will be given at once.
+ */
+void initMultiResFFT(MultiResFft *mr, int fftSize, int hop, int maxBlock, bool removeDC, FftThread thread);
+/**
+ * @brief Feeds count frames through the decimation chain and every level. count must not exceed maxBlock.
+ */
+void pushBlockToMultiResFFT(MultiResFft *mr, const float *frames, int count);
+/**
+ * @return sample rate of the signal level l analyses, for an input at sampleRate.
+ */
+float getMultiResLevelRate(float sampleRate, int level);
+void freeMultiResFFT(MultiResFft *mr);
+
+/**
+ * @brief Starts the analysis thread. Both ffts must have been initialised for FFT_THREAD_ANALYSIS with a maxBlock of at
+ *        least FFT_ANALYSIS_BLOCK.
+ */
+void startFFTAnalysis(FftAnalysis *analysis, Fft *fft, MultiResFft *multiRes);
+/**
+ * @brief Realtime safe, called from the audio callback. Frames that do not fit are dropped.
+ */
+void pushFFTAnalysisBlock(FftAnalysis *analysis, const float *frames, int count);
+void stopFFTAnalysis(FftAnalysis *analysis);
 
 #endif
@@ -28,19 +28,6 @@ BiquadFilter* createBiquadFilter(BiquadType type){
     return bf;
 }
 
-int checkFLoatUnderflow(float* val){
-    int undeflowPresent = 0;
-    if(*val > 0.0 && *val < SMALLEST_POS_FLOAT){
-        undeflowPresent = 1;
-        *val = 0.0f;
-    }
-    if(*val < 0.0 && *val > SMALLEST_NEG_FLOAT){
-        undeflowPresent = 1;
-        *val = 0.0f;
-    }
-    return undeflowPresent;
-}
-
 float processKDirect(BiquadFilter* bf, float xn){
     float yn = 
         bf->coefficients[a0] * xn +
@@ -74,8 +61,6 @@ float processKTransposeDirect(BiquadFilter* bf, float xn){
     float wn = xn + bf->states[y_z1];
     float yn = bf->coefficients[a0] * wn + bf->states[x_z1];
 
-    checkFLoatUnderflow(&yn);
-
     bf->states[y_z1] = bf->states[y_z2] - bf->coefficients[b1] * wn;
     bf->states[y_z2] = -bf->coefficients[b2] * wn;
 
@@ -88,8 +73,6 @@ float processKTransposeDirect(BiquadFilter* bf, float xn){
 float processKTransposeCanonical(BiquadFilter* bf, float xn){
     float yn = bf->coefficients[a0] * xn + bf->states[x_z1];
 
-    checkFLoatUnderflow(&yn);
-
     bf->states[x_z1] =  bf->coefficients[a1] * xn -
                         bf->coefficients[b1] * yn + bf->states[x_z2];
     bf->states[x_z2] = bf->coefficients[a2] * xn - bf->coefficients[b2] * yn;
@@ -98,70 +81,279 @@ float processKTransposeCanonical(BiquadFilter* bf, float xn){
 }
 
 Filter* createFilter(BiquadType bfType, FilterType fType, float freq, float q){
+    if(fType < 0 || fType >= filter_count){
+        printf("error: invalid Filter type, returning NULL");
+        return NULL;
+    }
     BiquadFilter* bf = createBiquadFilter(bfType);
     Filter* flt = (Filter*)malloc(sizeof(Filter));
-    if(!flt){
+    if(!flt || !bf){
         printf("error: could not allocate memory for Filter, returning NULL");
+        free(bf);
+        free(flt);
         return NULL;
     }
 
     flt->biquad = bf;
+    for(int c = 0; c < 2; c++){
+        initDiodeClipper(&flt->clipper[c], PA_SR, freq < FILTER_MIN_FREQ ? FILTER_MIN_FREQ : freq);
+    }
+    resetFilter(flt);
     flt->type = fType;
-    flt->q = q;    
-    
-    float angle = 0.0f, d = 0.0f, anglesin = 0.0f, anglecos = 0.0f, beta = 0.0f, theta = 0.0f;
+    flt->freq = freq;
+    flt->q = q;
+    calculateBiquadCoefficients(flt->biquad->coefficients, fType, freq, q);
+
+    return flt;
+}
 
-    switch(fType){
+void resetFilter(Filter* flt){
+    for(int i = 0; i < state_count; i++){
+        flt->biquad->states[i] = 0.0f;
+        flt->rightStates[i] = 0.0f;
+    }
+    wdfReset(&flt->clipper[0].circuit);
+    wdfReset(&flt->clipper[1].circuit);
+    // a zero cutoff makes the next smoothFilterParameters() call jump straight to its target
+    flt->freq = 0.0f;
+}
+
+void calculateBiquadCoefficients(float* coefficients, FilterType type, float freq, float q){
+    if(freq < FILTER_MIN_FREQ) freq = FILTER_MIN_FREQ;
+    if(freq > FILTER_MAX_FREQ) freq = FILTER_MAX_FREQ;
+    if(q < FILTER_MIN_Q) q = FILTER_MIN_Q;
+
+    float angle = (TWOPI * freq) / PA_SR;
+    float anglesin = sinf(angle);
+    float anglecos = cosf(angle);
+    float alpha = anglesin / (2.0f * q);
+    float norm = 1.0f / (1.0f + alpha);
+
+    switch(type){
+        default:
         case secondOrderLPF:
-            angle = (TWOPI * freq) / PA_SR;
-            d = 1 / q;
-            anglesin = sinf(angle);
-            anglecos = cosf(angle);
-            beta = 0.5f * (
-                (1.0f - (d / 2.0f) * anglesin) /
-                (1.0f + (d / 2.0f) * anglesin)
-            );
-            theta = (0.5f + beta) * anglecos;
-            flt->biquad->coefficients[a1] = (0.5f + beta - theta);
-            flt->biquad->coefficients[a0] = flt->biquad->coefficients[a1] / 2.0f;
-            flt->biquad->coefficients[a2] = flt->biquad->coefficients[a0];
-            flt->biquad->coefficients[b1] = -2.0f * theta;
-            flt->biquad->coefficients[b2] = 2.0f * beta;
-            flt->biquad->coefficients[c0] = 1.0f;
-            flt->biquad->coefficients[d0] = 0.0f;
+            coefficients[a0] = ((1.0f - anglecos) * 0.5f) * norm;
+            coefficients[a1] = (1.0f - anglecos) * norm;
+            coefficients[a2] = coefficients[a0];
             break;
         case secondOrderHPF:
-            angle = (TWOPI * freq) / PA_SR;
-            d = 1 / q;
-            anglesin = sinf(angle);
-            anglecos = cosf(angle);
-            beta = 0.5f * (
-                (1.0f - (d / 2.0f) * anglesin) /
-                (1.0f + (d / 2.0f) * anglesin)
-            );
-            theta = (0.5f + beta) * anglecos;
-            flt->biquad->coefficients[a1] = -(0.5f + beta + theta);
-            flt->biquad->coefficients[a0] = (0.5f + beta + theta) / 2.0f;
-            flt->biquad->coefficients[a2] = (0.5f + beta + theta);
-            flt->biquad->coefficients[b1] = -2.0f * theta;
-            flt->biquad->coefficients[b2] = 2.0f * beta;
-            flt->biquad->coefficients[c0] = 1.0f;
-            flt->biquad->coefficients[d0] = 0.0f;
+            coefficients[a0] = ((1.0f + anglecos) * 0.5f) * norm;
+            coefficients[a1] = -(1.0f + anglecos) * norm;
+            coefficients[a2] = coefficients[a0];
             break;
-        default:
-            printf("error: invalid Filter type, returning NULL");
-            return NULL;
+        case secondOrderBPF:
+            coefficients[a0] = alpha * norm;
+            coefficients[a1] = 0.0f;
+            coefficients[a2] = -alpha * norm;
+            break;
+        case secondOrderNotch:
+            coefficients[a0] = norm;
+            coefficients[a1] = -2.0f * anglecos * norm;
+            coefficients[a2] = norm;
             break;
     }
+    coefficients[b1] = -2.0f * anglecos * norm;
+    coefficients[b2] = (1.0f - alpha) * norm;
+    coefficients[c0] = 1.0f;
+    coefficients[d0] = 0.0f;
+}
 
-    return flt;
+bool setFilterParameters(Filter* flt, FilterType type, float freq, float q){
+    if(type == flt->type && freq == flt->freq && q == flt->q){
+        return false;
+    }
+    flt->type = type;
+    flt->freq = freq;
+    flt->q = q;
+    if(type == wdfDiodeClipper){
+        float cutoff = freq < FILTER_MIN_FREQ ? FILTER_MIN_FREQ : (freq > FILTER_MAX_FREQ ? FILTER_MAX_FREQ : freq);
+        setDiodeClipperCutoff(&flt->clipper[0], cutoff);
+        setDiodeClipperCutoff(&flt->clipper[1], cutoff);
+    } else if(!isSvfFilterType(type)){
+        calculateBiquadCoefficients(flt->biquad->coefficients, type, freq, q);
+    }
+    return true;
+}
+
+bool smoothFilterParameters(Filter* flt, FilterType type, float targetFreq, float targetQ){
+    if(targetFreq < FILTER_MIN_FREQ) targetFreq = FILTER_MIN_FREQ;
+    if(flt->freq <= 0.0f || type != flt->type){
+        return setFilterParameters(flt, type, targetFreq, targetQ);
+    }
+    float freq = flt->freq * powf(targetFreq / flt->freq, FILTER_SMOOTHING);
+    float q = flt->q + (targetQ - flt->q) * FILTER_SMOOTHING;
+    // close enough, land exactly on the target so the cached coefficients stop changing
+    if(fabsf(freq - targetFreq) < targetFreq * 0.001f) freq = targetFreq;
+    if(fabsf(q - targetQ) < 0.001f) q = targetQ;
+    return setFilterParameters(flt, type, freq, q);
+}
+
+void processFilterLanes(Filter** filters, float** left, float** right, int laneCount, int frameCount){
+    static float silence[PA_BUFFER_SIZE];
+    v4sf coeff[coeff_count];
+    v4sf zL1, zL2, zR1, zR2;
+    float* inL[BIQUAD_LANES];
+    float* inR[BIQUAD_LANES];
+
+    if(frameCount > PA_BUFFER_SIZE){
+        frameCount = PA_BUFFER_SIZE;
+    }
+
+    for(int c = 0; c < coeff_count; c++){
+        coeff[c] = v4sfSet1(0.0f);
+    }
+    zL1 = zL2 = zR1 = zR2 = v4sfSet1(0.0f);
+    for(int l = 0; l < BIQUAD_LANES; l++){
+        // unused lanes run all-zero coefficients over a silent buffer, which stays silent
+        if(l >= laneCount){
+            inL[l] = silence;
+            inR[l] = silence;
+            continue;
+        }
+        inL[l] = left[l];
+        inR[l] = right[l];
+        for(int c = 0; c < coeff_count; c++){
+            coeff[c][l] = filters[l]->biquad->coefficients[c];
+        }
+        zL1[l] = filters[l]->biquad->states[x_z1];
+        zL2[l] = filters[l]->biquad->states[x_z2];
+        zR1[l] = filters[l]->rightStates[x_z1];
+        zR2[l] = filters[l]->rightStates[x_z2];
+    }
+
+    for(int i = 0; i < frameCount; i++){
+        v4sf xL = { inL[0][i], inL[1][i], inL[2][i], inL[3][i] };
+        v4sf xR = { inR[0][i], inR[1][i], inR[2][i], inR[3][i] };
+
+        v4sf yL = coeff[a0] * xL + zL1;
+        v4sf yR = coeff[a0] * xR + zR1;
+        zL1 = coeff[a1] * xL - coeff[b1] * yL + zL2;
+        zR1 = coeff[a1] * xR - coeff[b1] * yR + zR2;
+        zL2 = coeff[a2] * xL - coeff[b2] * yL;
+        zR2 = coeff[a2] * xR - coeff[b2] * yR;
+
+        yL = yL * coeff[c0] + xL * coeff[d0];
+        yR = yR * coeff[c0] + xR * coeff[d0];
+        for(int l = 0; l < BIQUAD_LANES; l++){
+            inL[l][i] = yL[l];
+            inR[l][i] = yR[l];
+        }
+    }
+
+    for(int l = 0; l < laneCount; l++){
+        filters[l]->biquad->states[x_z1] = zL1[l];
+        filters[l]->biquad->states[x_z2] = zL2[l];
+        filters[l]->rightStates[x_z1] = zR1[l];
+        filters[l]->rightStates[x_z2] = zR2[l];
+    }
+}
+
+bool isSvfFilterType(FilterType type){
+    return type == svfLPF || type == svfBPF || type == svfHPF;
+}
+
+// [5/4] Pade approximant of tan(x), within 0.1% up to the x = pi * 0.45 we clamp the cutoff to
+static inline v4sf tanApprox(v4sf x){
+    v4sf x2 = x * x;
+    v4sf num = x * (945.0f - x2 * (105.0f - x2));
+    v4sf den = 945.0f - x2 * (420.0f - 15.0f * x2);
+    return num / den;
 }
 
+void processSvfLanes(Filter** filters, float** left, float** right, float** cutoff, int laneCount, int frameCount){
+    static float silence[PA_BUFFER_SIZE];
+    float* inL[BIQUAD_LANES];
+    float* inR[BIQUAD_LANES];
+    float* fc[BIQUAD_LANES];
+    v4sf k = v4sfSet1(1.0f);
+    v4sf lpMix = v4sfSet1(0.0f);
+    v4sf bpMix = v4sfSet1(0.0f);
+    v4sf hpMix = v4sfSet1(0.0f);
+    v4sf icL1, icL2, icR1, icR2;
+    const v4sf minFreq = v4sfSet1(FILTER_MIN_FREQ);
+    const v4sf maxFreq = v4sfSet1(FILTER_MAX_FREQ);
+    const v4sf radPerHz = v4sfSet1(M_PI / PA_SR);
 
-// flt->biquad->coefficients[a0] = (0.5f + beta - theta) / 2.0f;
-// flt->biquad->coefficients[a1] = ;
-// flt->biquad->coefficients[a2];
-// flt->biquad->coefficients[b1];
-// flt->biquad->coefficients[b2];
-// flt->biquad->coefficients[c0];
-// flt->biquad->coefficients[d0];
\ No newline at end of file
+    if(frameCount > PA_BUFFER_SIZE){
+        frameCount = PA_BUFFER_SIZE;
+    }
+
+    icL1 = icL2 = icR1 = icR2 = v4sfSet1(0.0f);
+    for(int l = 0; l < BIQUAD_LANES; l++){
+        if(l >= laneCount){
+            inL[l] = silence;
+            inR[l] = silence;
+            fc[l] = silence;
+            continue;
+        }
+        inL[l] = left[l];
+        inR[l] = right[l];
+        fc[l] = cutoff[l];
+        float q = filters[l]->q < FILTER_MIN_Q ? FILTER_MIN_Q : filters[l]->q;
+        k[l] = 1.0f / q;
+        // the three responses come out of the same update, a 0/1 mask picks one per lane without branching
+        lpMix[l] = filters[l]->type == svfLPF;
+        bpMix[l] = filters[l]->type == svfBPF;
+        hpMix[l] = filters[l]->type == svfHPF;
+        icL1[l] = filters[l]->biquad->states[x_z1];
+        icL2[l] = filters[l]->biquad->states[x_z2];
+        icR1[l] = filters[l]->rightStates[x_z1];
+        icR2[l] = filters[l]->rightStates[x_z2];
+    }
+
+    for(int i = 0; i < frameCount; i++){
+        v4sf freq = { fc[0][i], fc[1][i], fc[2][i], fc[3][i] };
+        freq = v4sfMin(v4sfMax(freq, minFreq), maxFreq);
+        v4sf g = tanApprox(freq * radPerHz);
+        v4sf ga1 = 1.0f / (1.0f + g * (g + k));
+        v4sf ga2 = g * ga1;
+        v4sf ga3 = g * ga2;
+
+        v4sf xL = { inL[0][i], inL[1][i], inL[2][i], inL[3][i] };
+        v4sf xR = { inR[0][i], inR[1][i], inR[2][i], inR[3][i] };
+
+        v4sf v3L = xL - icL2;
+        v4sf v3R = xR - icR2;
+        v4sf bpL = ga1 * icL1 + ga2 * v3L;
+        v4sf bpR = ga1 * icR1 + ga2 * v3R;
+        v4sf lpL = icL2 + ga2 * icL1 + ga3 * v3L;
+        v4sf lpR = icR2 + ga2 * icR1 + ga3 * v3R;
+        icL1 = 2.0f * bpL - icL1;
+        icR1 = 2.0f * bpR - icR1;
+        icL2 = 2.0f * lpL - icL2;
+        icR2 = 2.0f * lpR - icR2;
+        v4sf hpL = xL - k * bpL - lpL;
+        v4sf hpR = xR - k * bpR - lpR;
+
+        v4sf yL = lpMix * lpL + bpMix * bpL + hpMix * hpL;
+        v4sf yR = lpMix * lpR + bpMix * bpR + hpMix * hpR;
+        for(int l = 0; l < BIQUAD_LANES; l++){
+            inL[l][i] = yL[l];
+            inR[l][i] = yR[l];
+        }
+    }
+
+    for(int l = 0; l < laneCount; l++){
+        filters[l]->biquad->states[x_z1] = icL1[l];
+        filters[l]->biquad->states[x_z2] = icL2[l];
+        filters[l]->rightStates[x_z1] = icR1[l];
+        filters[l]->rightStates[x_z2] = icR2[l];
+    }
+}
+
+// the diodes only start conducting around 0.5V, so the voice level needs a push to reach them
+#define WDF_DRIVE_SCALE 4.0f
+
+void processWdfLanes(Filter** filters, float** left, float** right, int laneCount, int frameCount){
+    for(int l = 0; l < laneCount; l++){
+        DiodeClipper* clipperL = &filters[l]->clipper[0];
+        DiodeClipper* clipperR = &filters[l]->clipper[1];
+        float drive = filters[l]->q * WDF_DRIVE_SCALE;
+        float* inL = left[l];
+        float* inR = right[l];
+        for(int i = 0; i < frameCount; i++){
+            inL[i] = processDiodeClipper(clipperL, inL[i] * drive);
+            inR[i] = processDiodeClipper(clipperR, inR[i] * drive);
+        }
+    }
+}
@@ -1,14 +1,21 @@
 #ifndef FILTERS_H
 #define FILTERS_H
 
-#define SMALLEST_POS_FLOAT 1.175494351e-38         /* min positive value */
-#define SMALLEST_NEG_FLOAT -1.175494351e-38         /* min negative value */
-
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "settings.h"
+#include "simd.h"
+#include "wdf.h"
+
+#define BIQUAD_LANES V4SF_LANES
+#define FILTER_MIN_FREQ 20.0f
+#define FILTER_MAX_FREQ (PA_SR * 0.45f)
+#define FILTER_MIN_Q 0.1f
+// fraction of the remaining (log) distance to the target cutoff covered per block
+#define FILTER_SMOOTHING 0.3f
 
 typedef struct BiquadFilter BiquadFilter;
 typedef float (*BiquadProcessor)(BiquadFilter* bf, float xn);
@@ -43,6 +50,12 @@ typedef enum {
 typedef enum {
     secondOrderLPF,
     secondOrderHPF,
+    secondOrderBPF,
+    secondOrderNotch,
+    svfLPF,
+    svfBPF,
+    svfHPF,
+    wdfDiodeClipper,
     filter_count
 } FilterType;
 
@@ -57,25 +70,52 @@ typedef struct {
     FilterType type;
     BiquadFilter* biquad;
     float q;
+    float freq;                       // cutoff the current coefficients were designed for
+    float rightStates[state_count];   // biquad->states holds the left channel
+                                      // (the SVF keeps its two integrator states in x_z1/x_z2 of the same arrays)
+    DiodeClipper clipper[2];          // [channel], wdfDiodeClipper only
 } Filter;
 
-typedef struct {
-    float terminalResistace;
-    float openTerminalResistance;
-    float sourceResistance;
-    
-} WdfAdaptor;
-
 BiquadFilter* createBiquadFilter(BiquadType type);
 void resetState(BiquadFilter* bf);
 
-int checkFLoatUnderflow(float* val);
-
 float processKDirect(BiquadFilter* bf, float xn);
 float processKCanonical(BiquadFilter* bf, float xn);
 float processKTransposeDirect(BiquadFilter* bf, float xn);
 float processKTransposeCanonical(BiquadFilter* bf, float xn);
 
 Filter* createFilter(BiquadType bfType, FilterType fType, float freq, float q);
+void resetFilter(Filter* flt);
+/**
+ * @brief RBJ cookbook design, normalised so the feedback coefficients are b1/b2 and c0/d0 are 1/0.
+ */
+void calculateBiquadCoefficients(float* coefficients, FilterType type, float freq, float q);
+/**
+ * @brief Redesigns the filter only when type, cutoff or Q differ from what the current coefficients were built for.
+ * @return true if the coefficients were recomputed.
+ */
+bool setFilterParameters(Filter* flt, FilterType type, float freq, float q);
+/**
+ * @brief Per-block step towards the target cutoff/Q (log domain for the cutoff), snapping after resetFilter().
+ */
+bool smoothFilterParameters(Filter* flt, FilterType type, float targetFreq, float targetQ);
+/**
+ * @brief Runs up to BIQUAD_LANES stereo filters side by side (one voice per SIMD lane), in place.
+ * Uses the transposed canonical form regardless of each filter's BiquadType.
+ */
+void processFilterLanes(Filter** filters, float** left, float** right, int laneCount, int frameCount);
+
+bool isSvfFilterType(FilterType type);
+/**
+ * @brief Topology-preserving (zero-delay feedback) SVF over up to BIQUAD_LANES stereo voices, in place.
+ * The cutoff is read per sample from cutoff[lane][i]; the single g = tan(pi * fc / fs) coefficient comes from a
+ * rational approximation, so audio-rate modulation costs one divide per sample rather than a redesign.
+ * LP/BP/HP are all produced, the filter's type picks the one written back.
+ */
+void processSvfLanes(Filter** filters, float** left, float** right, float** cutoff, int laneCount, int frameCount);
+/**
+ * @brief Wave digital diode clipper, one voice at a time. The filter's Q is used as the input drive.
+ */
+void processWdfLanes(Filter** filters, float** left, float** right, int laneCount, int frameCount);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "granular.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oscillator.h"
+#include "resampler.h"
+#include "settings.h"
+#include "simd.h"
+
+// Hann, with guard points so the interpolation neither wraps nor reads past the end when the phase rounds up
+static float grainWindow[GRAIN_WINDOW_SIZE + 2];
+static bool windowReady = false;
+
+void initGranular() {
+	if(windowReady) {
+		return;
+	}
+	for(int i = 0; i <= GRAIN_WINDOW_SIZE; i++) {
+		grainWindow[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / GRAIN_WINDOW_SIZE));
+	}
+	grainWindow[GRAIN_WINDOW_SIZE + 1] = 0.0f;
+	windowReady = true;
+}
+
+GranularSource *createGranularSource(Sample *s) {
+	GranularSource *source = (GranularSource *)malloc(sizeof(GranularSource));
+	if(!source) {
+		printf("could not allocate memory for granular source.\n");
+		return NULL;
+	}
+	fillGranularSource(source, s);
+	return source;
+}
+
+void fillGranularSource(GranularSource *source, Sample *s) {
+	source->writeHead = 0;
+	source->length = 0;
+	source->sample = s;
+	const void *data = s ? __atomic_load_n(&s->data, __ATOMIC_ACQUIRE) : NULL;
+	if(!data || s->length < 2) {
+		return;
+	}
+	initResampler();
+	ResampleKernel kernel = getResampleKernel(RESAMPLE_SINC8, 1.0);
+	double step = (double)s->sampleRate / SAMPLE_RATE;
+	int frames = (int)((s->length - 1) / step);
+	frames = frames < GRANULAR_BUFFER_SIZE ? frames : GRANULAR_BUFFER_SIZE;
+	float right[PA_BUFFER_SIZE];
+	for(int done = 0; done < frames; done += PA_BUFFER_SIZE) {
+		int n = frames - done < PA_BUFFER_SIZE ? frames - done : PA_BUFFER_SIZE;
+		resampleSpan(data, s->format, s->length, s->channels, done * step, step, n, &kernel, false, source->buffer + done, right);
+	}
+	source->length = frames;
+	source->writeHead = frames % GRANULAR_BUFFER_SIZE;
+}
+
+void resetGrainCloud(GrainCloud *cloud) {
+	cloud->activeCount = 0;
+	cloud->untilOnset = 0.0f;
+	if(cloud->seed == 0) {
+		cloud->seed = 0x9e3779b9u;
+	}
+}
+
+// xorshift32, uniform in [-1, 1)
+static float nextSpray(GrainCloud *cloud) {
+	uint32_t x = cloud->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	cloud->seed = x;
+	return (float)(x >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+void setGrainSettings(GrainSettings *gs, const GranularSource *source, float density, float sizeMs, float position, float spray, float ratio, float rate) {
+	int length = source ? source->length : 0;
+	density = density < 0.01f ? 0.01f : density;
+	gs->interval = rate / density;
+	gs->size = (int)(sizeMs * 0.001f * rate);
+	gs->size = gs->size < 1 ? 1 : gs->size;
+	gs->position = position * (length > 1 ? length - 1 : 0);
+	gs->spray = spray * length;
+	gs->step = ratio * SAMPLE_RATE / rate;
+	// overlapping grains are mostly uncorrelated, so they add up by power
+	float overlap = density * sizeMs * 0.001f;
+	gs->gain = overlap > 1.0f ? 1.0f / sqrtf(overlap) : 1.0f;
+}
+
+static float wrapPosition(float position, int length) {
+	position = fmodf(position, (float)length);
+	position = position < 0.0f ? position + length : position;
+	// a tiny negative remainder plus length rounds to length itself, which would read one past the ring
+	return position >= length ? 0.0f : position;
+}
+
+static void startGrain(GrainCloud *cloud, const GranularSource *source, const GrainSettings *gs) {
+	Grain *g = &cloud->grains[cloud->activeCount++];
+	g->position = wrapPosition(gs->position + gs->spray * nextSpray(cloud), source->length);
+	g->phase = 0.0f;
+	g->phaseStep = (float)GRAIN_WINDOW_SIZE / gs->size;
+	g->step = gs->step;
+	g->gain = gs->gain;
+	g->framesLeft = gs->size;
+}
+
+static float grainFrame(const float *ring, int length, float position, float phase) {
+	int i = (int)position;
+	int next = i + 1 < length ? i + 1 : 0;
+	float s = ring[i] + (ring[next] - ring[i]) * (position - i);
+	int w = (int)phase;
+	float window = grainWindow[w] + (grainWindow[w + 1] - grainWindow[w]) * (phase - w);
+	return s * window;
+}
+
+// adds up to count - start frames of the grain into out from start, false once the grain has ended
+static bool renderGrain(Grain *g, const GranularSource *source, float *out, int start, int count) {
+	int n = count - start < g->framesLeft ? count - start : g->framesLeft;
+	const float *ring = source->buffer;
+	int length = source->length;
+	float len = (float)length;
+	float invLen = 1.0f / len;
+	const v4sf lane = { 0.0f, 1.0f, 2.0f, 3.0f };
+	v4sf position = v4sfSet1(g->position) + lane * g->step;
+	v4sf phase = v4sfSet1(g->phase) + lane * g->phaseStep;
+	v4sf positionStep = v4sfSet1(g->step * V4SF_LANES);
+	v4sf phaseStep = v4sfSet1(g->phaseStep * V4SF_LANES);
+	v4sf gain = v4sfSet1(g->gain);
+	int k = 0;
+	for(; k + V4SF_LANES <= n; k += V4SF_LANES) {
+		// the read heads run on past the end of the ring and are folded back per vector
+		v4sf wrapped = position - __builtin_convertvector(__builtin_convertvector(position * invLen, v4si), v4sf) * len;
+		wrapped = v4sfSelect(wrapped >= len, wrapped - len, wrapped);
+		v4si i = __builtin_convertvector(wrapped, v4si);
+		v4si next = i + 1;
+		next &= next < length;
+		v4sf frac = wrapped - __builtin_convertvector(i, v4sf);
+		v4si w = __builtin_convertvector(phase, v4si);
+		v4sf wfrac = phase - __builtin_convertvector(w, v4sf);
+		v4sf a = { ring[i[0]], ring[i[1]], ring[i[2]], ring[i[3]] };
+		v4sf b = { ring[next[0]], ring[next[1]], ring[next[2]], ring[next[3]] };
+		v4sf wa = { grainWindow[w[0]], grainWindow[w[1]], grainWindow[w[2]], grainWindow[w[3]] };
+		v4sf wb = { grainWindow[w[0] + 1], grainWindow[w[1] + 1], grainWindow[w[2] + 1], grainWindow[w[3] + 1] };
+		v4sf acc;
+		memcpy(&acc, out + start + k, sizeof(acc));
+		acc += (a + (b - a) * frac) * (wa + (wb - wa) * wfrac) * gain;
+		memcpy(out + start + k, &acc, sizeof(acc));
+		position += positionStep;
+		phase += phaseStep;
+	}
+	for(; k < n; k++) {
+		float p = wrapPosition(g->position + k * g->step, length);
+		out[start + k] += grainFrame(ring, length, p, g->phase + k * g->phaseStep) * g->gain;
+	}
+	g->position = wrapPosition(g->position + n * g->step, length);
+	g->phase += n * g->phaseStep;
+	g->framesLeft -= n;
+	return g->framesLeft > 0;
+}
+
+void renderGrainCloud(GrainCloud *cloud, const GranularSource *source, const GrainSettings *gs, float *out, int count) {
+	memset(out, 0, count * sizeof(float));
+	if(!source || source->length < 2) {
+		cloud->activeCount = 0;
+		return;
+	}
+
+	// grains carried over from the last block run from its first frame
+	for(int i = 0; i < cloud->activeCount;) {
+		if(renderGrain(&cloud->grains[i], source, out, 0, count)) {
+			i++;
+		} else {
+			cloud->grains[i] = cloud->grains[--cloud->activeCount];
+		}
+	}
+
+	// then every onset that falls in this block, from the frame it lands on
+	float t = cloud->untilOnset;
+	while(t < count) {
+		if(cloud->activeCount < GRAIN_POOL_SIZE) {
+			startGrain(cloud, source, gs);
+			if(!renderGrain(&cloud->grains[cloud->activeCount - 1], source, out, (int)t, count)) {
+				cloud->activeCount--;
+			}
+		}
+		t += gs->interval;
+	}
+	cloud->untilOnset = t - count;
+}
@@ -0,0 +1,81 @@
+#ifndef GRANULAR_H
+#define GRANULAR_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+#define GRANULAR_BUFFER_SIZE 441000 // 10 seconds
+#define GRAIN_WINDOW_SIZE 1024
+// grains one voice can have sounding at once, onsets beyond that are dropped
+#define GRAIN_POOL_SIZE 64
+#define GRAIN_MAX_DENSITY 200.0f // grains per second
+#define GRAIN_MIN_MS 5.0f
+#define GRAIN_MAX_MS 1000.0f
+#define GRAIN_MAX_PITCH 24.0f // semitones either way
+
+/**
+ * Source audio of a granular instrument, shared by all of its voices. The sample is rendered into the ring once at
+ * the engine rate, so grains are plain float reads whatever the sample's rate and storage format.
+ */
+typedef struct {
+	float buffer[GRANULAR_BUFFER_SIZE];
+	int writeHead; // next frame to write, the ring wraps once it is full
+	int length;    // frames written so far, at most GRANULAR_BUFFER_SIZE
+	Sample *sample;
+} GranularSource;
+
+typedef struct {
+	float position;  // read head in the source ring
+	float phase;     // through the window table
+	float phaseStep;
+	float step;      // ring frames per output frame
+	float gain;
+	int framesLeft;
+} Grain;
+
+/**
+ * A voice's grains. Active grains are kept packed at the front of the pool, so rendering costs what is sounding.
+ */
+typedef struct {
+	Grain grains[GRAIN_POOL_SIZE];
+	int activeCount;
+	float untilOnset; // output frames to the next onset, the fraction carries over so the spacing stays exact
+	uint32_t seed;
+} GrainCloud;
+
+// one block's worth of grain parameters, in output frames and ring frames
+typedef struct {
+	float interval; // between onsets
+	int size;
+	float position; // ring frame grains start around
+	float spray;    // random spread of the start, ring frames either side of position
+	float step;
+	float gain;     // keeps the level roughly even however many grains overlap
+} GrainSettings;
+
+/**
+ * @brief Builds the window table, safe to call repeatedly. Must have run before any cloud is rendered.
+ */
+void initGranular();
+GranularSource *createGranularSource(Sample *s);
+/**
+ * @brief Renders the sample (left channel) into the ring from the start, resampled to SAMPLE_RATE. Not realtime safe.
+ */
+void fillGranularSource(GranularSource *source, Sample *s);
+void resetGrainCloud(GrainCloud *cloud);
+/**
+ * @param density grains per second.
+ * @param position where grains start, 0 to 1 across what the ring holds.
+ * @param spray random spread of the start, as a fraction of the ring.
+ * @param ratio playback speed of each grain, 1 plays the source at its own pitch.
+ * @param rate output frames per second.
+ */
+void setGrainSettings(GrainSettings *gs, const GranularSource *source, float density, float sizeMs, float position, float spray, float ratio, float rate);
+/**
+ * @brief Renders count frames of the cloud into out (overwritten). Onsets land on the exact frame they fall on, each
+ *        grain is then rendered as one run through the block, four frames at a time.
+ */
+void renderGrainCloud(GrainCloud *cloud, const GranularSource *source, const GrainSettings *gs, float *out, int count);
+
+#endif
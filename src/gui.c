@@ -789,6 +789,7 @@ void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weigh
 
 	GuiNode *btnrow1 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_1", 0, 0);
 	GuiNode *btnrow2 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_2", 0, 0);
+	GuiNode *btnrow3 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_3", 0, 0);
 
 	GuiNode *rat1 = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "RATIO1", 1, incParameterBaseValue, inst->id.fm.ops[0]->ratio);
 	GuiNode *fb1 = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "FEEDBACK1", 0, incParameterBaseValue, inst->id.fm.ops[0]->feedbackAmount);
@@ -804,8 +805,14 @@ void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weigh
 	GuiNode *lvl4 = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "LEVEL4", 0, incParameterBaseValue, inst->id.fm.ops[3]->level);
 	GuiNode *alg = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "ALG", 0, incParameterBaseValue, inst->id.fm.selectedAlgorithm);
 	GuiNode *pan = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "PAN", 0, incParameterBaseValue, inst->panning);
+	GuiNode *oversample = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "OVERSMP", 0, incParameterBaseValue, inst->oversampling);
 	alg->draw = drawDiscreteDialGuiNode;
 	pan->draw = drawDiscreteDialGuiNode;
+	oversample->draw = drawDiscreteDialGuiNode;
+	GuiNode *filterType = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "FILTER", 0, incParameterBaseValue, inst->filterType);
+	GuiNode *cutoff = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "CUTOFF", 0, incParameterBaseValue, inst->filterCutoff);
+	GuiNode *resonance = createBtnGuiNode(0, 0, 100, 100, 2, na_horizontal, "RES", 0, incParameterBaseValue, inst->filterResonance);
+	filterType->draw = drawDiscreteDialGuiNode;
 	if(selected) {
 		g->selected = rat1;
 	}
@@ -815,6 +822,8 @@ void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weigh
 	GuiNode *sp3 = createBlankGuiNode();
 	GuiNode *sp4 = createBlankGuiNode();
 	GuiNode *sp5 = createBlankGuiNode();
+	GuiNode *sp6 = createBlankGuiNode();
+	GuiNode *sp7 = createBlankGuiNode();
 
 	appendItem(btnrow1, rat1, 40);
 	appendItem(btnrow1, fb1, 40);
@@ -825,6 +834,7 @@ void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weigh
 	appendItem(btnrow1, lvl2, 40);
 	appendItem(btnrow1, sp2, 5);
 	appendItem(btnrow1, pan, 20);
+	appendItem(btnrow1, oversample, 20);
 
 	appendItem(btnrow2, rat3, 40);
 	appendItem(btnrow2, fb3, 40);
@@ -835,9 +845,16 @@ void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weigh
 	appendItem(btnrow2, lvl4, 40);
 	appendItem(btnrow2, sp5, 5);
 	appendItem(btnrow2, alg, 20);
+	appendItem(btnrow2, sp6, 20);
+
+	appendItem(btnrow3, filterType, 40);
+	appendItem(btnrow3, cutoff, 40);
+	appendItem(btnrow3, resonance, 40);
+	appendItem(btnrow3, sp7, 170);
 
 	appendItem(btnwrap, btnrow1, 1);
 	appendItem(btnwrap, btnrow2, 1);
+	appendItem(btnwrap, btnrow3, 1);
 
 	appendItem(container, btnwrap, weight);
 }
@@ -853,11 +870,23 @@ void appendSampleInstControlNode(Graph *g, GuiNode *container, char *name, int w
 	GuiNode *sampleIndex = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "SAMPLE", selected, incParameterBaseValue, inst->id.sampler.sampleIndex);
 	GuiNode *pan = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PAN", 0, incParameterBaseValue, inst->panning);
 	GuiNode *loop = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "LOOP", 0, incParameterBaseValue, inst->id.sampler.loopSample);
+	GuiNode *oversample = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "OVERSMP", 0, incParameterBaseValue, inst->oversampling);
+	GuiNode *interpolation = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "INTERP", 0, incParameterBaseValue, inst->id.sampler.interpolation);
 	loop->draw = drawBtnGuiNode;
 	pan->draw = drawDiscreteDialGuiNode;
+	oversample->draw = drawDiscreteDialGuiNode;
+	interpolation->draw = drawDiscreteDialGuiNode;
 	GuiNode *loopStart = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "START", 0, incParameterBaseValue, inst->id.sampler.loopStartIndex);
 	GuiNode *loopEnd = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "END", 0, incParameterBaseValue, inst->id.sampler.loopEndIndex);
 	GuiNode *playbackType = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PLAYBACK", 0, incParameterBaseValue, inst->id.sampler.playbackType);
+	GuiNode *filterType = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "FILTER", 0, incParameterBaseValue, inst->filterType);
+	GuiNode *cutoff = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "CUTOFF", 0, incParameterBaseValue, inst->filterCutoff);
+	GuiNode *resonance = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "RES", 0, incParameterBaseValue, inst->filterResonance);
+	GuiNode *bitDepth = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "BITS", 0, incParameterBaseValue, inst->id.sampler.bitDepth);
+	GuiNode *bitRate = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "RATE", 0, incParameterBaseValue, inst->id.sampler.sampleRate);
+	GuiNode *dither = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "DITHER", 0, incParameterBaseValue, inst->id.sampler.dither);
+	filterType->draw = drawDiscreteDialGuiNode;
+	dither->draw = drawBtnGuiNode;
 	SampleWaveformGuiNode *swgn = createSampleWaveformGuiNode(0, 0, 100, 100, 5, na_vertical, "WFRM", 0, inst, inst->id.sampler.loopStartIndex, inst->id.sampler.loopEndIndex);
 	if(selected) {
 		g->selected = sampleIndex;
@@ -872,9 +901,17 @@ void appendSampleInstControlNode(Graph *g, GuiNode *container, char *name, int w
 	appendItem(btnrow1, loopStart, 1);
 	appendItem(btnrow1, loopEnd, 1);
 	appendItem(btnrow1, playbackType, 1);
-	appendItem(btnrow1, sp1, 2);
-
-	appendItem(btnrow2, (GuiNode *)swgn, 3);
+	appendItem(btnrow1, oversample, 1);
+	appendItem(btnrow1, interpolation, 1);
+	appendItem(btnrow1, sp1, 1);
+
+	appendItem(btnrow2, (GuiNode *)swgn, 9);
+	appendItem(btnrow2, filterType, 1);
+	appendItem(btnrow2, cutoff, 1);
+	appendItem(btnrow2, resonance, 1);
+	appendItem(btnrow2, bitDepth, 1);
+	appendItem(btnrow2, bitRate, 1);
+	appendItem(btnrow2, dither, 1);
 	appendItem(btnrow2, sp2, 1);
 
 	appendItem(btnwrap, btnrow1, 1);
@@ -893,7 +930,13 @@ void appendBlepInstControlNode(Graph *g, GuiNode *container, char *name, int wei
 
 	GuiNode *waveShape = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "SHAPE", selected, incParameterBaseValue, inst->id.blep.shape);
 	GuiNode *pan = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PAN", 0, incParameterBaseValue, inst->panning);
+	GuiNode *oversample = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "OVERSMP", 0, incParameterBaseValue, inst->oversampling);
 	pan->draw = drawDiscreteDialGuiNode;
+	oversample->draw = drawDiscreteDialGuiNode;
+	GuiNode *filterType = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "FILTER", 0, incParameterBaseValue, inst->filterType);
+	GuiNode *cutoff = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "CUTOFF", 0, incParameterBaseValue, inst->filterCutoff);
+	GuiNode *resonance = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "RES", 0, incParameterBaseValue, inst->filterResonance);
+	filterType->draw = drawDiscreteDialGuiNode;
 
 	if(selected) {
 		g->selected = waveShape;
@@ -904,8 +947,106 @@ void appendBlepInstControlNode(Graph *g, GuiNode *container, char *name, int wei
 
 	appendItem(btnrow1, waveShape, 1);
 	appendItem(btnrow1, pan, 1);
-	appendItem(btnrow1, sp1, 4);
+	appendItem(btnrow1, oversample, 1);
+	appendItem(btnrow1, sp1, 3);
+
+	appendItem(btnrow2, filterType, 1);
+	appendItem(btnrow2, cutoff, 1);
+	appendItem(btnrow2, resonance, 1);
+	appendItem(btnrow2, sp2, 3);
+
+	appendItem(btnwrap, btnrow1, 1);
+	appendItem(btnwrap, btnrow2, 1);
+
+	appendItem(container, btnwrap, weight);
+}
+
+void appendGranularInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst) {
+	GuiNode *btnwrap = createGuiNode(0, 0, 100, 100, 0, na_vertical, "GRAIN_CONTROLS", 0, 0);
+	btnwrap->draw = drawWrapperNode;
+	btnwrap->drawable = true;
 
+	GuiNode *btnrow1 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_1", 0, 0);
+	GuiNode *btnrow2 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_2", 0, 0);
+
+	GuiNode *density = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "DENSITY", selected, incParameterBaseValue, inst->id.granular.density);
+	GuiNode *grainMs = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "SIZE", 0, incParameterBaseValue, inst->id.granular.grainMs);
+	GuiNode *position = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "POS", 0, incParameterBaseValue, inst->id.granular.position);
+	GuiNode *pitch = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PITCH", 0, incParameterBaseValue, inst->id.granular.pitch);
+	GuiNode *spray = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "SPRAY", 0, incParameterBaseValue, inst->id.granular.spray);
+	GuiNode *pan = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PAN", 0, incParameterBaseValue, inst->panning);
+	GuiNode *oversample = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "OVERSMP", 0, incParameterBaseValue, inst->oversampling);
+	pan->draw = drawDiscreteDialGuiNode;
+	oversample->draw = drawDiscreteDialGuiNode;
+	GuiNode *filterType = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "FILTER", 0, incParameterBaseValue, inst->filterType);
+	GuiNode *cutoff = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "CUTOFF", 0, incParameterBaseValue, inst->filterCutoff);
+	GuiNode *resonance = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "RES", 0, incParameterBaseValue, inst->filterResonance);
+	filterType->draw = drawDiscreteDialGuiNode;
+
+	if(selected) {
+		g->selected = density;
+	}
+
+	GuiNode *sp1 = createBlankGuiNode();
+	GuiNode *sp2 = createBlankGuiNode();
+
+	appendItem(btnrow1, density, 1);
+	appendItem(btnrow1, grainMs, 1);
+	appendItem(btnrow1, position, 1);
+	appendItem(btnrow1, pitch, 1);
+	appendItem(btnrow1, spray, 1);
+	appendItem(btnrow1, sp1, 1);
+
+	appendItem(btnrow2, pan, 1);
+	appendItem(btnrow2, oversample, 1);
+	appendItem(btnrow2, filterType, 1);
+	appendItem(btnrow2, cutoff, 1);
+	appendItem(btnrow2, resonance, 1);
+	appendItem(btnrow2, sp2, 1);
+
+	appendItem(btnwrap, btnrow1, 1);
+	appendItem(btnwrap, btnrow2, 1);
+
+	appendItem(container, btnwrap, weight);
+}
+
+void appendSpectralInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst) {
+	GuiNode *btnwrap = createGuiNode(0, 0, 100, 100, 0, na_vertical, "SPECTRAL_CONTROLS", 0, 0);
+	btnwrap->draw = drawWrapperNode;
+	btnwrap->drawable = true;
+
+	GuiNode *btnrow1 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_1", 0, 0);
+	GuiNode *btnrow2 = createGuiNode(0, 0, 100, 100, 2, na_horizontal, "R_2", 0, 0);
+
+	GuiNode *speed = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "SPEED", selected, incParameterBaseValue, inst->id.spectral.speed);
+	GuiNode *pitch = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PITCH", 0, incParameterBaseValue, inst->id.spectral.pitch);
+	GuiNode *position = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "POS", 0, incParameterBaseValue, inst->id.spectral.position);
+	GuiNode *pan = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "PAN", 0, incParameterBaseValue, inst->panning);
+	GuiNode *oversample = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "OVERSMP", 0, incParameterBaseValue, inst->oversampling);
+	pan->draw = drawDiscreteDialGuiNode;
+	oversample->draw = drawDiscreteDialGuiNode;
+	GuiNode *filterType = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "FILTER", 0, incParameterBaseValue, inst->filterType);
+	GuiNode *cutoff = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "CUTOFF", 0, incParameterBaseValue, inst->filterCutoff);
+	GuiNode *resonance = createBtnGuiNode(0, 0, 100, 100, 5, na_horizontal, "RES", 0, incParameterBaseValue, inst->filterResonance);
+	filterType->draw = drawDiscreteDialGuiNode;
+
+	if(selected) {
+		g->selected = speed;
+	}
+
+	GuiNode *sp1 = createBlankGuiNode();
+	GuiNode *sp2 = createBlankGuiNode();
+
+	appendItem(btnrow1, speed, 1);
+	appendItem(btnrow1, pitch, 1);
+	appendItem(btnrow1, position, 1);
+	appendItem(btnrow1, sp1, 3);
+
+	appendItem(btnrow2, pan, 1);
+	appendItem(btnrow2, oversample, 1);
+	appendItem(btnrow2, filterType, 1);
+	appendItem(btnrow2, cutoff, 1);
+	appendItem(btnrow2, resonance, 1);
 	appendItem(btnrow2, sp2, 1);
 
 	appendItem(btnwrap, btnrow1, 1);
@@ -999,6 +1140,12 @@ Graph *createInstGraph(Instrument *inst, bool selected) {
 		case VOICE_TYPE_BLEP:
 			appendBlepInstControlNode(instGraph, instwrap, "blctrl", 8, true, inst);
 			break;
+		case VOICE_TYPE_GRAIN:
+			appendGranularInstControlNode(instGraph, instwrap, "grctrl", 8, true, inst);
+			break;
+		case VOICE_TYPE_SPECTRAL:
+			appendSpectralInstControlNode(instGraph, instwrap, "spctrl", 8, true, inst);
+			break;
 	}
 	appendItem(instwrap, pad2, 1);
 
@@ -1177,12 +1324,13 @@ void drawArrangerGuiNode(void *self) {
 OscilloscopeGui *createOscilloscopeGui(int x, int y, int w, int h) {
 	OscilloscopeGui *og = (OscilloscopeGui *)malloc(sizeof(OscilloscopeGui));
 	og->base.draw = drawOscilloscopeGui;
-	og->base.enabled = true;
 	og->shape.x = x;
 	og->shape.y = y;
 	og->shape.w = w < OSCILLOSCOPE_HISTORY ? w : OSCILLOSCOPE_HISTORY;
 	og->shape.h = h;
-	og->updateIndex = 0;
+	og->triggerLevel = 0.0f;
+	og->triggered = false;
+	og->base.enabled = false;
 	og->backgroundColour = &cs.highlightedCell;
 	og->waveformColour = &cs.backgroundColor;
 	og->lineColour = &cs.fontColour;
@@ -1201,11 +1349,55 @@ void drawOscilloscopeGui(void *self) {
 	}
 }
 
-void updateOscilloscopeGui(OscilloscopeGui *og, float *data, int length) {
-	for(int i = 0; i < length; i++) {
-		og->data[og->updateIndex] = data[i];
-		og->updateIndex++;
-		og->updateIndex %= og->shape.w;
+void updateOscilloscopeGui(OscilloscopeGui *og, AudioMeters *meters) {
+	float frames[OSCILLOSCOPE_HISTORY];
+	og->triggered = readScope(meters, frames, og->shape.w, og->triggerLevel);
+	for(int i = 0; i < og->shape.w; i++) {
+		og->data[i] = -frames[i] * og->shape.h / 2;
+	}
+}
+
+MeterGui *createMeterGui(AudioMeters *meters, int x, int y, int w, int h) {
+	MeterGui *mg = (MeterGui *)malloc(sizeof(MeterGui));
+	if(!mg) {
+		printf("could not allocate memory for meter gui.\n");
+		return NULL;
+	}
+	mg->base.draw = drawMeterGui;
+	mg->base.enabled = false;
+	mg->shape.x = x;
+	mg->shape.y = y;
+	mg->shape.w = w;
+	mg->shape.h = h;
+	mg->meters = meters;
+	for(int i = 0; i <= MAX_SEQUENCER_CHANNELS; i++) {
+		mg->peak[i] = 0.0f;
+		mg->rms[i] = 0.0f;
+	}
+	return mg;
+}
+
+void updateMeterGui(MeterGui *mg) {
+	for(int i = 0; i <= MAX_SEQUENCER_CHANNELS; i++) {
+		Meter *meter = i < MAX_SEQUENCER_CHANNELS ? &mg->meters->channels[i] : &mg->meters->master;
+		float peak = takeMeterPeak(meter);
+		mg->peak[i] = peak > mg->peak[i] * METER_GUI_PEAK_DECAY ? peak : mg->peak[i] * METER_GUI_PEAK_DECAY;
+		mg->rms[i] = getMeterRms(meter);
+	}
+}
+
+void drawMeterGui(void *self) {
+	MeterGui *mg = (MeterGui *)self;
+	// a channel bar per channel, the master gets two
+	int barW = mg->shape.w / (MAX_SEQUENCER_CHANNELS + 2);
+	DrawRectangle(mg->shape.x, mg->shape.y, mg->shape.w, mg->shape.h, cs.backgroundColor);
+	for(int i = 0; i <= MAX_SEQUENCER_CHANNELS; i++) {
+		int x = mg->shape.x + i * barW;
+		int w = i < MAX_SEQUENCER_CHANNELS ? barW - 1 : barW * 2;
+		int rmsH = (int)(fminf(mg->rms[i], 1.0f) * mg->shape.h);
+		int peakY = mg->shape.y + mg->shape.h - (int)(fminf(mg->peak[i], 1.0f) * mg->shape.h);
+		DrawRectangle(x, mg->shape.y + mg->shape.h - rmsH, w, rmsH, cs.highlightedCell);
+		DrawRectangle(x, peakY, w, 1, mg->peak[i] >= 1.0f ? RED : cs.fontColour);
 	}
 }
 
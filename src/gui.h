@@ -10,6 +10,7 @@
 #include "input.h"
 #include "graph_gui.h"
 #include "voice.h"
+#include "meters.h"
 
 #define MAX_GRAPH_HISTORY 25
 #define MAX_BUTTON_ROWS 64
@@ -17,6 +18,7 @@
 #define MAX_BUTTON_CONTAINER_ROWS 64
 #define MAX_BUTTON_CONTAINER_COLS 64
 #define OSCILLOSCOPE_HISTORY 1024
+#define METER_GUI_PEAK_DECAY 0.95f
 
 typedef void (*CallbackApplicator)(void *self, float value);
 
@@ -61,13 +63,26 @@ typedef struct {
 typedef struct {
 	Drawable base;
 	Shape shape;
-	int updateIndex;
-	float data[OSCILLOSCOPE_HISTORY];
+	float triggerLevel;
+	bool triggered;
+	float data[OSCILLOSCOPE_HISTORY]; // pixel offsets from the centre line
 	Color *backgroundColour;
 	Color *waveformColour;
 	Color *lineColour;
 } OscilloscopeGui;
 
+/**
+ * Peak and rms of every channel plus the master, which is the wider bar on the right. Peaks fall back at
+ * METER_GUI_PEAK_DECAY per frame instead of following each block.
+ */
+typedef struct {
+	Drawable base;
+	Shape shape;
+	AudioMeters *meters;
+	float peak[MAX_SEQUENCER_CHANNELS + 1];
+	float rms[MAX_SEQUENCER_CHANNELS + 1];
+} MeterGui;
+
 typedef struct {
 	Drawable base;
 	Sequencer *sequencer;
@@ -246,6 +261,7 @@ ArrangerGui *createArrangerGui(Arranger *arranger, PatternList *patternList);
 SongMinimapGui *createSongMinimapGui(Arranger *arranger, int *songIndex, int x, int y);
 EnvelopeGui *createEnvelopeGui(Envelope *env, int x, int y, int w, int h);
 OscilloscopeGui *createOscilloscopeGui(int x, int y, int w, int h);
+MeterGui *createMeterGui(AudioMeters *meters, int x, int y, int w, int h);
 AlgoGraphGui *createAlgoGraphGui(Parameter *algorithm, int x, int y, int w, int h);
 
 typedef struct {
@@ -284,6 +300,8 @@ void drawWrapperNode(void *self);
 void appendFMInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst);
 void appendSampleInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst);
 void appendBlepInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst);
+void appendGranularInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst);
+void appendSpectralInstControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Instrument *inst);
 void appendADEnvControlNode(Graph *g, GuiNode *container, char *name, int weight, bool selected, Envelope *env);
 void appendBlankNode(GuiNode *container, int weight);
 Graph *createInstGraph(Instrument *inst, bool selected);
@@ -312,7 +330,12 @@ void drawArrangerGuiNode(void *self);
 void drawSongMinimapGui(void *self);
 void drawEnvelopeGui(void *self);
 void drawAlgoGraphGui(void *self);
-void updateOscilloscopeGui(OscilloscopeGui *og, float *data, int length);
+/**
+ * @brief Takes the newest scope frames from the meters, lined up on a rising edge through triggerLevel when there is one.
+ */
+void updateOscilloscopeGui(OscilloscopeGui *og, AudioMeters *meters);
+void updateMeterGui(MeterGui *mg);
+void drawMeterGui(void *self);
 void updateGraphGui(GraphGui *graphGui);
 void InitGUI(void);
 void DrawGUI(int currentScene);
@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "io.h"
+#include "denormal.h"
 #include "modsystem.h"
+#include "sample_cache.h"
 
 static int writeChunkHeader(FILE *file, const char *id) {
 	return fwrite(id, 1, 4, file) == 4;
@@ -115,109 +118,496 @@ void populateDirectoryList(DirectoryList *list, const char *dirPath) {
 #endif
 }
 
-void loadSamplesfromDirectory(const char *path, SamplePool *sp) {
-	DirectoryList *dirList = createDirectoryList();
-	populateDirectoryList(dirList, path);
+static uint16_t readLe16(const uint8_t *p) {
+	return (uint16_t)(p[0] | p[1] << 8);
+}
 
-	for(int i = 0; i < dirList->count; i++) {
-		load_wav_sample(dirList->file_paths[i], sp);
+static uint32_t readLe32(const uint8_t *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static bool parseFmtChunk(const uint8_t *chunk, uint32_t size, WavInfo *info) {
+	if(size < 16) {
+		printf("Invalid fmt chunk\n");
+		return false;
+	}
+	uint16_t audioFormat = readLe16(chunk);
+	info->numChannels = readLe16(chunk + 2);
+	info->sampleRate = readLe32(chunk + 4);
+	info->blockAlign = readLe16(chunk + 12);
+	info->bitsPerSample = readLe16(chunk + 14);
+	// WAVE_FORMAT_EXTENSIBLE carries the real format in the first two bytes of its sub format GUID
+	if(audioFormat == WAV_FORMAT_EXTENSIBLE && size >= 26) {
+		audioFormat = readLe16(chunk + 24);
 	}
 
-	freeDirectoryList(dirList);
+	int bits = info->bitsPerSample;
+	if(audioFormat == WAV_FORMAT_PCM && bits == 8) {
+		info->format = PCM_U8;
+	} else if(audioFormat == WAV_FORMAT_PCM && bits == 16) {
+		info->format = PCM_S16;
+	} else if(audioFormat == WAV_FORMAT_PCM && bits == 24) {
+		info->format = PCM_S24;
+	} else if(audioFormat == WAV_FORMAT_PCM && bits == 32) {
+		info->format = PCM_S32;
+	} else if(audioFormat == WAV_FORMAT_FLOAT && bits == 32) {
+		info->format = PCM_F32;
+	} else if(audioFormat == WAV_FORMAT_FLOAT && bits == 64) {
+		info->format = PCM_F64;
+	} else {
+		printf("Unsupported WAV format %d, %d bit\n", audioFormat, bits);
+		return false;
+	}
+	if(info->numChannels == 0 || info->blockAlign != info->numChannels * pcmBytesPerSample(info->format)) {
+		printf("Invalid WAV block alignment\n");
+		return false;
+	}
+	return true;
 }
 
-void load_wav_sample(const char *filename, SamplePool *sp) {
-	FILE *file = fopen(filename, "rb"); // Open the file in binary read mode
-	if(!file) {
-		printf("Failed to open sample file: %s\n", filename); // Error if file cannot be opened
+static void parseSmplChunk(const uint8_t *chunk, uint32_t size, SampleMarkers *markers) {
+	// 36 byte header, then 24 byte loop records: id, type, start, end (inclusive), fraction, play count
+	if(size < 36 + 24 || readLe32(chunk + 28) == 0) {
 		return;
 	}
+	markers->loopStart = readLe32(chunk + 36 + 8);
+	markers->loopEnd = readLe32(chunk + 36 + 12) + 1;
+}
 
-	WAVHeader header;
-	if(fread(&header, sizeof(WAVHeader), 1, file) != 1) {
-		printf("Failed to read WAV header\n"); // Error if header cannot be read
-		fclose(file);
+static void parseCueChunk(const uint8_t *chunk, uint32_t size, SampleMarkers *markers) {
+	// count, then 24 byte points: id, position, data chunk id, chunk start, block start, sample offset
+	if(size < 4) {
 		return;
 	}
+	uint32_t count = readLe32(chunk);
+	for(uint32_t i = 0; i < count && markers->cueCount < MAX_SAMPLE_CUES; i++) {
+		const uint8_t *point = chunk + 4 + i * 24;
+		if(point + 24 > chunk + size) {
+			break;
+		}
+		markers->cues[markers->cueCount++] = readLe32(point + 20);
+	}
+}
 
-	if(strncmp(header.chunkID, "RIFF", 4) != 0 || strncmp(header.format, "WAVE", 4) != 0) {
+// walks the RIFF chunks in any order, only fmt, data, smpl and cue are looked at, everything else is skipped
+static bool readWavInfo(FILE *file, WavInfo *info) {
+	uint8_t riff[12];
+	if(fread(riff, 1, sizeof(riff), file) != sizeof(riff)) {
+		printf("Failed to read WAV header\n"); // Error if header cannot be read
+		return false;
+	}
+	if(memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
 		printf("Invalid or unsupported WAV file format\n"); // Error if file is not a valid WAV
+		return false;
+	}
+
+	memset(info, 0, sizeof(WavInfo));
+	bool haveFmt = false;
+	bool haveData = false;
+	uint8_t chunkHeader[8];
+	while(fread(chunkHeader, 1, sizeof(chunkHeader), file) == sizeof(chunkHeader)) {
+		uint32_t size = readLe32(chunkHeader + 4);
+		long start = ftell(file);
+		if(memcmp(chunkHeader, "data", 4) == 0) {
+			info->dataOffset = start;
+			info->dataSize = size;
+			haveData = true;
+		} else if(memcmp(chunkHeader, "fmt ", 4) == 0) {
+			if(size > WAV_MAX_META_CHUNK_BYTES) {
+				printf("Oversized %.4s chunk\n", chunkHeader);
+				return false;
+			}
+			uint8_t chunk[WAV_MAX_META_CHUNK_BYTES];
+			if(fread(chunk, 1, size, file) != size) {
+				break;
+			}
+			if(!parseFmtChunk(chunk, size, info)) {
+				return false;
+			}
+			haveFmt = true;
+		} else if(memcmp(chunkHeader, "smpl", 4) == 0 || memcmp(chunkHeader, "cue ", 4) == 0) {
+			// only the head is parsed, loop and cue records past the buffer are skipped with the rest of the chunk
+			uint32_t parsed = size < WAV_MAX_META_CHUNK_BYTES ? size : WAV_MAX_META_CHUNK_BYTES;
+			uint8_t chunk[WAV_MAX_META_CHUNK_BYTES];
+			if(fread(chunk, 1, parsed, file) != parsed) {
+				break;
+			}
+			if(chunkHeader[0] == 's') {
+				parseSmplChunk(chunk, parsed, &info->markers);
+			} else {
+				parseCueChunk(chunk, parsed, &info->markers);
+			}
+		}
+		// chunks are word aligned
+		if(fseek(file, start + size + (size & 1), SEEK_SET) != 0) {
+			break;
+		}
+	}
+
+	if(!haveFmt || !haveData) {
+		printf("Failed to find %s chunk\n", haveFmt ? "data" : "fmt");
+		return false;
+	}
+	// a truncated file, or a streaming writer that never patched the size, has less data than it claims
+	fseek(file, 0, SEEK_END);
+	long available = ftell(file) - info->dataOffset;
+	if(available < (long)info->dataSize) {
+		info->dataSize = available > 0 ? (uint32_t)available : 0;
+	}
+	info->frameCount = info->dataSize / info->blockAlign;
+	if(info->markers.loopEnd > info->frameCount || info->markers.loopStart >= info->markers.loopEnd) {
+		info->markers.loopStart = 0;
+		info->markers.loopEnd = 0;
+	}
+	return info->frameCount > 0;
+}
+
+typedef struct {
+	uint8_t *raw;
+	float *interleaved;
+	float *front; // the kept channels, when they still need converting to the storage format
+	size_t channels; // the buffers hold PCM_CHUNK_FRAMES frames of this many channels
+} DecodeScratch;
+
+static bool growDecodeScratch(DecodeScratch *scratch, int channels) {
+	if(scratch->channels >= (size_t)channels) {
+		return true;
+	}
+	uint8_t *raw = (uint8_t *)realloc(scratch->raw, (size_t)PCM_CHUNK_FRAMES * channels * 8);
+	if(raw) scratch->raw = raw;
+	float *interleaved = (float *)realloc(scratch->interleaved, (size_t)PCM_CHUNK_FRAMES * channels * sizeof(float));
+	if(interleaved) scratch->interleaved = interleaved;
+	float *front = (float *)realloc(scratch->front, (size_t)PCM_CHUNK_FRAMES * SAMPLE_MAX_CHANNELS * sizeof(float));
+	if(front) scratch->front = front;
+	if(!raw || !interleaved || !front) {
+		printf("Failed to allocate memory for WAV data\n");
+		return false;
+	}
+	scratch->channels = channels;
+	return true;
+}
+
+static int sampleChannelCount(const WavInfo *info) {
+	return info->numChannels < SAMPLE_MAX_CHANNELS ? info->numChannels : SAMPLE_MAX_CHANNELS;
+}
+
+// int16 holds 8 and 16-bit sources exactly, anything finer stays float unless compact storage was asked for
+static SampleFormat sampleStorageFormat(int bitsPerSample, SampleStorage storage) {
+	if(bitsPerSample <= 16) {
+		return SAMPLE_S16;
+	}
+	return storage == SAMPLE_STORAGE_COMPACT ? SAMPLE_F16 : SAMPLE_F32;
+}
+
+// reads and converts PCM_CHUNK_FRAMES at a time into out, or straight into the cache file when the sample is streamed
+static bool decodeWavData(FILE *file, const WavInfo *info, void *out, SampleFormat outFormat, SampleStreamWriter *stream, DecodeScratch *scratch) {
+	if(!growDecodeScratch(scratch, info->numChannels) || fseek(file, info->dataOffset, SEEK_SET) != 0) {
+		return false;
+	}
+	int channels = sampleChannelCount(info);
+	for(int frame = 0; frame < info->frameCount; frame += PCM_CHUNK_FRAMES) {
+		int frames = info->frameCount - frame < PCM_CHUNK_FRAMES ? info->frameCount - frame : PCM_CHUNK_FRAMES;
+		if(fread(scratch->raw, info->blockAlign, frames, file) != (size_t)frames) {
+			printf("Failed to read WAV data\n");
+			return false;
+		}
+		size_t offset = (size_t)frame * channels;
+		int count = frames * channels;
+		if(stream) {
+			float *converted = scratch->interleaved;
+			pcmToFloat(scratch->raw, info->format, converted, frames * info->numChannels);
+			if(channels != info->numChannels) {
+				keepFrontChannels(converted, info->numChannels, scratch->front, channels, frames);
+				converted = scratch->front;
+			}
+			if(!writeSampleStream(stream, converted, count)) {
+				return false;
+			}
+		} else if(outFormat == SAMPLE_S16 && info->format == PCM_S16 && channels == info->numChannels) {
+			memcpy((int16_t *)out + offset, scratch->raw, count * sizeof(int16_t));
+		} else if(outFormat == SAMPLE_F32 && channels == info->numChannels) {
+			// mono and stereo convert straight into the sample, only wider files go through the scratch buffer
+			pcmToFloat(scratch->raw, info->format, (float *)out + offset, count);
+		} else {
+			float *converted = scratch->interleaved;
+			pcmToFloat(scratch->raw, info->format, converted, frames * info->numChannels);
+			if(channels != info->numChannels) {
+				keepFrontChannels(converted, info->numChannels, scratch->front, channels, frames);
+				converted = scratch->front;
+			}
+			floatToSampleFormat(converted, outFormat, (char *)out + offset * sampleFormatBytes(outFormat), count);
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	char *path;
+	int index;     // reserved pool slot
+	void *target;  // pool memory to decode into, NULL when the sample is streamed
+	SampleFormat format; // of target, what the pool settled on rather than what was asked for
+	WavInfo info;  // only read for files that are not in the cache
+	SampleFileStamp stamp;
+	bool stamped;
+	const SampleCacheEntry *cached; // unchanged since the cache was written
+	const void *cachedData;         // its frames in the blob, NULL if it was streamed
+} SampleLoadJob;
+
+typedef struct {
+	SamplePool *sp;
+	SampleCache cache;
+	SampleLoadJob *jobs;
+	int jobCount;
+	int nextJob;
+	int finished;
+	pthread_mutex_t lock;
+	pthread_cond_t progressed;
+} SampleLoader;
+
+// false means the cache could not supply the frames after all and the file has to be decoded
+static bool loadCachedSample(SamplePool *sp, SampleLoadJob *job) {
+	if(!job->cached) {
+		return false;
+	}
+	if(job->target) {
+		// a sample the pool now stores differently from last run is decoded again
+		if(!job->cachedData || job->cached->format != (int32_t)job->format) {
+			return false;
+		}
+		memcpy(job->target, job->cachedData, (size_t)job->cached->length * job->cached->channels * sampleFormatBytes(job->format));
+		commitSample(sp, job->index, NULL);
+		return true;
+	}
+	SampleStream *stream = openCachedSampleStream(job->path, job->cached->length * job->cached->channels);
+	if(stream) {
+		commitStreamedSample(sp, job->index, stream);
+		return true;
+	}
+	// the stream file is gone, it is recreated from the blob copy if there is one
+	if(job->cachedData && job->cached->format == SAMPLE_F32) {
+		commitSample(sp, job->index, job->cachedData);
+		return true;
+	}
+	return false;
+}
+
+static void runSampleLoadJob(SamplePool *sp, SampleLoadJob *job, DecodeScratch *scratch) {
+	if(loadCachedSample(sp, job)) {
+		return;
+	}
+	FILE *file = fopen(job->path, "rb");
+	if(!file) {
+		printf("Failed to open sample file: %s\n", job->path);
+		cancelSample(sp, job->index);
+		return;
+	}
+	if(job->cached && (!readWavInfo(file, &job->info) || job->info.frameCount != job->cached->length || sampleChannelCount(&job->info) != job->cached->channels)) {
+		printf("Sample file changed while loading: %s\n", job->path);
+		cancelSample(sp, job->index);
 		fclose(file);
 		return;
 	}
-	// Ensure the "data" subchunk is found
-	if(strncmp(header.subchunk2ID, "data", 4) != 0) {
-		printf("Failed to find data subchunk\n");
+	if(job->target) {
+		if(decodeWavData(file, &job->info, job->target, job->format, NULL, scratch)) {
+			commitSample(sp, job->index, NULL);
+		} else {
+			cancelSample(sp, job->index);
+		}
 		fclose(file);
 		return;
 	}
+	// streamed samples are decoded chunk by chunk into their cache file, never whole in memory
+	SampleStreamWriter writer;
+	SampleStream *stream = NULL;
+	if(beginSampleStream(&writer, job->path) && decodeWavData(file, &job->info, NULL, SAMPLE_F32, &writer, scratch)) {
+		stream = finishSampleStream(&writer);
+	}
+	cancelSampleStream(&writer);
+	if(stream) {
+		commitStreamedSample(sp, job->index, stream);
+	} else {
+		printf("Failed to map sample cache for %s\n", job->path);
+		cancelSample(sp, job->index);
+	}
+	fclose(file);
+}
 
-	// sample.sampleRate = header.sampleRate;
-	// sample.length = header.subchunk2Size / (header.bitsPerSample / 4);
-	// sample.bit = header.bitsPerSample * header.numChannels;
-	// sample.data = (float *)malloc(sample.length * sizeof(float));
-	// if (!sample.data)
-	// {
-	// 	printf("Failed to allocate memory for sample data\n");
-	// 	fclose(file);
-	// 	return sample;
-	// }
-
-	// Read and convert PCM data to float
-	int bit = header.bitsPerSample * header.numChannels;
-	int length = header.subchunk2Size / (header.bitsPerSample / 4);
-	float *data = (float *)malloc(sizeof(float) * length);
-	if(header.bitsPerSample == 8) {
-		uint8_t *pcm_data = (uint8_t *)malloc(header.subchunk2Size);
-		if(fread(pcm_data, 1, header.subchunk2Size, file) != header.subchunk2Size) {
-			printf("Failed to read WAV data\n");
-			free(pcm_data);
-			free(data);
-			fclose(file);
-			return;
+static void *sampleLoaderThread(void *arg) {
+	SampleLoader *loader = (SampleLoader *)arg;
+	// the format conversions run here, FTZ/DAZ has to be set per thread like on the audio thread
+	setFlushDenormals(true);
+	DecodeScratch scratch = { NULL, NULL, NULL, 0 };
+	pthread_mutex_lock(&loader->lock);
+	while(loader->nextJob < loader->jobCount) {
+		SampleLoadJob *job = &loader->jobs[loader->nextJob++];
+		pthread_mutex_unlock(&loader->lock);
+		runSampleLoadJob(loader->sp, job, &scratch);
+		pthread_mutex_lock(&loader->lock);
+		loader->finished++;
+		pthread_cond_signal(&loader->progressed);
+	}
+	pthread_mutex_unlock(&loader->lock);
+	free(scratch.raw);
+	free(scratch.interleaved);
+	free(scratch.front);
+	return NULL;
+}
+
+// headers are read and slots reserved in directory order so sample indices do not depend on thread timing
+static bool reserveSampleLoadJob(SamplePool *sp, const SampleCache *cache, const char *filename, SampleStorageFunc storage, void *userData, SampleLoadJob *job) {
+	job->path = (char *)filename;
+	job->cached = NULL;
+	job->cachedData = NULL;
+	job->stamped = getSampleFileStamp(filename, &job->stamp);
+	const SampleCacheEntry *entry = job->stamped && cache ? findSampleCacheEntry(cache, filename, &job->stamp) : NULL;
+	if(entry) {
+		job->index = reserveSample(sp, filename, entry->bit, entry->sampleRate, entry->length, entry->channels, sampleStorageFormat(entry->bit, storage ? storage(filename, entry->bit, userData) : SAMPLE_STORAGE_EXACT), &job->target);
+		if(job->index < 0) {
+			return false;
 		}
-		for(uint32_t i = 0; i < length; i++) {
-			float value = 0.0f;
-			for(uint16_t ch = 0; ch < header.numChannels; ch++) {
-				value += (pcm_data[i * header.numChannels + ch] - 128) / 128.0f;
+		job->format = sp->samples[job->index]->format;
+		job->cached = entry;
+		job->cachedData = getSampleCacheData(cache, entry);
+		setSampleMarkers(sp, job->index, &entry->markers);
+		return true;
+	}
+
+	FILE *file = fopen(filename, "rb");
+	if(!file) {
+		printf("Failed to open sample file: %s\n", filename);
+		return false;
+	}
+	bool valid = readWavInfo(file, &job->info);
+	fclose(file);
+	if(!valid) {
+		printf("Skipping sample file: %s\n", filename);
+		return false;
+	}
+	job->index = reserveSample(sp, filename, job->info.bitsPerSample, job->info.sampleRate, job->info.frameCount, sampleChannelCount(&job->info), sampleStorageFormat(job->info.bitsPerSample, storage ? storage(filename, job->info.bitsPerSample, userData) : SAMPLE_STORAGE_EXACT), &job->target);
+	if(job->index < 0) {
+		return false;
+	}
+	// a reserved slot belongs to its reserver, so its format can be read without the pool lock
+	job->format = sp->samples[job->index]->format;
+	setSampleMarkers(sp, job->index, &job->info.markers);
+	return true;
+}
+
+// closes the cache, and rewrites it if anything was decoded or a cached file has gone away
+static void updateSampleCache(SamplePool *sp, SampleLoader *loader) {
+	int hits = 0;
+	for(int i = 0; i < loader->jobCount; i++) {
+		hits += loader->jobs[i].cached != NULL;
+	}
+	bool unchanged = loader->cache.blob && hits == loader->jobCount && loader->cache.header->entryCount == (uint32_t)hits;
+	closeSampleCache(&loader->cache);
+	if(unchanged) {
+		return;
+	}
+
+	int *indices = (int *)malloc(sizeof(int) * (loader->jobCount + 1));
+	char **paths = (char **)malloc(sizeof(char *) * (loader->jobCount + 1));
+	SampleFileStamp *stamps = (SampleFileStamp *)malloc(sizeof(SampleFileStamp) * (loader->jobCount + 1));
+	if(indices && paths && stamps) {
+		int count = 0;
+		for(int i = 0; i < loader->jobCount; i++) {
+			if(loader->jobs[i].stamped) {
+				indices[count] = loader->jobs[i].index;
+				paths[count] = loader->jobs[i].path;
+				stamps[count] = loader->jobs[i].stamp;
+				count++;
 			}
-			data[i] = value / header.numChannels;
-		}
-		printf("Copied data (first 10 samples):\n");
-		for(int i = 0; i < 10; i++) {
-			printf("%f ", data[i]);
-		}
-		loadSample(sp, filename, data, header.bitsPerSample * header.numChannels, header.sampleRate, length);
-		free(pcm_data);
-		// free(data);
-	} else if(header.bitsPerSample == 16) {
-		int16_t *pcm_data = (int16_t *)malloc(header.subchunk2Size);
-		if(fread(pcm_data, sizeof(int16_t), header.subchunk2Size / 2, file) != header.subchunk2Size / 2) {
-			printf("Failed to read WAV data\n");
-			free(pcm_data);
-			free(data);
-			fclose(file);
-			return;
 		}
-		for(uint32_t i = 0; i < length; i++) {
-			float value = 0.0f;
-			for(uint16_t ch = 0; ch < header.numChannels; ch++) {
-				value += pcm_data[i * header.numChannels + ch] / 32768.0f;
-			}
-			data[i] = value / header.numChannels;
+		writeSampleCache(sp, indices, paths, stamps, count);
+	}
+	free(indices);
+	free(paths);
+	free(stamps);
+}
+
+void loadSamplesfromDirectory(const char *path, SamplePool *sp, SampleStorageFunc storage, SampleLoadProgressFunc progress, void *userData) {
+	DirectoryList *dirList = createDirectoryList();
+	populateDirectoryList(dirList, path);
+
+	SampleLoader loader;
+	loader.sp = sp;
+	loader.jobs = (SampleLoadJob *)malloc(sizeof(SampleLoadJob) * (dirList->count ? dirList->count : 1));
+	loader.jobCount = 0;
+	loader.nextJob = 0;
+	loader.finished = 0;
+	if(!loader.jobs) {
+		printf("could not allocate memory for sample load jobs.\n");
+		freeDirectoryList(dirList);
+		free(dirList);
+		return;
+	}
+	openSampleCache(&loader.cache);
+	for(int i = 0; i < dirList->count; i++) {
+		if(reserveSampleLoadJob(sp, &loader.cache, dirList->file_paths[i], storage, userData, &loader.jobs[loader.jobCount])) {
+			loader.jobCount++;
+		}
+	}
+	pthread_mutex_init(&loader.lock, NULL);
+	pthread_cond_init(&loader.progressed, NULL);
+
+	pthread_t threads[SAMPLE_LOADER_THREADS];
+	int threadCount = 0;
+	for(int i = 0; i < SAMPLE_LOADER_THREADS && i < loader.jobCount; i++) {
+		if(pthread_create(&threads[threadCount], NULL, sampleLoaderThread, &loader) == 0) {
+			threadCount++;
 		}
-		printf("Copied data (first 10 samples):\n");
-		for(int i = 0; i < 10; i++) {
-			printf("%f ", data[i]);
+	}
+	if(threadCount == 0) {
+		// no workers, decode on this thread and still report progress per file
+		DecodeScratch scratch = { NULL, NULL, NULL, 0 };
+		for(int i = 0; i < loader.jobCount; i++) {
+			runSampleLoadJob(sp, &loader.jobs[i], &scratch);
+			if(progress) progress(i + 1, loader.jobCount, userData);
 		}
-		loadSample(sp, filename, data, header.bitsPerSample * header.numChannels, header.sampleRate, length);
-		free(pcm_data);
-		// free(data);
+		free(scratch.raw);
+		free(scratch.interleaved);
+		free(scratch.front);
 	} else {
-		printf("Unsupported bit depth: %d\n", header.bitsPerSample);
-		fclose(file);
-		return;
+		// progress is reported from the calling thread, the splash screen has to draw from there
+		pthread_mutex_lock(&loader.lock);
+		int reported = -1;
+		while(reported < loader.jobCount) {
+			if(loader.finished == reported) {
+				pthread_cond_wait(&loader.progressed, &loader.lock);
+				continue;
+			}
+			reported = loader.finished;
+			pthread_mutex_unlock(&loader.lock);
+			if(progress) progress(reported, loader.jobCount, userData);
+			pthread_mutex_lock(&loader.lock);
+		}
+		pthread_mutex_unlock(&loader.lock);
+		for(int i = 0; i < threadCount; i++) {
+			pthread_join(threads[i], NULL);
+		}
 	}
 
-	fclose(file);
+	pthread_cond_destroy(&loader.progressed);
+	pthread_mutex_destroy(&loader.lock);
+	updateSampleCache(sp, &loader);
+	free(loader.jobs);
+	freeDirectoryList(dirList);
+	free(dirList);
+}
+
+// the callback form of a single storage choice, so one file goes through the same job as a directory
+static SampleStorage fixedSampleStorage(const char *path, int bitsPerSample, void *userData) {
+	return *(const SampleStorage *)userData;
+}
+
+void load_wav_sample(const char *filename, SamplePool *sp, SampleStorage storage) {
+	SampleLoadJob job;
+	if(!reserveSampleLoadJob(sp, NULL, filename, fixedSampleStorage, &storage, &job)) {
+		return;
+	}
+	DecodeScratch scratch = { NULL, NULL, NULL, 0 };
+	runSampleLoadJob(sp, &job, &scratch);
+	free(scratch.raw);
+	free(scratch.interleaved);
+	free(scratch.front);
 }
@@ -7,6 +7,7 @@
 #include "settings.h"
 #include "sequencer.h"
 #include "sample.h"
+#include "pcm.h"
 
 #define SEQ_MAGIC_HEADER "SEQ1"
 #define PATTERN_SECTION "PATT"
@@ -30,6 +31,24 @@ typedef struct {
 	size_t count;
 } DirectoryList;
 
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_FLOAT 0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+// a bigger fmt chunk is not a sane file, smpl and cue are only parsed this far
+#define WAV_MAX_META_CHUNK_BYTES 4096
+
+typedef struct {
+	PcmFormat format;
+	uint16_t numChannels;
+	uint32_t sampleRate;
+	uint16_t blockAlign;
+	uint16_t bitsPerSample;
+	long dataOffset;
+	uint32_t dataSize;
+	int frameCount;
+	SampleMarkers markers;
+} WavInfo;
+
 // File operation results
 typedef enum {
 	FILE_OK,
@@ -52,10 +71,33 @@ DirectoryList *createDirectoryList();
 void freeDirectoryList(DirectoryList *list);
 void populateDirectoryList(DirectoryList *list, const char *dirPath);
 
-void loadSamplesfromDirectory(const char *path, SamplePool *sp);
+/**
+ * @brief Called on the thread that started the load, after each finished file.
+ */
+typedef void (*SampleLoadProgressFunc)(int loaded, int total, void *userData);
+
+/**
+ * How a loaded sample is kept in the pool. Streamed samples are always float.
+ */
+typedef enum {
+	SAMPLE_STORAGE_EXACT,  // int16 for 8/16-bit files, float for anything finer
+	SAMPLE_STORAGE_COMPACT // int16 up to 16 bits, half floats above, only 11 significant bits so it has to be asked for
+} SampleStorage;
+
+/**
+ * @brief Picks the storage of one file in a directory load.
+ */
+typedef SampleStorage (*SampleStorageFunc)(const char *path, int bitsPerSample, void *userData);
+
+/**
+ * @brief Reserves a pool slot per WAV in directory order, then decodes them on SAMPLE_LOADER_THREADS workers straight
+ *        into pool memory. Returns once every file is loaded or has failed.
+ * @param storage NULL keeps every file SAMPLE_STORAGE_EXACT.
+ */
+void loadSamplesfromDirectory(const char *path, SamplePool *sp, SampleStorageFunc storage, SampleLoadProgressFunc progress, void *userData);
 
 // Sample load_raw_sample(const char *filename, int sample_rate);
-void load_wav_sample(const char *filename, SamplePool *sp);
+void load_wav_sample(const char *filename, SamplePool *sp, SampleStorage storage);
 /**
  * @brief Saves a colour scheme to a binary file
  * @param filename Path to save the colour scheme file
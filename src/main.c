@@ -18,6 +18,8 @@
 #include "distortion.h"
 #include "graph_gui.h"
 #include "dataviz.h"
+#include "denormal.h"
+#include "meters.h"
 
 typedef struct
 {
@@ -35,10 +37,27 @@ typedef struct
 	WavetablePool *wavetablePool;
 	Spectrogram spectrogram;
 	TimeGraph timeGraph;
+	AudioMeters *meters;
+	MeterGui *meterGui;
+	OscilloscopeGui *scopeGui;
 	PresetBank presetBank;
 } paTestData;
 
-void initApplication(paTestData *data, ApplicationState **appState, InstrumentGui **instrumentGui);
+void initApplication(paTestData *data, ApplicationState **appState, InstrumentGui **instrumentGui, Texture2D *loadingImage);
+
+static void drawLoadingScreen(Texture2D *loadingImage, float progress) {
+	BeginDrawing();
+	ClearBackground(BLACK);
+	float scale = loadingImage->height > SCREEN_H ? (float)SCREEN_H / loadingImage->height : .5;
+	int xOffset = (int)((loadingImage->width * scale - SCREEN_W) / 2);
+	DrawTextureEx(*loadingImage, (Vector2){ xOffset, 0 }, 0.0f, scale, WHITE);
+	DrawRectangle(0, SCREEN_H - 4, (int)(SCREEN_W * progress), 4, WHITE);
+	EndDrawing();
+}
+
+static void sampleLoadProgress(int loaded, int total, void *userData) {
+	drawLoadingScreen((Texture2D *)userData, total > 0 ? (float)loaded / total : 1.0f);
+}
 
 /* This routine will be called by the PortAudio engine when audio is needed.
 ** It may called at interrupt level on some machines so don't do anything
@@ -54,6 +73,10 @@ static int patestCallback(const void *inputBuffer, void *outputBuffer, unsigned
 	clock_t start, end;
 	double cpu_time_used;
 	start = clock();
+	// cheap enough to do every callback, and stays correct if the host hands us a different thread
+	setFlushDenormals(true);
+	// sample data read from here on may be moved or unloaded by the pool, it waits for us to leave the epoch
+	epochEnter(&data->samplePool->epoch, EPOCH_READER_AUDIO);
 	int stepSamples = data->arranger->tempoSettings.swingStep ? data->arranger->tempoSettings.samplesPerOddStep : data->arranger->tempoSettings.samplesPerEvenStep;
 	if(data->arranger->tempoSettings.samplesElapsed >= stepSamples) {
 		data->arranger->tempoSettings.samplesElapsed = 0;
@@ -78,74 +101,47 @@ static int patestCallback(const void *inputBuffer, void *outputBuffer, unsigned
 	// process song-level param changes:
 	processModulations(data->globalParameters, data->modList, 1.0f / framesPerBuffer);
 
-	for(i = 0; i < framesPerBuffer; i++) {
-		float left_output = 0.0f;
-		float right_output = 0.0f;
+	float mixL[PA_BUFFER_SIZE];
+	float mixR[PA_BUFFER_SIZE];
+	float channelL[PA_BUFFER_SIZE];
+	float channelR[PA_BUFFER_SIZE];
+	for(unsigned long offset = 0; offset < framesPerBuffer; offset += PA_BUFFER_SIZE) {
+		unsigned int frameCount = framesPerBuffer - offset < PA_BUFFER_SIZE ? framesPerBuffer - offset : PA_BUFFER_SIZE;
+		for(i = 0; i < frameCount; i++) {
+			mixL[i] = 0.0f;
+			mixR[i] = 0.0f;
+		}
 
+		// each voice renders its whole block (at its own oversampling factor) and is filtered before being mixed in. The
+		// channel gets a buffer of its own so it can be metered on its way into the mix
 		for(j = 0; j < data->arranger->enabledChannels; j++) {
-			for(int v = 0; v < data->voiceManager->voiceCount[j]; v++) {
-				Voice *currentVoice = data->voiceManager->voicePools[j][v];
-				if(currentVoice->active) {
-					processModulations(currentVoice->paramList, currentVoice->modList, 1.0f / SAMPLE_RATE);
-					// Handle envelope
-					if(!currentVoice->envelope[0]->isTriggered) {
-						setParameterValue(currentVoice->volume, 1.0f);
-						setParameterBaseValue(currentVoice->volume, 1.0f);
-						currentVoice->active = 0;
-						// printf("%i not triggered...", j);
-						if(currentVoice->type == VOICE_TYPE_SAMPLE) {
-							currentVoice->vd.sampler.samplePosition = 0.0f;
-						}
-					}
-
-					float phase_increment = 0.0f;
-					float freq = 0.0f;
-					if(currentVoice->note[0] != OFF) {
-						freq = noteFrequencies[currentVoice->note[0]][currentVoice->note[1]];
-						setParameterBaseValue(currentVoice->frequency, freq);
-						setParameterValue(currentVoice->frequency, freq);
-						phase_increment = freq / SAMPLE_RATE;
-					}
-
-					OutVal currentSample = generateVoice(data->voiceManager, currentVoice, phase_increment, freq);
-
-					if(data->arranger->playing) {
-						// float vol = getParameterValue(currentVoice->volume);
-						// if(j == 0){
-						// 	printf("VOLUME: %f\n", vol);
-						// }
-						left_output += currentSample.L * getParameterValue(currentVoice->volume);
-						right_output += currentSample.R * getParameterValue(currentVoice->volume);
-						currentVoice->leftPhase = fmodf(currentVoice->leftPhase + phase_increment, 1.0f);
-						currentVoice->rightPhase = fmodf(currentVoice->rightPhase + phase_increment, 1.0f);
-
-						currentVoice->samplesElapsed++;
-					} else {
-						currentSample.L = 0;
-						currentSample.R = 0;
-					}
-				} else {
-					//	data->voices[j].mod[0].result = 0;
-				}
+			for(i = 0; i < frameCount; i++) {
+				channelL[i] = 0.0f;
+				channelR[i] = 0.0f;
 			}
+			renderChannelBlock(data->voiceManager, j, channelL, channelR, frameCount, data->arranger->playing);
+			mixAndMeterBlock(&data->meters->channels[j], channelL, channelR, mixL, mixR, frameCount);
 		}
 
-		// Track the maximum output value
-		if(fabsf(left_output) > max_output)
-			max_output = fabsf(left_output);
-		if(fabsf(right_output) > max_output)
-			max_output = fabsf(right_output);
+		for(i = 0; i < frameCount; i++) {
+			float left_output = mixL[i];
+			float right_output = mixR[i];
 
-		*out++ = left_output;
-		*out++ = right_output;
+			// Track the maximum output value
+			if(fabsf(left_output) > max_output)
+				max_output = fabsf(left_output);
+			if(fabsf(right_output) > max_output)
+				max_output = fabsf(right_output);
 
-		pushFrameToFFT(&data->spectrogram.fft, left_output);
+			*out++ = left_output;
+			*out++ = right_output;
 
-		data->arranger->tempoSettings.samplesElapsed++;
+			data->arranger->tempoSettings.samplesElapsed++;
+		}
+		pushSpectrogramAudio(&data->spectrogram, mixL, frameCount);
+		meterMasterBlock(data->meters, mixL, mixR, frameCount);
 	}
 
-	processFFTData(&data->spectrogram.fft);
-
 	// Normalize the entire buffer to avoid clipping
 	//  if (max_output > MAX_VOLUME)
 	//  {
@@ -159,6 +155,7 @@ static int patestCallback(const void *inputBuffer, void *outputBuffer, unsigned
 	end = clock();
 	cpu_time_used = (((double)(end - start)) / CLOCKS_PER_SEC) * 1000.0f;
 	pushTimeGraphMeasurement(&data->timeGraph, cpu_time_used);
+	epochExit(&data->samplePool->epoch, EPOCH_READER_AUDIO);
 	return 0;
 }
 
@@ -167,19 +164,17 @@ int main(void) {
 	PaError err;
 	paTestData data;
 	ApplicationState *appState;
+	if(!setFlushDenormals(true)) {
+		printf("WARNING: no flush-to-zero control on this target, denormals will be processed in software.\n");
+	}
 	// loading screen
 
 	InitGUI();
 	Texture2D loadingImage = LoadTexture("resources/images/spectrax_splash5_fix_2x.png");
 
-	BeginDrawing();
-	ClearBackground(BLACK);
-	float scale = loadingImage.height > SCREEN_H ? (float)SCREEN_H / loadingImage.height : .5;
-	int xOffset = (int)((loadingImage.width * scale - SCREEN_W) / 2);
-	DrawTextureEx(loadingImage, (Vector2){ xOffset, 0 }, 0.0f, scale, WHITE);
-	EndDrawing();
+	drawLoadingScreen(&loadingImage, 0.0f);
 
-	initApplication(&data, &appState, NULL);
+	initApplication(&data, &appState, NULL, &loadingImage);
 	initModSystem();
 
 	err = Pa_Initialize();
@@ -207,6 +202,7 @@ int main(void) {
 		clearBg();
 		updateSpectrogramData(&data.spectrogram);
 		updateTimeGraphData(&data.timeGraph);
+		maintainSamplePool(data.samplePool);
 		// printf("checking inputs...\n");
 		// Global Navigation Controls
 		if(isKeyJustPressed(appState->inputState, KM_START)) {
@@ -366,7 +362,9 @@ int main(void) {
 		if(isKeyHeld(appState->inputState, KM_MOD_EXTRA)) {
 			if(isKeyJustPressed(appState->inputState, KM_START)) {
 				toggleSpectrogram(&data.spectrogram);
-				toggleSpectrogram(&data.timeGraph);
+				toggleTimeGraph(&data.timeGraph);
+				data.meterGui->base.enabled = !data.meterGui->base.enabled;
+				data.scopeGui->base.enabled = !data.scopeGui->base.enabled;
 			}
 			if(isKeyJustPressed(appState->inputState, KM_RIGHT)) {
 				incWindowFunc(&data.spectrogram.fft, true);
@@ -374,6 +372,15 @@ int main(void) {
 			if(isKeyJustPressed(appState->inputState, KM_LEFT)) {
 				incWindowFunc(&data.spectrogram.fft, false);
 			}
+			if(isKeyJustPressed(appState->inputState, KM_UP)) {
+				incSpectrogramScale(&data.spectrogram);
+			}
+			if(isKeyJustPressed(appState->inputState, KM_DOWN)) {
+				toggleSpectrogramAggregate(&data.spectrogram);
+			}
+			if(isKeyJustPressed(appState->inputState, KM_FUNCTION)) {
+				toggleSpectrogramMultiResolution(&data.spectrogram);
+			}
 			if(isKeyJustPressed(appState->inputState, KM_SELECT)) {
 				printArrGraph();
 			}
@@ -383,6 +390,14 @@ int main(void) {
 
 		drawSpectrogram(&data.spectrogram);
 		drawTimeGraph(&data.timeGraph);
+		if(data.meterGui->base.enabled) {
+			updateMeterGui(data.meterGui);
+			drawMeterGui(data.meterGui);
+		}
+		if(data.scopeGui->base.enabled) {
+			updateOscilloscopeGui(data.scopeGui, data.meters);
+			drawOscilloscopeGui(data.scopeGui);
+		}
 		DrawFPS(SCREEN_W - 80, 5);
 		EndDrawing();
 	}
@@ -399,6 +414,8 @@ int main(void) {
 		goto error;
 	Pa_Terminate();
 
+	freeSpectrogram(&data.spectrogram);
+	freeAudioMeters(data.meters);
 	freeSamplePool(data.samplePool);
 	cleanupModSystem(data.modList);
 
@@ -418,11 +435,18 @@ error:
 	return err;
 }
 
-void initApplication(paTestData *data, ApplicationState **appState, InstrumentGui **instrumentGui) {
+void initApplication(paTestData *data, ApplicationState **appState, InstrumentGui **instrumentGui, Texture2D *loadingImage) {
 	Settings *settings = createSettings();
 	loadColourSchemeTxt("colourscheme2.txt", getColorSchemeAsPointerArray(), 9);
 	initSpectrogram(&data->spectrogram, 4096, 256, 5, 1.0);
 	initTimeGraph(&data->timeGraph, 1024, 0, 640, 1024, 128);
+	data->meters = createAudioMeters();
+	if(!data->meters) {
+		printf("meter creation failed.\n");
+		return;
+	}
+	data->meterGui = createMeterGui(data->meters, SCREEN_W - 110, 24, 100, 80);
+	data->scopeGui = createOscilloscopeGui(SCREEN_W - 266, 110, 256, 64);
 	data->globalParameters = createParamList();
 	*appState = createApplicationState();
 	if(!*appState) {
@@ -435,7 +459,7 @@ void initApplication(paTestData *data, ApplicationState **appState, InstrumentGu
 		printf("samplePool creation failed.\n");
 		return;
 	}
-	loadSamplesfromDirectory("resources/samples/", data->samplePool);
+	loadSamplesfromDirectory("resources/samples/", data->samplePool, NULL, sampleLoadProgress, loadingImage);
 	data->modList = createModList();
 	if(!data->modList) {
 		printf("modList creation failed.\n");
@@ -0,0 +1,111 @@
+#include "meters.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int floatBits(float value) {
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float bitsFloat(unsigned int bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+AudioMeters *createAudioMeters() {
+	AudioMeters *meters = (AudioMeters *)malloc(sizeof(AudioMeters));
+	if(!meters) {
+		printf("could not allocate memory for audio meters.\n");
+		return NULL;
+	}
+	for(int i = 0; i <= MAX_SEQUENCER_CHANNELS; i++) {
+		Meter *meter = i < MAX_SEQUENCER_CHANNELS ? &meters->channels[i] : &meters->master;
+		meter->meanSquare = 0.0f;
+		atomic_init(&meter->peak, floatBits(0.0f));
+		atomic_init(&meter->rms, floatBits(0.0f));
+	}
+	memset(meters->scope, 0, sizeof(meters->scope));
+	atomic_init(&meters->scopeWritten, 0);
+	meters->scopePhase = 0;
+	return meters;
+}
+
+void freeAudioMeters(AudioMeters *meters) {
+	free(meters);
+}
+
+static void publishMeter(Meter *meter, float peak, float sumSquares, int count) {
+	// the GUI may have just taken the peak, re-publishing an older one then only makes it show a block longer
+	if(peak > bitsFloat(atomic_load_explicit(&meter->peak, memory_order_relaxed))) {
+		atomic_store_explicit(&meter->peak, floatBits(peak), memory_order_relaxed);
+	}
+	float coefficient = count / (METER_RMS_TIME * PA_SR);
+	coefficient = coefficient < 1.0f ? coefficient : 1.0f;
+	meter->meanSquare += coefficient * (sumSquares / (2 * count) - meter->meanSquare);
+	atomic_store_explicit(&meter->rms, floatBits(sqrtf(meter->meanSquare)), memory_order_relaxed);
+}
+
+void mixAndMeterBlock(Meter *meter, const float *left, const float *right, float *mixLeft, float *mixRight, int count) {
+	float peak = 0.0f;
+	float sumSquares = 0.0f;
+	for(int i = 0; i < count; i++) {
+		mixLeft[i] += left[i];
+		mixRight[i] += right[i];
+		peak = fmaxf(peak, fmaxf(fabsf(left[i]), fabsf(right[i])));
+		sumSquares += left[i] * left[i] + right[i] * right[i];
+	}
+	if(count > 0) {
+		publishMeter(meter, peak, sumSquares, count);
+	}
+}
+
+void meterMasterBlock(AudioMeters *meters, const float *left, const float *right, int count) {
+	float peak = 0.0f;
+	float sumSquares = 0.0f;
+	unsigned int written = atomic_load_explicit(&meters->scopeWritten, memory_order_relaxed);
+	for(int i = 0; i < count; i++) {
+		peak = fmaxf(peak, fmaxf(fabsf(left[i]), fabsf(right[i])));
+		sumSquares += left[i] * left[i] + right[i] * right[i];
+		if(meters->scopePhase-- == 0) {
+			meters->scopePhase = SCOPE_DECIMATION - 1;
+			meters->scope[written++ & (SCOPE_RING_SIZE - 1)] = 0.5f * (left[i] + right[i]);
+		}
+	}
+	if(count > 0) {
+		publishMeter(&meters->master, peak, sumSquares, count);
+	}
+	atomic_store_explicit(&meters->scopeWritten, written, memory_order_release);
+}
+
+float takeMeterPeak(Meter *meter) {
+	return bitsFloat(atomic_exchange_explicit(&meter->peak, floatBits(0.0f), memory_order_relaxed));
+}
+
+float getMeterRms(Meter *meter) {
+	return bitsFloat(atomic_load_explicit(&meter->rms, memory_order_relaxed));
+}
+
+bool readScope(AudioMeters *meters, float *out, int count, float triggerLevel) {
+	unsigned int written = atomic_load_explicit(&meters->scopeWritten, memory_order_acquire);
+	unsigned int start = written - count;
+	bool triggered = false;
+	// searched newest first over the count frames before that, so the view sticks to the same edge
+	for(unsigned int i = start; i != start - count; i--) {
+		float previous = meters->scope[(i - 1) & (SCOPE_RING_SIZE - 1)];
+		float current = meters->scope[i & (SCOPE_RING_SIZE - 1)];
+		if(previous < triggerLevel && current >= triggerLevel) {
+			start = i;
+			triggered = true;
+			break;
+		}
+	}
+	for(int i = 0; i < count; i++) {
+		out[i] = meters->scope[(start + i) & (SCOPE_RING_SIZE - 1)];
+	}
+	return triggered;
+}
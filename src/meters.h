@@ -0,0 +1,60 @@
+#ifndef METERS_H
+#define METERS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "settings.h"
+
+#define SCOPE_RING_SIZE 4096 // scope frames, a power of two
+#define SCOPE_DECIMATION 2   // output frames per scope frame
+#define METER_RMS_TIME 0.3f  // seconds the rms settles over
+
+/**
+ * Levels of one signal. The audio thread keeps meanSquare to itself and publishes the results as float bits once per
+ * block, so neither side ever waits on the other.
+ */
+typedef struct {
+	float meanSquare;
+	atomic_uint peak; // highest magnitude since the GUI last took it
+	atomic_uint rms;
+} Meter;
+
+/**
+ * Written by the audio callback, read by the GUI. The scope is a ring of decimated master frames (the mean of both
+ * sides). Frames are written before scopeWritten is released, and a reader that stays well behind the newest frame
+ * never sees one being overwritten.
+ */
+typedef struct {
+	Meter channels[MAX_SEQUENCER_CHANNELS];
+	Meter master;
+	float scope[SCOPE_RING_SIZE];
+	atomic_uint scopeWritten; // scope frames ever written
+	int scopePhase;           // audio thread only, output frames until the next scope frame
+} AudioMeters;
+
+AudioMeters *createAudioMeters();
+void freeAudioMeters(AudioMeters *meters);
+
+/**
+ * @brief Adds a channel's block into the mix and meters it in the same pass. Audio thread only.
+ */
+void mixAndMeterBlock(Meter *meter, const float *left, const float *right, float *mixLeft, float *mixRight, int count);
+/**
+ * @brief Meters the master block and appends it to the scope. Audio thread only.
+ */
+void meterMasterBlock(AudioMeters *meters, const float *left, const float *right, int count);
+
+/**
+ * @brief Returns the peak since the last call and starts a new one.
+ */
+float takeMeterPeak(Meter *meter);
+float getMeterRms(Meter *meter);
+/**
+ * @brief Copies count scope frames, starting at the latest rising crossing of triggerLevel that still leaves count
+ *        frames after it, or the newest count frames if there is none. count must be at most SCOPE_RING_SIZE / 4.
+ * @return whether the view is triggered.
+ */
+bool readScope(AudioMeters *meters, float *out, int count, float triggerLevel);
+
+#endif
@@ -0,0 +1,140 @@
+#include "oversampler.h"
+
+#include <math.h>
+#include <string.h>
+
+// final 2x -> 1x stage, Blackman windowed half-band, 47 taps (~74dB stopband, passband to ~17kHz at 44.1kHz)
+#define OS_LONG_K 11
+// first 4x -> 2x stage only has to keep images out of 0-22kHz, so a much shorter filter will do
+#define OS_SHORT_K 4
+
+static float longStageCoefficients[OS_HB_MAX_EVEN_TAPS];
+static float shortStageCoefficients[OS_HB_MAX_EVEN_TAPS];
+static bool coefficientsReady = false;
+
+static void designHalfband(float *evenTaps, int k) {
+	int length = 4 * k + 3;
+	int centre = (length - 1) / 2;
+	int evenCount = 2 * k + 2;
+	float sum = 0.0f;
+	for(int j = 0; j < evenCount; j++) {
+		int n = 2 * j;
+		float t = (float)(n - centre);
+		float sinc = sinf(M_PI * t * 0.5f) / (M_PI * t * 0.5f);
+		float window = 0.42f - 0.5f * cosf((2.0f * M_PI * n) / (length - 1)) + 0.08f * cosf((4.0f * M_PI * n) / (length - 1));
+		evenTaps[j] = 0.5f * sinc * window;
+		sum += evenTaps[j];
+	}
+	// the centre tap carries exactly half of the DC gain, the even branch the other half
+	for(int j = 0; j < evenCount; j++) {
+		evenTaps[j] *= 0.5f / sum;
+	}
+}
+
+static void initCoefficients() {
+	if(coefficientsReady) {
+		return;
+	}
+	designHalfband(longStageCoefficients, OS_LONG_K);
+	designHalfband(shortStageCoefficients, OS_SHORT_K);
+	coefficientsReady = true;
+}
+
+void initHalfbandDecimator(HalfbandDecimator *hb, int k) {
+	initCoefficients();
+	hb->evenTapCount = 2 * k + 2;
+	hb->oddDelay = k;
+	hb->evenIndex = 0;
+	hb->oddIndex = 0;
+	hb->coefficients = k == OS_LONG_K ? longStageCoefficients : shortStageCoefficients;
+	memset(hb->evenHistory, 0, sizeof(hb->evenHistory));
+	memset(hb->oddHistory, 0, sizeof(hb->oddHistory));
+}
+
+float processHalfbandDecimator(HalfbandDecimator *hb, float x0, float x1) {
+	int evenLength = hb->evenTapCount;
+	int oddLength = hb->oddDelay + 1;
+
+	hb->evenIndex = hb->evenIndex == 0 ? evenLength - 1 : hb->evenIndex - 1;
+	hb->evenHistory[hb->evenIndex] = x1;
+	hb->evenHistory[hb->evenIndex + evenLength] = x1;
+
+	hb->oddIndex = hb->oddIndex == 0 ? oddLength - 1 : hb->oddIndex - 1;
+	hb->oddHistory[hb->oddIndex] = x0;
+	hb->oddHistory[hb->oddIndex + oddLength] = x0;
+
+	const float *history = &hb->evenHistory[hb->evenIndex];
+	float acc = 0.5f * hb->oddHistory[hb->oddIndex + hb->oddDelay];
+	for(int j = 0; j < evenLength; j++) {
+		acc += hb->coefficients[j] * history[j];
+	}
+	return acc;
+}
+
+int getOversamplingFactor(OversamplingMode mode) {
+	switch(mode) {
+		case OS_2X:
+			return 2;
+		case OS_4X:
+			return 4;
+		default:
+		case OS_OFF:
+			return 1;
+	}
+}
+
+void resetOversampler(Oversampler *os) {
+	for(int c = 0; c < 2; c++) {
+		switch(os->mode) {
+			case OS_2X:
+				initHalfbandDecimator(&os->stages[0][c], OS_LONG_K);
+				break;
+			case OS_4X:
+				initHalfbandDecimator(&os->stages[0][c], OS_SHORT_K);
+				initHalfbandDecimator(&os->stages[1][c], OS_LONG_K);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void initOversampler(Oversampler *os, OversamplingMode mode) {
+	os->mode = mode < 0 || mode >= OS_COUNT ? OS_OFF : mode;
+	os->factor = getOversamplingFactor(os->mode);
+	resetOversampler(os);
+}
+
+bool setOversamplingMode(Oversampler *os, OversamplingMode mode) {
+	if(mode < 0 || mode >= OS_COUNT) {
+		mode = OS_OFF;
+	}
+	if(mode == os->mode) {
+		return false;
+	}
+	initOversampler(os, mode);
+	return true;
+}
+
+void decimateFrame(Oversampler *os, float *subL, float *subR, float *outL, float *outR) {
+	switch(os->mode) {
+		case OS_2X:
+			*outL = processHalfbandDecimator(&os->stages[0][0], subL[0], subL[1]);
+			*outR = processHalfbandDecimator(&os->stages[0][1], subR[0], subR[1]);
+			break;
+		case OS_4X: {
+			float l0 = processHalfbandDecimator(&os->stages[0][0], subL[0], subL[1]);
+			float l1 = processHalfbandDecimator(&os->stages[0][0], subL[2], subL[3]);
+			float r0 = processHalfbandDecimator(&os->stages[0][1], subR[0], subR[1]);
+			float r1 = processHalfbandDecimator(&os->stages[0][1], subR[2], subR[3]);
+			*outL = processHalfbandDecimator(&os->stages[1][0], l0, l1);
+			*outR = processHalfbandDecimator(&os->stages[1][1], r0, r1);
+			break;
+		}
+		default:
+		case OS_OFF:
+			*outL = subL[0];
+			*outR = subR[0];
+			break;
+	}
+}
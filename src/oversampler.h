@@ -0,0 +1,57 @@
+#ifndef OVERSAMPLER_H
+#define OVERSAMPLER_H
+
+#include <stdbool.h>
+
+#define OS_MAX_STAGES 2
+#define OS_MAX_FACTOR (1 << OS_MAX_STAGES)
+// half-band length is 4 * K + 3 taps, only the 2 * K + 2 even taps (plus the 0.5 centre tap) are non-zero
+#define OS_HB_MAX_EVEN_TAPS 24
+
+typedef enum {
+	OS_OFF,
+	OS_2X,
+	OS_4X,
+	OS_COUNT
+} OversamplingMode;
+
+typedef struct {
+	int evenTapCount;
+	int oddDelay;
+	int evenIndex;
+	int oddIndex;
+	// history is stored twice so the convolution can always read a contiguous run
+	float evenHistory[OS_HB_MAX_EVEN_TAPS * 2];
+	float oddHistory[OS_HB_MAX_EVEN_TAPS * 2];
+	const float *coefficients;
+} HalfbandDecimator;
+
+typedef struct {
+	OversamplingMode mode;
+	int factor;
+	HalfbandDecimator stages[OS_MAX_STAGES][2]; // [stage][channel]
+} Oversampler;
+
+void initOversampler(Oversampler *os, OversamplingMode mode);
+/**
+ * @brief Switches the oversampling mode, clearing decimator state only when the mode changes.
+ * @return true if the mode changed.
+ */
+bool setOversamplingMode(Oversampler *os, OversamplingMode mode);
+int getOversamplingFactor(OversamplingMode mode);
+void resetOversampler(Oversampler *os);
+
+/**
+ * @brief Sets up a half-band decimator of 4 * k + 3 taps (k selects one of the precomputed designs).
+ */
+void initHalfbandDecimator(HalfbandDecimator *hb, int k);
+/**
+ * @brief Polyphase decimate-by-2: consumes two consecutive input samples and returns one output sample.
+ */
+float processHalfbandDecimator(HalfbandDecimator *hb, float x0, float x1);
+/**
+ * @brief Decimates os->factor consecutive stereo sub-samples down to a single output frame.
+ */
+void decimateFrame(Oversampler *os, float *subL, float *subR, float *outL, float *outR);
+
+#endif
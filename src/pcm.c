@@ -0,0 +1,229 @@
+#include "pcm.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+// WAV data is little-endian, as are all the targets, so samples are loaded with plain memcpy
+typedef uint8_t v4qu __attribute__((vector_size(4)));
+typedef int16_t v4hi __attribute__((vector_size(8)));
+typedef double v4df __attribute__((vector_size(32)));
+
+int pcmBytesPerSample(PcmFormat format) {
+	switch(format) {
+		case PCM_U8:
+			return 1;
+		case PCM_S16:
+			return 2;
+		case PCM_S24:
+			return 3;
+		case PCM_S32:
+		case PCM_F32:
+			return 4;
+		case PCM_F64:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+static void convertU8(const uint8_t *src, float *dst, int count) {
+	const v4sf scale = v4sfSet1(1.0f / 128.0f);
+	const v4si bias = { 128, 128, 128, 128 };
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		v4qu raw;
+		memcpy(&raw, src + i, sizeof(raw));
+		v4sf v = __builtin_convertvector(__builtin_convertvector(raw, v4si) - bias, v4sf) * scale;
+		memcpy(dst + i, &v, sizeof(v));
+	}
+	for(; i < count; i++) {
+		dst[i] = (src[i] - 128) * (1.0f / 128.0f);
+	}
+}
+
+static void convertS16(const uint8_t *src, float *dst, int count) {
+	const v4sf scale = v4sfSet1(1.0f / 32768.0f);
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		v4hi raw;
+		memcpy(&raw, src + i * 2, sizeof(raw));
+		v4sf v = __builtin_convertvector(raw, v4sf) * scale;
+		memcpy(dst + i, &v, sizeof(v));
+	}
+	for(; i < count; i++) {
+		int16_t s;
+		memcpy(&s, src + i * 2, sizeof(s));
+		dst[i] = s * (1.0f / 32768.0f);
+	}
+}
+
+static void convertS24(const uint8_t *src, float *dst, int count) {
+	// placing the three bytes in the top of an int32 lets the sign come along for free
+	const v4sf scale = v4sfSet1(1.0f / 2147483648.0f);
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		const uint8_t *p = src + i * 3;
+		v4si raw = {
+			(int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24),
+			(int32_t)((uint32_t)p[3] << 8 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 24),
+			(int32_t)((uint32_t)p[6] << 8 | (uint32_t)p[7] << 16 | (uint32_t)p[8] << 24),
+			(int32_t)((uint32_t)p[9] << 8 | (uint32_t)p[10] << 16 | (uint32_t)p[11] << 24),
+		};
+		v4sf v = __builtin_convertvector(raw, v4sf) * scale;
+		memcpy(dst + i, &v, sizeof(v));
+	}
+	for(; i < count; i++) {
+		const uint8_t *p = src + i * 3;
+		int32_t s = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+		dst[i] = s * (1.0f / 2147483648.0f);
+	}
+}
+
+static void convertS32(const uint8_t *src, float *dst, int count) {
+	const v4sf scale = v4sfSet1(1.0f / 2147483648.0f);
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		v4si raw;
+		memcpy(&raw, src + i * 4, sizeof(raw));
+		v4sf v = __builtin_convertvector(raw, v4sf) * scale;
+		memcpy(dst + i, &v, sizeof(v));
+	}
+	for(; i < count; i++) {
+		int32_t s;
+		memcpy(&s, src + i * 4, sizeof(s));
+		dst[i] = s * (1.0f / 2147483648.0f);
+	}
+}
+
+static void convertF64(const uint8_t *src, float *dst, int count) {
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		v4df raw;
+		memcpy(&raw, src + i * 8, sizeof(raw));
+		v4sf v = __builtin_convertvector(raw, v4sf);
+		memcpy(dst + i, &v, sizeof(v));
+	}
+	for(; i < count; i++) {
+		double s;
+		memcpy(&s, src + i * 8, sizeof(s));
+		dst[i] = (float)s;
+	}
+}
+
+void pcmToFloat(const void *src, PcmFormat format, float *dst, int count) {
+	const uint8_t *bytes = (const uint8_t *)src;
+	switch(format) {
+		case PCM_U8:
+			convertU8(bytes, dst, count);
+			break;
+		case PCM_S16:
+			convertS16(bytes, dst, count);
+			break;
+		case PCM_S24:
+			convertS24(bytes, dst, count);
+			break;
+		case PCM_S32:
+			convertS32(bytes, dst, count);
+			break;
+		case PCM_F32:
+			memcpy(dst, bytes, count * sizeof(float));
+			break;
+		case PCM_F64:
+			convertF64(bytes, dst, count);
+			break;
+		default:
+			memset(dst, 0, count * sizeof(float));
+			break;
+	}
+}
+
+void keepFrontChannels(const float *src, int srcChannels, float *dst, int dstChannels, int frames) {
+	for(int i = 0; i < frames; i++) {
+		for(int ch = 0; ch < dstChannels; ch++) {
+			dst[i * dstChannels + ch] = src[i * srcChannels + ch];
+		}
+	}
+}
+
+int sampleFormatBytes(SampleFormat format) {
+	switch(format) {
+		case SAMPLE_S16:
+		case SAMPLE_F16:
+			return 2;
+		case SAMPLE_F32:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+float halfToFloat(uint16_t h) {
+	v4sf f = v4sfFromHalf((v4si){ h, 0, 0, 0 });
+	return f[0];
+}
+
+static uint16_t floatToHalf(float value) {
+	const uint32_t f32Infinity = 255u << 23;
+	const uint32_t f16Max = (127u + 16u) << 23;
+	const uint32_t denormalMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+	uint32_t f;
+	memcpy(&f, &value, sizeof(f));
+	uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+	uint32_t o;
+	if(f >= f16Max) {
+		o = f > f32Infinity ? 0x7e00 : 0x7c00;
+	} else if(f < (113u << 23)) {
+		// the float add does the denormal shift and its rounding in one go
+		float magic;
+		float v;
+		memcpy(&magic, &denormalMagic, sizeof(magic));
+		memcpy(&v, &f, sizeof(v));
+		v += magic;
+		memcpy(&o, &v, sizeof(o));
+		o -= denormalMagic;
+	} else {
+		uint32_t mantissaOdd = (f >> 13) & 1;
+		f += ((uint32_t)(15 - 127) << 23) + 0xfff;
+		f += mantissaOdd;
+		o = f >> 13;
+	}
+	return (uint16_t)(o | (sign >> 16));
+}
+
+static void floatToS16(const float *src, int16_t *dst, int count) {
+	const v4sf scale = v4sfSet1(32768.0f);
+	const v4sf lo = v4sfSet1(-32768.0f);
+	const v4sf hi = v4sfSet1(32767.0f);
+	int i = 0;
+	for(; i + V4SF_LANES <= count; i += V4SF_LANES) {
+		v4sf v;
+		memcpy(&v, src + i, sizeof(v));
+		v4hi s = __builtin_convertvector(v4sfRound(v4sfMin(v4sfMax(v * scale, lo), hi)), v4hi);
+		memcpy(dst + i, &s, sizeof(s));
+	}
+	for(; i < count; i++) {
+		float v = src[i] * 32768.0f;
+		v = v < -32768.0f ? -32768.0f : v > 32767.0f ? 32767.0f : v;
+		dst[i] = (int16_t)lrintf(v);
+	}
+}
+
+void floatToSampleFormat(const float *src, SampleFormat format, void *dst, int count) {
+	switch(format) {
+		case SAMPLE_S16:
+			floatToS16(src, (int16_t *)dst, count);
+			break;
+		case SAMPLE_F16:
+			for(int i = 0; i < count; i++) {
+				((uint16_t *)dst)[i] = floatToHalf(src[i]);
+			}
+			break;
+		default:
+			memcpy(dst, src, count * sizeof(float));
+			break;
+	}
+}
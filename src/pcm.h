@@ -0,0 +1,61 @@
+#ifndef PCM_H
+#define PCM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// frames converted per pass when decoding, keeps the raw read buffer small whatever the file size
+#define PCM_CHUNK_FRAMES 4096
+
+typedef enum {
+	PCM_U8,  // 8-bit WAV is unsigned
+	PCM_S16,
+	PCM_S24, // packed, 3 bytes per sample
+	PCM_S32,
+	PCM_F32,
+	PCM_F64,
+	PCM_FORMAT_COUNT
+} PcmFormat;
+
+// how a loaded sample is kept in memory, the resampler converts while it interpolates
+typedef enum {
+	SAMPLE_F32,
+	SAMPLE_S16, // lossless for 8 and 16-bit sources
+	SAMPLE_F16, // IEEE half, 11 significant bits at any level
+	SAMPLE_FORMAT_COUNT
+} SampleFormat;
+
+/**
+ * @brief Bytes per single-channel sample, 0 for an invalid format.
+ */
+int pcmBytesPerSample(PcmFormat format);
+/**
+ * @brief Converts count little-endian interleaved samples to float in [-1, 1), four at a time.
+ */
+void pcmToFloat(const void *src, PcmFormat format, float *dst, int count);
+/**
+ * @brief Copies the first dstChannels of each interleaved frame, WAV puts the front left/right pair first.
+ *        dst may not alias src.
+ */
+void keepFrontChannels(const float *src, int srcChannels, float *dst, int dstChannels, int frames);
+int sampleFormatBytes(SampleFormat format);
+/**
+ * @brief Stores count floats in a sample storage format, int16 is rounded and clipped, half rounds to nearest even.
+ */
+void floatToSampleFormat(const float *src, SampleFormat format, void *dst, int count);
+float halfToFloat(uint16_t h);
+/**
+ * @brief One value of stored sample data as a float, for the paths that are not worth vectorising.
+ */
+static inline float loadSampleValue(const void *data, SampleFormat format, size_t index) {
+	switch(format) {
+		case SAMPLE_S16:
+			return ((const int16_t *)data)[index] * (1.0f / 32768.0f);
+		case SAMPLE_F16:
+			return halfToFloat(((const uint16_t *)data)[index]);
+		default:
+			return ((const float *)data)[index];
+	}
+}
+
+#endif
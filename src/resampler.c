@@ -0,0 +1,304 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+
+static float sinc8Tables[RESAMPLER_BANDS][RESAMPLER_PHASES][8];
+static float sinc16Tables[RESAMPLER_BANDS][RESAMPLER_PHASES][16];
+static float sinc32Tables[RESAMPLER_BANDS][RESAMPLER_PHASES][32];
+static bool tablesReady = false;
+
+static double sinc(double x) {
+	return fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+}
+
+// Blackman window over the kernel span, same family as the oversampler half-bands
+static double window(double t, double halfWidth) {
+	if(fabs(t) >= halfWidth) {
+		return 0.0;
+	}
+	double x = M_PI * t / halfWidth;
+	return 0.42 + 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+}
+
+static void designKernel(float *table, int taps, double cutoff) {
+	double halfWidth = taps / 2;
+	for(int p = 0; p < RESAMPLER_PHASES; p++) {
+		double frac = (double)p / RESAMPLER_PHASES;
+		float *row = &table[p * taps];
+		double sum = 0.0;
+		for(int j = 0; j < taps; j++) {
+			double t = (j - taps / 2 + 1) - frac;
+			double h = cutoff * sinc(cutoff * t) * window(t, halfWidth);
+			row[j] = (float)h;
+			sum += h;
+		}
+		// every phase gets unity DC gain, otherwise the gain ripples with the fractional position
+		for(int j = 0; j < taps; j++) {
+			row[j] = (float)(row[j] / sum);
+		}
+	}
+}
+
+void initResampler() {
+	if(tablesReady) {
+		return;
+	}
+	for(int b = 0; b < RESAMPLER_BANDS; b++) {
+		double cutoff = RESAMPLER_PASSBAND / pow(2.0, b * 0.5);
+		designKernel(&sinc8Tables[b][0][0], 8, cutoff);
+		designKernel(&sinc16Tables[b][0][0], 16, cutoff);
+		designKernel(&sinc32Tables[b][0][0], 32, cutoff);
+	}
+	tablesReady = true;
+}
+
+ResampleKernel getResampleKernel(ResampleMode mode, double ratio) {
+	ResampleKernel kernel = { 0, NULL };
+	// smallest half-octave step whose cutoff is still below the output Nyquist
+	int band = ratio > 1.0 ? (int)ceil(2.0 * log2(ratio) - 1e-9) : 0;
+	band = band < RESAMPLER_BANDS ? band : RESAMPLER_BANDS - 1;
+	switch(mode) {
+		case RESAMPLE_SINC8:
+			kernel.taps = 8;
+			kernel.table = &sinc8Tables[band][0][0];
+			break;
+		case RESAMPLE_SINC16:
+			kernel.taps = 16;
+			kernel.table = &sinc16Tables[band][0][0];
+			break;
+		case RESAMPLE_SINC32:
+			kernel.taps = 32;
+			kernel.table = &sinc32Tables[band][0][0];
+			break;
+		case RESAMPLE_LINEAR:
+		default:
+			break;
+	}
+	return kernel;
+}
+
+typedef short v8hi __attribute__((vector_size(16)));
+typedef long long v2di __attribute__((vector_size(16)));
+
+#define RESAMPLER_INLINE static inline __attribute__((always_inline))
+
+// int16 data is interpolated unscaled and scaled once per output frame
+static float storedScale(SampleFormat format) {
+	return format == SAMPLE_S16 ? 1.0f / 32768.0f : 1.0f;
+}
+
+// one stored value, unscaled
+RESAMPLER_INLINE float loadRaw(const void *data, SampleFormat format, size_t index) {
+	switch(format) {
+		case SAMPLE_S16:
+			return ((const int16_t *)data)[index];
+		case SAMPLE_F16:
+			return v4sfFromHalf((v4si){ ((const uint16_t *)data)[index], 0, 0, 0 })[0];
+		default:
+			return ((const float *)data)[index];
+	}
+}
+
+// four consecutive stored values, unscaled, converted in registers
+RESAMPLER_INLINE v4sf loadRaw4(const void *data, SampleFormat format, size_t index) {
+	// 16-bit values are loaded as one 64-bit lane and widened with an unpack, a plain convert of a short vector goes
+	// lane by lane without SSE4.1
+	long long bits;
+	v8hi raw;
+	v4sf v;
+	switch(format) {
+		case SAMPLE_S16:
+			memcpy(&bits, (const int16_t *)data + index, sizeof(bits));
+			raw = (v8hi)(v2di){ bits, 0 };
+			raw = __builtin_shuffle(raw, (v8hi){ 0, 0, 1, 1, 2, 2, 3, 3 });
+			v = __builtin_convertvector((v4si)raw >> 16, v4sf);
+			break;
+		case SAMPLE_F16:
+			memcpy(&bits, (const uint16_t *)data + index, sizeof(bits));
+			raw = (v8hi)(v2di){ bits, 0 };
+			raw = __builtin_shuffle(raw, (v8hi){ 0 }, (v8hi){ 0, 8, 1, 9, 2, 10, 3, 11 });
+			v = v4sfFromHalf((v4si)raw);
+			break;
+		default:
+			memcpy(&v, (const float *)data + index, sizeof(v));
+			break;
+	}
+	return v;
+}
+
+static void resampleLinear(const void *data, SampleFormat format, int length, int channels, int index, float frac, bool loop, float *out) {
+	int next = index + 1;
+	if(next >= length) {
+		next = loop ? next - length : length - 1;
+	}
+	for(int ch = 0; ch < channels; ch++) {
+		float a = loadSampleValue(data, format, (size_t)index * channels + ch);
+		float b = loadSampleValue(data, format, (size_t)next * channels + ch);
+		out[ch] = a * (1.0f - frac) + b * frac;
+	}
+}
+
+// taps near either end of the sample, read one by one
+static void resampleEdge(const void *data, SampleFormat format, int length, int channels, int start, const float *row, int taps, bool loop, float *out) {
+	for(int ch = 0; ch < channels; ch++) {
+		out[ch] = 0.0f;
+	}
+	for(int j = 0; j < taps; j++) {
+		int i = start + j;
+		if(i < 0 || i >= length) {
+			if(!loop) {
+				continue;
+			}
+			i %= length;
+			i += i < 0 ? length : 0;
+		}
+		for(int ch = 0; ch < channels; ch++) {
+			out[ch] += loadSampleValue(data, format, (size_t)i * channels + ch) * row[j];
+		}
+	}
+}
+
+RESAMPLER_INLINE float convolveMono(const void *data, SampleFormat format, size_t start, const float *row, int taps) {
+	v4sf acc = v4sfSet1(0.0f);
+	for(int j = 0; j < taps; j += V4SF_LANES) {
+		v4sf h;
+		memcpy(&h, row + j, sizeof(h));
+		acc += loadRaw4(data, format, start + j) * h;
+	}
+	return v4sfSum(acc);
+}
+
+// each vector holds two interleaved frames, the taps are spread to match so left and right accumulate side by side
+RESAMPLER_INLINE void convolveStereo(const void *data, SampleFormat format, size_t start, const float *row, int taps, float *out) {
+	v4sf acc = v4sfSet1(0.0f);
+	for(int j = 0; j < taps; j += V4SF_LANES) {
+		v4sf h;
+		memcpy(&h, row + j, sizeof(h));
+		v4sf lo = loadRaw4(data, format, start + j * 2);
+		v4sf hi = loadRaw4(data, format, start + j * 2 + V4SF_LANES);
+		acc += lo * __builtin_shuffle(h, (v4si){ 0, 0, 1, 1 });
+		acc += hi * __builtin_shuffle(h, (v4si){ 2, 2, 3, 3 });
+	}
+	out[0] = acc[0] + acc[2];
+	out[1] = acc[1] + acc[3];
+}
+
+void resampleAt(const void *data, SampleFormat format, int length, int channels, double position, const ResampleKernel *kernel, bool loop, float *out) {
+	int index = (int)position;
+	double frac = position - index;
+	if(kernel->taps == 0) {
+		resampleLinear(data, format, length, channels, index, (float)frac, loop, out);
+		return;
+	}
+
+	int phase = (int)(frac * RESAMPLER_PHASES + 0.5);
+	index += phase >> RESAMPLER_PHASE_BITS;
+	phase &= RESAMPLER_PHASES - 1;
+	int taps = kernel->taps;
+	const float *row = &kernel->table[phase * taps];
+	int start = index - taps / 2 + 1;
+	if(start < 0 || start + taps > length) {
+		resampleEdge(data, format, length, channels, start, row, taps, loop, out);
+	} else if(channels == 2) {
+		convolveStereo(data, format, (size_t)start * 2, row, taps, out);
+		out[0] *= storedScale(format);
+		out[1] *= storedScale(format);
+	} else {
+		out[0] = convolveMono(data, format, start, row, taps) * storedScale(format);
+	}
+}
+
+// frames of the span whose position lies in [lo, hi), positions move monotonically so this is a single range
+static void spanRange(double position, double step, int count, double lo, double hi, int *first, int *end) {
+	double a;
+	double b;
+	if(step > 0.0) {
+		a = ceil((lo - position) / step);
+		b = ceil((hi - position) / step);
+	} else if(step < 0.0) {
+		a = floor((position - hi) / -step) + 1.0;
+		b = floor((position - lo) / -step) + 1.0;
+	} else {
+		bool inside = position >= lo && position < hi;
+		a = 0.0;
+		b = inside ? count : 0.0;
+	}
+	a = a < 0.0 ? 0.0 : a > count ? count : a;
+	b = b < a ? a : b > count ? count : b;
+	*first = (int)a;
+	*end = (int)b;
+}
+
+// the unchecked part of a span, inlined once per storage format so each gets its own conversion in the inner loop
+RESAMPLER_INLINE void resampleInterior(const void *data, SampleFormat format, int channels, double position, double step, int first, int end, const ResampleKernel *kernel, float *outL, float *outR) {
+	int taps = kernel->taps;
+	float scale = storedScale(format);
+	float frame[2];
+	for(int k = first; k < end; k++) {
+		double p = position + k * step;
+		int index = (int)p;
+		double frac = p - index;
+		if(taps == 0) {
+			float f = (float)frac;
+			size_t x = (size_t)index * channels;
+			float l0 = loadRaw(data, format, x);
+			float l1 = loadRaw(data, format, x + channels);
+			float r0 = loadRaw(data, format, x + channels - 1);
+			float r1 = loadRaw(data, format, x + 2 * channels - 1);
+			outL[k] = (l0 + (l1 - l0) * f) * scale;
+			outR[k] = (r0 + (r1 - r0) * f) * scale;
+			continue;
+		}
+		int phase = (int)(frac * RESAMPLER_PHASES + 0.5);
+		index += phase >> RESAMPLER_PHASE_BITS; // rounding up to the next whole sample
+		phase &= RESAMPLER_PHASES - 1;
+		const float *row = &kernel->table[phase * taps];
+		size_t start = (size_t)(index - taps / 2 + 1) * channels;
+		if(channels == 2) {
+			convolveStereo(data, format, start, row, taps, frame);
+			outL[k] = frame[0] * scale;
+			outR[k] = frame[1] * scale;
+		} else {
+			outL[k] = convolveMono(data, format, start, row, taps) * scale;
+			outR[k] = outL[k];
+		}
+	}
+}
+
+void resampleSpan(const void *data, SampleFormat format, int length, int channels, double position, double step, int count, const ResampleKernel *kernel, bool loop, float *outL, float *outR) {
+	// a frame is interior when every tap it could touch (including the rounded up phase) is inside the sample,
+	// one extra frame of margin on each side absorbs rounding in spanRange
+	int taps = kernel->taps;
+	double lo = taps ? taps / 2 : 1.0;
+	double hi = taps ? length - taps / 2 - 2 : length - 2;
+	int first;
+	int end;
+	spanRange(position, step, count, lo, hi, &first, &end);
+
+	float frame[2];
+	for(int k = 0; k < first; k++) {
+		resampleAt(data, format, length, channels, position + k * step, kernel, loop, frame);
+		outL[k] = frame[0];
+		outR[k] = frame[channels - 1];
+	}
+	switch(format) {
+		case SAMPLE_S16:
+			resampleInterior(data, SAMPLE_S16, channels, position, step, first, end, kernel, outL, outR);
+			break;
+		case SAMPLE_F16:
+			resampleInterior(data, SAMPLE_F16, channels, position, step, first, end, kernel, outL, outR);
+			break;
+		default:
+			resampleInterior(data, SAMPLE_F32, channels, position, step, first, end, kernel, outL, outR);
+			break;
+	}
+	for(int k = end; k < count; k++) {
+		resampleAt(data, format, length, channels, position + k * step, kernel, loop, frame);
+		outL[k] = frame[0];
+		outR[k] = frame[channels - 1];
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdbool.h>
+
+#include "pcm.h"
+
+// fractional positions per input sample, the nearest one is used
+#define RESAMPLER_PHASE_BITS 8
+#define RESAMPLER_PHASES (1 << RESAMPLER_PHASE_BITS)
+#define RESAMPLER_MAX_TAPS 32
+// cutoffs a half-octave apart, the last one covers everything from 3 octaves up
+#define RESAMPLER_BANDS 7
+// fraction of the input Nyquist kept when the sample is not sped up
+#define RESAMPLER_PASSBAND 0.9
+
+typedef enum {
+	RESAMPLE_LINEAR,
+	RESAMPLE_SINC8,
+	RESAMPLE_SINC16,
+	RESAMPLE_SINC32,
+	RESAMPLE_MODE_COUNT
+} ResampleMode;
+
+/**
+ * One windowed-sinc design: RESAMPLER_PHASES rows of taps coefficients, tap j of a row weights input sample
+ * floor(position) - taps / 2 + 1 + j. Linear interpolation is the kernel with no taps.
+ */
+typedef struct {
+	int taps;
+	const float *table;
+} ResampleKernel;
+
+/**
+ * @brief Builds the polyphase tables, safe to call repeatedly. Must have run before any kernel is requested.
+ */
+void initResampler();
+/**
+ * @brief Picks the design for a mode and playback ratio (input samples per output sample). Ratios above 1 get a
+ * lowered cutoff so pitching up does not alias.
+ */
+ResampleKernel getResampleKernel(ResampleMode mode, double ratio);
+/**
+ * @brief Interpolates the frame at position of interleaved mono or stereo data into out[channels], both channels of a
+ * stereo frame come out of the same vector pass. Taps that fall outside the sample wrap around when looping and read
+ * as silence otherwise. int16 and half data are widened to float as the taps are loaded, never as a whole.
+ */
+void resampleAt(const void *data, SampleFormat format, int length, int channels, double position, const ResampleKernel *kernel, bool loop, float *out);
+/**
+ * @brief Renders count frames from position onwards, moving by step (negative plays backwards) after each one, into
+ * outL/outR (mono samples fill both). The frames whose taps stay inside the sample are found up front and run without
+ * any bounds checks, only the few near either end go through the checked path.
+ */
+void resampleSpan(const void *data, SampleFormat format, int length, int channels, double position, double step, int count, const ResampleKernel *kernel, bool loop, float *outL, float *outR);
+
+#endif
@@ -4,8 +4,46 @@
 #include <string.h>
 #include <stdint.h>
 #include <math.h>
+#include <sched.h>
 #include "settings.h"
 
+#define SAMPLE_SLAB_ALIGN 16
+
+// slab allocations are rounded up so every sample starts on a vector boundary
+static size_t slabBytes(size_t bytes) {
+	return (bytes + SAMPLE_SLAB_ALIGN - 1) & ~(size_t)(SAMPLE_SLAB_ALIGN - 1);
+}
+
+// values in the data, frames times channels
+static int sampleValueCount(const Sample *sample) {
+	return sample->length * sample->channels;
+}
+
+static size_t sampleDataBytes(const Sample *sample) {
+	return (size_t)sampleValueCount(sample) * sampleFormatBytes(sample->format);
+}
+
+static void publishSampleData(Sample *sample, void *data) {
+	__atomic_store_n(&sample->data, data, __ATOMIC_SEQ_CST);
+}
+
+// returns once no reader can still hold a pointer that was unpublished before the call
+static void waitForReaders(SamplePool *sp) {
+	unsigned retired = epochRetire(&sp->epoch);
+	while(!epochReclaimable(&sp->epoch, retired)) {
+		sched_yield();
+	}
+}
+
+// for a slot about to be rewritten, the caller has to have claimed it (reserved) since the lock is dropped while waiting
+static void waitForSlotReaders(SamplePool *sp, Sample *sample) {
+	while(!epochReclaimable(&sp->epoch, sample->retireEpoch)) {
+		pthread_mutex_unlock(&sp->lock);
+		sched_yield();
+		pthread_mutex_lock(&sp->lock);
+	}
+}
+
 SamplePool *createSamplePool() {
 	// printf("creating sample pool.\n");
 
@@ -14,11 +52,13 @@ SamplePool *createSamplePool() {
 		printf("could not allocate memory for sample pool struct.\n");
 		return NULL;
 	}
-	sp->sampleData = (char *)malloc(MAX_SAMPLE_POOL_BYTES);
-	if(!sp->sampleData) {
-		free(sp);
-		printf("could not allocate memory for sample pool data.\n");
-		return NULL;
+	// slabs are only allocated once samples need them
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		sp->slabs[i].data = NULL;
+		sp->slabs[i].used = 0;
+		sp->slabs[i].live = 0;
+		sp->slabs[i].retiring = false;
+		sp->slabs[i].retireEpoch = 0;
 	}
 
 	sp->memoryUsed = 0;
@@ -26,101 +66,436 @@ SamplePool *createSamplePool() {
 	sp->sampleCount = 0;
 	sp->maxSamples = MAX_LOADED_SAMPLES;
 	if(!sp->samples) {
-		free(sp->sampleData);
 		free(sp);
 		printf("could not allocate memory for sample within pool.\n");
 		return NULL;
 	}
+	sp->retiredStreamCount = 0;
+	initEpochDomain(&sp->epoch);
+	pthread_mutex_init(&sp->lock, NULL);
+	sp->streamer = createSampleStreamer(&sp->epoch);
 	printf("\t-> DONE.\n");
 	return sp;
 }
 
+// the Sample struct, its name and its stream, the pooled data belongs to the slabs
+static void freeSample(Sample *sample) {
+	freeSampleStream(sample->stream);
+	free(sample->name);
+	free(sample);
+}
+
 void freeSamplePool(SamplePool *sp) {
 	if(!sp) return;
 
+	// stop the prefetcher before any mapping goes away under it
+	freeSampleStreamer(sp->streamer);
 	for(size_t i = 0; i < sp->sampleCount; i++) {
-		free(sp->samples[i]);
+		freeSample(sp->samples[i]);
+	}
+	for(int i = 0; i < sp->retiredStreamCount; i++) {
+		freeSampleStream(sp->retiredStreams[i].stream);
+	}
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		free(sp->slabs[i].data);
 	}
+	pthread_mutex_destroy(&sp->lock);
 	free(sp->samples);
-	free(sp->sampleData);
 	free(sp);
 }
 
-void loadSample(SamplePool *sp, const char *name, float *data, int bit, int sampleSr, int length) {
-	if(sp->sampleCount >= sp->maxSamples) {
-		printf("Error: Maximum number of samples reached ().\n");
-		return;
+static void *allocateSlabSpace(SamplePool *sp, size_t size, int excludeSlab, int *slabIndex) {
+	int emptySlab = -1;
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		SampleSlab *slab = &sp->slabs[i];
+		if(i == excludeSlab || slab->retiring) {
+			continue;
+		}
+		if(!slab->data) {
+			if(emptySlab < 0) emptySlab = i;
+			continue;
+		}
+		if(slab->used + size <= SAMPLE_SLAB_BYTES) {
+			void *data = slab->data + slab->used;
+			slab->used += size;
+			slab->live += size;
+			sp->memoryUsed += size;
+			*slabIndex = i;
+			return data;
+		}
+	}
+	if(emptySlab < 0 || size > SAMPLE_SLAB_BYTES) {
+		return NULL;
 	}
-	size_t dataSize = length * sizeof(float);
-	float *sampleData = (float *)((char *)sp->sampleData + sp->memoryUsed);
 
-	memcpy(sampleData, data, dataSize);
+	SampleSlab *slab = &sp->slabs[emptySlab];
+	slab->data = (char *)malloc(SAMPLE_SLAB_BYTES);
+	if(!slab->data) {
+		printf("could not allocate memory for sample slab.\n");
+		return NULL;
+	}
+	slab->used = size;
+	slab->live = size;
+	sp->memoryUsed += size;
+	*slabIndex = emptySlab;
+	return slab->data;
+}
 
-	Sample *sample = (Sample *)malloc(sizeof(Sample));
-	if(!sample) return;
+// call only after the data in this range has been unpublished
+static void releaseSlabSpace(SamplePool *sp, int slabIndex, size_t size) {
+	SampleSlab *slab = &sp->slabs[slabIndex];
+	slab->live -= size;
+	sp->memoryUsed -= size;
+	if(slab->live == 0) {
+		slab->retiring = true;
+		slab->retireEpoch = epochRetire(&sp->epoch);
+	}
+}
 
-	sample->data = sampleData;
+static void reclaimRetired(SamplePool *sp) {
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		SampleSlab *slab = &sp->slabs[i];
+		if(slab->retiring && epochReclaimable(&sp->epoch, slab->retireEpoch)) {
+			free(slab->data);
+			slab->data = NULL;
+			slab->used = 0;
+			slab->retiring = false;
+		}
+	}
 
+	int kept = 0;
+	for(int i = 0; i < sp->retiredStreamCount; i++) {
+		RetiredStream rs = sp->retiredStreams[i];
+		if(epochReclaimable(&sp->epoch, rs.retireEpoch)) {
+			if(rs.cursorsCleared) {
+				freeSampleStream(rs.stream);
+				continue;
+			}
+			// no voice can publish this mapping any more, drop it from the cursors and give the prefetcher a grace period
+			clearStreamCursors(sp->streamer, rs.stream->mapping, rs.stream->size);
+			rs.cursorsCleared = true;
+			rs.retireEpoch = epochRetire(&sp->epoch);
+		}
+		sp->retiredStreams[kept++] = rs;
+	}
+	sp->retiredStreamCount = kept;
+}
+
+static void retireStream(SamplePool *sp, SampleStream *stream) {
+	while(sp->retiredStreamCount >= MAX_RETIRED_STREAMS) {
+		waitForReaders(sp);
+		reclaimRetired(sp);
+	}
+	sp->retiredStreams[sp->retiredStreamCount].stream = stream;
+	sp->retiredStreams[sp->retiredStreamCount].retireEpoch = epochRetire(&sp->epoch);
+	sp->retiredStreams[sp->retiredStreamCount].cursorsCleared = false;
+	sp->retiredStreamCount++;
+}
+
+static void unpublishSample(SamplePool *sp, Sample *sample) {
+	if(!sample->data) {
+		return;
+	}
+	publishSampleData(sample, NULL);
+	// the slot's fields stay readable to blocks that saw the old data until this epoch is over
+	sample->retireEpoch = epochRetire(&sp->epoch);
+	if(sample->stream) {
+		retireStream(sp, sample->stream);
+	} else if(sample->slab >= 0) {
+		releaseSlabSpace(sp, sample->slab, slabBytes(sampleDataBytes(sample)));
+	}
+	sample->stream = NULL;
+	sample->slab = -1;
+}
+
+// sizes an unpublished slot and reserves its pool memory, readers must be gone from its previous data
+static bool prepareSample(SamplePool *sp, Sample *sample, const char *name, int bit, int sampleSr, int length, int channels, SampleFormat format) {
+	if(length <= 0) {
+		printf("error: %s has no sample data.\n", name);
+		return false;
+	}
+	if(channels < 1 || channels > SAMPLE_MAX_CHANNELS) {
+		printf("error: %s has %i channels, at most %i are supported.\n", name, channels, SAMPLE_MAX_CHANNELS);
+		return false;
+	}
+	if(sampleFormatBytes(format) == 0) {
+		printf("error: %s has an invalid storage format %i.\n", name, format);
+		return false;
+	}
+	size_t dataSize = (size_t)length * channels * sampleFormatBytes(format);
+	int slab = -1;
+	void *pending = NULL;
+	// big samples, or anything that no longer fits, go to a mapped cache file instead of the pool
+	if(dataSize < STREAM_MIN_BYTES && sp->memoryUsed + slabBytes(dataSize) <= MAX_SAMPLE_POOL_BYTES) {
+		pending = allocateSlabSpace(sp, slabBytes(dataSize), -1, &slab);
+	}
+
+	free(sample->name);
 	sample->name = (char *)malloc(strlen(name) + 1);
 	strcpy(sample->name, name);
 	sample->bit = bit;
 	sample->length = length;
+	sample->channels = channels;
 	sample->sampleRate = sampleSr;
+	// stream files hold floats
+	sample->format = pending ? format : SAMPLE_F32;
+	sample->stream = NULL;
+	sample->slab = pending ? slab : -1;
+	memset(&sample->markers, 0, sizeof(SampleMarkers));
+	sample->pending = pending;
+	sample->reserved = true;
+	return true;
+}
 
-	printf("adding sample of %i length, %i bit\n", sample->length, sample->bit);
+static void cancelPendingSample(SamplePool *sp, Sample *sample) {
+	if(sample->pending) {
+		// never published, so nobody can be reading it
+		releaseSlabSpace(sp, sample->slab, slabBytes(sampleDataBytes(sample)));
+	}
+	sample->pending = NULL;
+	sample->slab = -1;
+	sample->reserved = false;
+}
 
-	sp->samples[sp->sampleCount] = sample;
-	sp->sampleCount++;
-	sp->memoryUsed += dataSize;
+// stream creation writes a whole file, callers do it before taking the pool lock
+static SampleStream *streamPendingSample(Sample *sample, const float *streamData) {
+	if(sample->pending) {
+		return NULL;
+	}
+	if(!streamData) {
+		printf("error: no data to stream %s from.\n", sample->name);
+		return NULL;
+	}
+	SampleStream *stream = createSampleStream(sample->name, streamData, sampleValueCount(sample));
+	if(!stream) {
+		printf("Error: could not stream %s, it does not fit the sample pool.\n", sample->name);
+	}
+	return stream;
+}
 
+static bool publishPendingSample(SamplePool *sp, Sample *sample, SampleStream *stream) {
+	if(!sample->pending && !stream) {
+		cancelPendingSample(sp, sample);
+		return false;
+	}
+	sample->stream = stream;
+	void *data = stream ? stream->mapping : sample->pending;
+	sample->pending = NULL;
+	sample->reserved = false;
+	publishSampleData(sample, data);
+
+	static const char *formatNames[SAMPLE_FORMAT_COUNT] = { "f32", "s16", "f16" };
+	printf("adding sample of %i length, %i bit, %i channels, %s%s\n", sample->length, sample->bit, sample->channels, formatNames[sample->format], stream ? ", streamed" : "");
 	printf("%i samples, %i memoryUsed \n", sp->sampleCount, sp->memoryUsed);
+	return true;
 }
 
-void freeSample(Sample *sample) {
-	if(sample->data) {
-		free(sample->data);
+int reserveSample(SamplePool *sp, const char *name, int bit, int sampleSr, int length, int channels, SampleFormat format, void **data) {
+	pthread_mutex_lock(&sp->lock);
+	int index = -1;
+	for(size_t i = 0; i < sp->sampleCount; i++) {
+		if(!sp->samples[i]->data && !sp->samples[i]->reserved) {
+			index = i;
+			break;
+		}
+	}
+
+	Sample *sample = NULL;
+	if(index >= 0) {
+		sample = sp->samples[index];
+		// an unloaded slot can still be read by a block that started before the unload
+		sample->reserved = true;
+		waitForSlotReaders(sp, sample);
+	} else {
+		if(sp->sampleCount >= sp->maxSamples) {
+			printf("Error: Maximum number of samples reached ().\n");
+			pthread_mutex_unlock(&sp->lock);
+			return -1;
+		}
+		sample = (Sample *)malloc(sizeof(Sample));
+		if(!sample) {
+			pthread_mutex_unlock(&sp->lock);
+			return -1;
+		}
 		sample->data = NULL;
+		sample->name = NULL;
+		sample->stream = NULL;
+		sample->channels = 1;
+		sample->format = SAMPLE_F32;
+		sample->slab = -1;
+		sample->pending = NULL;
+		sample->reserved = false;
+		sample->retireEpoch = 0;
+	}
+
+	if(!prepareSample(sp, sample, name, bit, sampleSr, length, channels, format)) {
+		if(index < 0) {
+			freeSample(sample);
+		} else {
+			sample->reserved = false;
+		}
+		pthread_mutex_unlock(&sp->lock);
+		return -1;
 	}
-	sample->length = 0;
-	sample->sampleRate = 0;
+	if(index < 0) {
+		index = sp->sampleCount;
+		sp->samples[index] = sample;
+		// the slot pointer has to be visible before the count that makes it reachable
+		__atomic_store_n(&sp->sampleCount, sp->sampleCount + 1, __ATOMIC_RELEASE);
+	}
+	*data = sample->pending;
+	pthread_mutex_unlock(&sp->lock);
+	return index;
 }
 
-float getSampleValueFwd(Sample *sample, float *samplePosition, float phaseIncrement, int loop) {
-	// Validate the sample
-	if(!sample || !sample->data || sample->length <= 0) {
-		fprintf(stderr, "Invalid sample or data\n");
-		return 0.0f;
+bool commitSample(SamplePool *sp, int index, const float *streamData) {
+	if(index < 0 || index >= (int)sp->sampleCount || !sp->samples[index]->reserved) {
+		printf("error: sample %i was not reserved.\n", index);
+		return false;
 	}
-	float adjusted_phase_increment = phaseIncrement * (PA_SR / ((float)sample->sampleRate / sample->bit) * 2);
-	*samplePosition += adjusted_phase_increment;
+	// a reserved slot belongs to its reserver, only the publish needs the lock
+	Sample *sample = sp->samples[index];
+	SampleStream *stream = streamPendingSample(sample, streamData);
+	pthread_mutex_lock(&sp->lock);
+	bool published = publishPendingSample(sp, sample, stream);
+	pthread_mutex_unlock(&sp->lock);
+	return published;
+}
 
-	if(*samplePosition >= sample->length) {
-		if(loop) {
-			*samplePosition -= sample->length;
-		} else {
-			*samplePosition = sample->length - 1;
+bool commitStreamedSample(SamplePool *sp, int index, SampleStream *stream) {
+	if(index < 0 || index >= (int)sp->sampleCount || !sp->samples[index]->reserved || sp->samples[index]->pending) {
+		printf("error: sample %i was not reserved for streaming.\n", index);
+		return false;
+	}
+	pthread_mutex_lock(&sp->lock);
+	bool published = publishPendingSample(sp, sp->samples[index], stream);
+	pthread_mutex_unlock(&sp->lock);
+	return published;
+}
+
+void setSampleMarkers(SamplePool *sp, int index, const SampleMarkers *markers) {
+	// only the reserver writes a reserved slot, nothing else reads the markers before it is committed
+	if(index >= 0 && index < (int)sp->sampleCount && sp->samples[index]->reserved) {
+		sp->samples[index]->markers = *markers;
+	}
+}
+
+void cancelSample(SamplePool *sp, int index) {
+	pthread_mutex_lock(&sp->lock);
+	if(index >= 0 && index < (int)sp->sampleCount && sp->samples[index]->reserved) {
+		cancelPendingSample(sp, sp->samples[index]);
+	}
+	pthread_mutex_unlock(&sp->lock);
+}
+
+int loadSample(SamplePool *sp, const char *name, float *data, int bit, int sampleSr, int length, int channels) {
+	void *reserved = NULL;
+	int index = reserveSample(sp, name, bit, sampleSr, length, channels, SAMPLE_F32, &reserved);
+	if(index < 0) {
+		return -1;
+	}
+	if(reserved) {
+		memcpy(reserved, data, (size_t)length * channels * sizeof(float));
+	}
+	return commitSample(sp, index, data) ? index : -1;
+}
+
+bool reloadSample(SamplePool *sp, int index, const char *name, float *data, int bit, int sampleSr, int length, int channels) {
+	pthread_mutex_lock(&sp->lock);
+	if(index < 0 || index >= (int)sp->sampleCount || sp->samples[index]->reserved) {
+		printf("error: no sample at index %i to reload.\n", index);
+		pthread_mutex_unlock(&sp->lock);
+		return false;
+	}
+	Sample *sample = sp->samples[index];
+	unpublishSample(sp, sample);
+	// from here on the slot is reserved like a fresh one, so the copy or stream file is written without the lock
+	sample->reserved = true;
+	waitForSlotReaders(sp, sample);
+	if(!prepareSample(sp, sample, name, bit, sampleSr, length, channels, SAMPLE_F32)) {
+		sample->reserved = false;
+		pthread_mutex_unlock(&sp->lock);
+		return false;
+	}
+	void *reserved = sample->pending;
+	pthread_mutex_unlock(&sp->lock);
+	if(reserved) {
+		memcpy(reserved, data, (size_t)length * channels * sizeof(float));
+	}
+	return commitSample(sp, index, data);
+}
+
+void unloadSample(SamplePool *sp, int index) {
+	pthread_mutex_lock(&sp->lock);
+	if(index >= 0 && index < (int)sp->sampleCount) {
+		// the name and length stay readable for the GUI until the slot is reused
+		unpublishSample(sp, sp->samples[index]);
+	}
+	pthread_mutex_unlock(&sp->lock);
+}
+
+// moves the live samples out of the most fragmented slab so the whole slab can be released, one slab per call
+static void compactSlabs(SamplePool *sp) {
+	int worst = -1;
+	size_t worstHoles = (size_t)(SAMPLE_SLAB_COMPACT_RATIO * SAMPLE_SLAB_BYTES);
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		SampleSlab *slab = &sp->slabs[i];
+		if(!slab->data || slab->retiring) {
+			continue;
+		}
+		size_t holes = slab->used - slab->live;
+		if(holes >= worstHoles) {
+			worst = i;
+			worstHoles = holes;
 		}
 	}
-	// Calculate the wavetable indices and interpolation fraction
-	int indexFloor = (int)*samplePosition;
-	int indexCeil = (indexFloor + 1) % sample->length; // Wrap around at the end
-	float frac = *samplePosition - indexFloor;
+	if(worst < 0) {
+		return;
+	}
 
-	// Perform linear interpolation between indexFloor and indexCeil
-	float value = sample->data[indexFloor] * (1.0f - frac) + sample->data[indexCeil] * frac;
-	if(*samplePosition >= sample->length - 2) {
-		return 0;
+	for(size_t s = 0; s < sp->sampleCount; s++) {
+		Sample *sample = sp->samples[s];
+		if(sample->slab != worst || !sample->data) {
+			continue;
+		}
+		size_t size = slabBytes(sampleDataBytes(sample));
+		int target = -1;
+		void *moved = allocateSlabSpace(sp, size, worst, &target);
+		if(!moved) {
+			return;
+		}
+		memcpy(moved, sample->data, sampleDataBytes(sample));
+		publishSampleData(sample, moved);
+		sample->slab = target;
+		releaseSlabSpace(sp, worst, size);
 	}
-	return value;
 }
 
-float getSampleValueRev(Sample *sample, float *samplePosition, float phaseIncrement, int loop) {
-	// Validate the sample
-	if(!sample || !sample->data || sample->length <= 0) {
-		fprintf(stderr, "Invalid sample or data\n");
+void maintainSamplePool(SamplePool *sp) {
+	// a loader holding the lock just means maintenance waits for the next call
+	if(pthread_mutex_trylock(&sp->lock) != 0) {
+		return;
+	}
+	reclaimRetired(sp);
+	compactSlabs(sp);
+	pthread_mutex_unlock(&sp->lock);
+}
+
+// the analysis and preview readers work on a mono mix of the frame
+static float sampleFrameMono(const void *data, SampleFormat format, int channels, int frame) {
+	if(channels == 2) {
+		return (loadSampleValue(data, format, frame * 2) + loadSampleValue(data, format, frame * 2 + 1)) * 0.5f;
+	}
+	return loadSampleValue(data, format, frame);
+}
+
+float getSampleValueFwd(Sample *sample, float *samplePosition, float phaseIncrement, int loop) {
+	// Validate the sample, data is read once since the pool may swap it (see Sample)
+	const void *data = sample ? __atomic_load_n(&sample->data, __ATOMIC_ACQUIRE) : NULL;
+	if(!data || sample->length <= 0) {
 		return 0.0f;
 	}
-	float adjusted_phase_increment = phaseIncrement * (PA_SR / ((float)sample->sampleRate / sample->bit) * 2);
+	float adjusted_phase_increment = phaseIncrement * sample->sampleRate / SAMPLE_ROOT_FREQ;
 	*samplePosition += adjusted_phase_increment;
 
 	if(*samplePosition >= sample->length) {
@@ -136,9 +511,81 @@ float getSampleValueRev(Sample *sample, float *samplePosition, float phaseIncrem
 	float frac = *samplePosition - indexFloor;
 
 	// Perform linear interpolation between indexFloor and indexCeil
-	float value = sample->data[indexFloor] * (1.0f - frac) + sample->data[indexCeil] * frac;
+	float value = sampleFrameMono(data, sample->format, sample->channels, indexFloor) * (1.0f - frac) + sampleFrameMono(data, sample->format, sample->channels, indexCeil) * frac;
 	if(*samplePosition >= sample->length - 2) {
 		return 0;
 	}
 	return value;
 }
+
+void startSamplePlayhead(SamplePlayhead *ph, const Sample *sample, SamplePlaybackType type) {
+	bool reverse = type == SPT_REVERSE || type == SPT_REVERSE_PINGPONG;
+	ph->direction = reverse ? -1 : 1;
+	ph->startDirection = ph->direction;
+	ph->position = reverse && sample ? sample->length - 1 : 0.0;
+	ph->finished = false;
+}
+
+void renderSampleBlock(Sample *sample, SamplePlayhead *ph, const SamplePlayback *pb, double step, const ResampleKernel *kernel, float *outL, float *outR, int count) {
+	// Validate the sample, data is read once since the pool may swap it (see Sample)
+	const void *data = sample ? __atomic_load_n(&sample->data, __ATOMIC_ACQUIRE) : NULL;
+	int length = data ? sample->length : 0;
+	int done = 0;
+	if(length < 2 || ph->finished) {
+		ph->finished = ph->finished || data;
+		memset(outL, 0, count * sizeof(float));
+		memset(outR, 0, count * sizeof(float));
+		return;
+	}
+
+	bool pingPong = pb->type == SPT_FORWARD_PINGPONG || pb->type == SPT_REVERSE_PINGPONG;
+	int loopStart = pb->loopStart < 0 ? 0 : pb->loopStart > length - 2 ? length - 2 : pb->loopStart;
+	int loopEnd = pb->loopEnd > length ? length : pb->loopEnd;
+	bool looping = pb->loop && loopEnd - loopStart >= 2;
+	// playback runs in [lo, hi), ping-pong turns around on the last frame of the range instead of wrapping past it
+	double lo = looping ? loopStart : 0.0;
+	double hi = looping ? loopEnd : length;
+	hi -= pingPong ? 1.0 : 0.0;
+	// taps only wrap when the loop is the whole sample, otherwise they read on into the audio either side of it
+	bool wrapTaps = looping && !pingPong && loopStart == 0 && loopEnd == length;
+	double position = ph->position;
+
+	// the block is cut at every boundary up front, the spans in between have nothing left to check per frame
+	while(done < count) {
+		int n = count - done;
+		if(step > 0.0) {
+			double left = ph->direction > 0 ? ceil((hi - position) / step) : floor((position - lo) / step) + 1.0;
+			left = left < 0.0 ? 0.0 : left;
+			n = left < n ? (int)left : n;
+		}
+		if(n > 0) {
+			double delta = step * ph->direction;
+			resampleSpan(data, sample->format, length, sample->channels, position, delta, n, kernel, wrapTaps, outL + done, outR + done);
+			position += n * delta;
+			done += n;
+			continue;
+		}
+
+		if(pingPong && (looping || ph->direction == ph->startDirection)) {
+			// folded rather than mirrored once, a step longer than the range can bounce off both ends
+			double span = hi - lo;
+			double over = fmod(ph->direction > 0 ? position - hi : lo - position, 2.0 * span);
+			if(over <= span) {
+				position = ph->direction > 0 ? hi - over : lo + over;
+				ph->direction = -ph->direction;
+			} else {
+				position = ph->direction > 0 ? lo + (over - span) : hi - (over - span);
+			}
+		} else if(looping) {
+			double span = hi - lo;
+			position = ph->direction > 0 ? lo + fmod(position - hi, span) : hi - fmod(lo - position, span);
+			position = position >= hi ? lo : position;
+		} else {
+			ph->finished = true;
+			memset(outL + done, 0, (count - done) * sizeof(float));
+			memset(outR + done, 0, (count - done) * sizeof(float));
+			break;
+		}
+	}
+	ph->position = position;
+}
@@ -3,28 +3,34 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "epoch.h"
+#include "pcm.h"
+#include "resampler.h"
+#include "sample_stream.h"
 
 #define MAX_SAMPLE_POOL_BYTES 32000000
 #define MAX_LOADED_SAMPLES 1024
+// anything that does not fit in a single slab is streamed instead (see sample_stream.h)
+#define SAMPLE_SLAB_BYTES STREAM_MIN_BYTES
+#define MAX_SAMPLE_SLABS ((MAX_SAMPLE_POOL_BYTES + SAMPLE_SLAB_BYTES - 1) / SAMPLE_SLAB_BYTES)
+// a slab is compacted once at least this much of its bump range is holes left by unloaded samples
+#define SAMPLE_SLAB_COMPACT_RATIO 0.5f
+#define MAX_RETIRED_STREAMS 32
+#define MAX_SAMPLE_CUES 16
+// mono or stereo, files with more channels keep their front pair
+#define SAMPLE_MAX_CHANNELS 2
+// pitch a sample plays back at unshifted (C4)
+#define SAMPLE_ROOT_FREQ 261.6256f
 
-#pragma pack(push, 1)
-typedef struct
-{
-	char chunkID[4];        // "RIFF"
-	uint32_t chunkSize;     // Size of the entire file minus 8 bytes
-	char format[4];         // "WAVE"
-	char subchunk1ID[4];    // "fmt "
-	uint32_t subchunk1Size; // Size of the fmt chunk (in bytes)
-	uint16_t audioFormat;   // Audio format (1 for PCM)
-	uint16_t numChannels;   // Number of channels
-	uint32_t sampleRate;    // Sampling rate
-	uint32_t byteRate;      // Byte rate = SampleRate * NumChannels * BitsPerSample/8
-	uint16_t blockAlign;    // Block align = NumChannels * BitsPerSample/8
-	uint16_t bitsPerSample; // Bits per sample
-	char subchunk2ID[4];    // "data"
-	uint32_t subchunk2Size; // Size of the data chunk (in bytes)
-} WAVHeader;
-#pragma pack(pop)
+typedef struct {
+	int loopStart;
+	int loopEnd; // exclusive, 0 when the file has no loop
+	int cueCount;
+	int cues[MAX_SAMPLE_CUES];
+} SampleMarkers;
 
 typedef enum {
 	SPT_FORWARD,
@@ -34,29 +40,115 @@ typedef enum {
 	SPT_COUNT
 } SamplePlaybackType;
 
+/**
+ * Sample structs stay put for the lifetime of the pool, unloading only clears data. The audio thread snapshots data
+ * with acquire semantics and bails out on NULL; length and the other fields are only rewritten once every reader that
+ * could have seen the old data has left its epoch.
+ */
 typedef struct {
-	float *data;
+	void *data; // interleaved frames in format
+	SampleFormat format; // streamed samples are always SAMPLE_F32
 	char *name;
-	int length;
+	int length;  // in frames
+	int channels;
 	int sampleRate;
 	int bit;
+	SampleStream *stream; // NULL when data lives in the pool, otherwise data points into the mapped cache file
+	int slab;             // pool slab holding data, -1 when streamed or unloaded
+	SampleMarkers markers; // loop points and cues from the file
+	void *pending;        // reserved pool memory a loader is still writing, published on commit
+	bool reserved;        // between reserveSample and commitSample/cancelSample
+	unsigned retireEpoch; // when data was last unpublished, the slot is only rewritten once readers are past it
 } Sample;
 
-typedef float (*GetSampleFunc)(Sample *sample, float *samplePosition, float phaseIncrement, int loop);
+// how a voice moves through a sample, read from the instrument once per block
+typedef struct {
+	SamplePlaybackType type;
+	bool loop;
+	int loopStart;
+	int loopEnd; // exclusive
+} SamplePlayback;
+
+typedef struct {
+	double position;    // in frames
+	int direction;      // 1 or -1, flips on ping-pong turns
+	int startDirection;
+	bool finished;      // ran off the end of a one-shot, renders silence until restarted
+} SamplePlayhead;
+
+typedef struct {
+	char *data;   // allocated on first use, released again once empty
+	size_t used;  // bump offset
+	size_t live;  // bytes still owned by loaded samples, used - live are holes
+	bool retiring; // emptied, used is rewound once readers have left retireEpoch
+	unsigned retireEpoch;
+} SampleSlab;
+
+typedef struct {
+	SampleStream *stream;
+	unsigned retireEpoch;
+	bool cursorsCleared; // second grace period, the prefetcher may still have read a stale cursor
+} RetiredStream;
 
 typedef struct {
-	char *sampleData;
-	size_t memoryUsed;
+	SampleSlab slabs[MAX_SAMPLE_SLABS];
+	size_t memoryUsed; // live bytes across all slabs
 	Sample **samples;
 	size_t sampleCount;
 	size_t maxSamples;
+	SampleStreamer *streamer;
+	EpochDomain epoch;
+	RetiredStream retiredStreams[MAX_RETIRED_STREAMS];
+	int retiredStreamCount;
+	pthread_mutex_t lock; // taken by loaders and maintenance only, never by the audio thread
 } SamplePool;
 
-void loadSample(SamplePool *sp, const char *name, float *data, int bit, int sampleSr, int length);
+/**
+ * @brief Loads into the first unloaded slot, or appends one.
+ * @return the sample index, -1 on failure.
+ */
+int loadSample(SamplePool *sp, const char *name, float *data, int bit, int sampleSr, int length, int channels);
+/**
+ * @brief Reserves a slot with its final size so a decoder can write straight into pool memory. Reserving is cheap and
+ *        keeps slot order deterministic, the filling can then happen on any thread.
+ * @param format storage format of the pool memory, a sample that ends up streamed is SAMPLE_F32 whatever was asked
+ *               for, so check the reserved sample's format before filling.
+ * @param data receives the pool memory to fill, or NULL when the sample is going to be streamed, in which case the
+ *             decoded frames are handed to commitSample instead.
+ * @return the sample index, -1 on failure.
+ */
+int reserveSample(SamplePool *sp, const char *name, int bit, int sampleSr, int length, int channels, SampleFormat format, void **data);
+/**
+ * @brief Publishes a reserved sample. streamData (float frames) is only read when reserveSample handed out no pool memory.
+ */
+bool commitSample(SamplePool *sp, int index, const float *streamData);
+/**
+ * @brief Publishes a sample reserved for streaming with an already mapped stream, the pool takes ownership of it.
+ */
+bool commitStreamedSample(SamplePool *sp, int index, SampleStream *stream);
+void setSampleMarkers(SamplePool *sp, int index, const SampleMarkers *markers);
+void cancelSample(SamplePool *sp, int index);
+/**
+ * @brief Replaces the sample at index in place, instruments pointing at the index pick up the new data.
+ */
+bool reloadSample(SamplePool *sp, int index, const char *name, float *data, int bit, int sampleSr, int length, int channels);
+void unloadSample(SamplePool *sp, int index);
+/**
+ * @brief Reclaims retired slabs/streams and compacts fragmented slabs. Call regularly, never from the audio thread.
+ */
+void maintainSamplePool(SamplePool *sp);
 SamplePool *createSamplePool();
 void freeSamplePool(SamplePool *sp);
-void freeSample(Sample *sample);
 float getSampleValueFwd(Sample *sample, float *samplePosition, float phaseIncrement, int loop);
-float getSampleValueRev(Sample *sample, float *samplePosition, float phaseIncrement, int loop);
+/**
+ * @brief Puts the playhead at the start of the sample for forward types and at the end for reverse ones.
+ */
+void startSamplePlayhead(SamplePlayhead *ph, const Sample *sample, SamplePlaybackType type);
+/**
+ * @brief Renders count frames of the sample into outL/outR (mono samples fill both), moving step frames per output
+ *        frame. The block is split at loop, turn and end points before any audio is read, so each span in between is
+ *        a straight run through the resampler.
+ */
+void renderSampleBlock(Sample *sample, SamplePlayhead *ph, const SamplePlayback *pb, double step, const ResampleKernel *kernel, float *outL, float *outR, int count);
 
 #endif
@@ -0,0 +1,160 @@
+#include "sample_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static uint64_t alignCacheOffset(uint64_t offset) {
+	return (offset + SAMPLE_CACHE_ALIGN - 1) & ~(uint64_t)(SAMPLE_CACHE_ALIGN - 1);
+}
+
+bool getSampleFileStamp(const char *path, SampleFileStamp *stamp) {
+	struct stat st;
+	if(stat(path, &st) != 0) {
+		return false;
+	}
+	stamp->size = (uint64_t)st.st_size;
+	stamp->mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+void openSampleCache(SampleCache *cache) {
+	cache->blob = NULL;
+	cache->header = NULL;
+	cache->entries = NULL;
+
+	struct stat st;
+	if(stat(SAMPLE_CACHE_FILE, &st) != 0 || (size_t)st.st_size < sizeof(SampleCacheHeader)) {
+		return;
+	}
+	size_t size = (size_t)st.st_size;
+	SampleStream *blob = mapSampleStream(SAMPLE_CACHE_FILE, size, 0);
+	if(!blob) {
+		return;
+	}
+
+	const SampleCacheHeader *header = (const SampleCacheHeader *)blob->mapping;
+	bool valid = memcmp(header->magic, SAMPLE_CACHE_MAGIC, 4) == 0 && header->version == SAMPLE_CACHE_VERSION;
+	valid = valid && sizeof(SampleCacheHeader) + (uint64_t)header->entryCount * sizeof(SampleCacheEntry) <= header->dataStart && header->dataStart <= size;
+	const SampleCacheEntry *entries = (const SampleCacheEntry *)(header + 1);
+	for(uint32_t i = 0; valid && i < header->entryCount; i++) {
+		const SampleCacheEntry *e = &entries[i];
+		valid = e->length > 0 && e->channels >= 1 && e->channels <= SAMPLE_MAX_CHANNELS && memchr(e->path, '\0', SAMPLE_CACHE_MAX_PATH) != NULL;
+		valid = valid && e->format >= 0 && e->format < SAMPLE_FORMAT_COUNT;
+		valid = valid && (e->streamed || e->dataOffset + (uint64_t)e->length * e->channels * sampleFormatBytes(e->format) <= size);
+	}
+	if(!valid) {
+		printf("WARNING: ignoring invalid sample cache %s\n", SAMPLE_CACHE_FILE);
+		freeSampleStream(blob);
+		return;
+	}
+	cache->blob = blob;
+	cache->header = header;
+	cache->entries = entries;
+}
+
+void closeSampleCache(SampleCache *cache) {
+	freeSampleStream(cache->blob);
+	cache->blob = NULL;
+	cache->header = NULL;
+	cache->entries = NULL;
+}
+
+const SampleCacheEntry *findSampleCacheEntry(const SampleCache *cache, const char *path, const SampleFileStamp *stamp) {
+	if(!cache->blob) {
+		return NULL;
+	}
+	for(uint32_t i = 0; i < cache->header->entryCount; i++) {
+		const SampleCacheEntry *e = &cache->entries[i];
+		if(e->fileSize == stamp->size && e->mtime == stamp->mtime && strcmp(e->path, path) == 0) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+const void *getSampleCacheData(const SampleCache *cache, const SampleCacheEntry *entry) {
+	if(entry->streamed) {
+		return NULL;
+	}
+	return (const char *)cache->blob->mapping + entry->dataOffset;
+}
+
+bool writeSampleCache(SamplePool *sp, const int *indices, char *const *paths, const SampleFileStamp *stamps, int count) {
+	SampleCacheEntry *entries = (SampleCacheEntry *)calloc(count ? count : 1, sizeof(SampleCacheEntry));
+	if(!entries) {
+		printf("could not allocate memory for the sample cache table.\n");
+		return false;
+	}
+
+	pthread_mutex_lock(&sp->lock);
+	SampleCacheHeader header;
+	memcpy(header.magic, SAMPLE_CACHE_MAGIC, 4);
+	header.version = SAMPLE_CACHE_VERSION;
+	header.entryCount = 0;
+	for(int i = 0; i < count; i++) {
+		Sample *sample = sp->samples[indices[i]];
+		if(!sample->data || strlen(paths[i]) >= SAMPLE_CACHE_MAX_PATH) {
+			continue;
+		}
+		SampleCacheEntry *e = &entries[header.entryCount++];
+		strcpy(e->path, paths[i]);
+		e->fileSize = stamps[i].size;
+		e->mtime = stamps[i].mtime;
+		e->sampleRate = sample->sampleRate;
+		e->bit = sample->bit;
+		e->length = sample->length;
+		e->channels = sample->channels;
+		e->format = sample->format;
+		e->streamed = sample->stream != NULL;
+		e->markers = sample->markers;
+	}
+	header.dataStart = (uint32_t)alignCacheOffset(sizeof(SampleCacheHeader) + header.entryCount * sizeof(SampleCacheEntry));
+	uint64_t offset = header.dataStart;
+	for(uint32_t i = 0; i < header.entryCount; i++) {
+		if(!entries[i].streamed) {
+			entries[i].dataOffset = offset;
+			offset = alignCacheOffset(offset + (uint64_t)entries[i].length * entries[i].channels * sampleFormatBytes(entries[i].format));
+		}
+	}
+
+	// written next to the old blob and renamed over it, so a crash never leaves a half written cache behind
+	const char *tmpPath = SAMPLE_CACHE_FILE ".tmp";
+	makeSampleCacheDirectory();
+	FILE *file = fopen(tmpPath, "wb");
+	bool ok = file != NULL;
+	if(ok) {
+		static const char padding[SAMPLE_CACHE_ALIGN] = { 0 };
+		ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(entries, sizeof(SampleCacheEntry), header.entryCount, file) == header.entryCount;
+		long position = sizeof(header) + header.entryCount * sizeof(SampleCacheEntry);
+		for(int i = 0, e = 0; ok && i < count; i++) {
+			Sample *sample = sp->samples[indices[i]];
+			if(!sample->data || strlen(paths[i]) >= SAMPLE_CACHE_MAX_PATH) {
+				continue;
+			}
+			SampleCacheEntry *entry = &entries[e++];
+			if(entry->streamed) {
+				continue;
+			}
+			ok = fwrite(padding, 1, entry->dataOffset - position, file) == entry->dataOffset - position;
+			size_t bytes = (size_t)entry->length * entry->channels * sampleFormatBytes(entry->format);
+			ok = ok && fwrite(sample->data, 1, bytes, file) == bytes;
+			position = entry->dataOffset + bytes;
+		}
+		ok = fclose(file) == 0 && ok;
+	}
+	pthread_mutex_unlock(&sp->lock);
+	free(entries);
+
+	if(ok) {
+		remove(SAMPLE_CACHE_FILE);
+		ok = rename(tmpPath, SAMPLE_CACHE_FILE) == 0;
+	}
+	if(!ok) {
+		printf("Failed to write sample cache %s\n", SAMPLE_CACHE_FILE);
+		remove(tmpPath);
+	}
+	return ok;
+}
@@ -0,0 +1,67 @@
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sample.h"
+#include "sample_stream.h"
+#include "settings.h"
+
+#define SAMPLE_CACHE_FILE SAMPLE_CACHE_PATH "samples.bin"
+#define SAMPLE_CACHE_MAGIC "SPXC"
+#define SAMPLE_CACHE_VERSION 3
+#define SAMPLE_CACHE_MAX_PATH 256
+#define SAMPLE_CACHE_ALIGN 16
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t dataStart; // header plus entry table, rounded up to SAMPLE_CACHE_ALIGN
+} SampleCacheHeader;
+
+typedef struct {
+	char path[SAMPLE_CACHE_MAX_PATH];
+	uint64_t fileSize;
+	int64_t mtime;
+	int32_t sampleRate;
+	int32_t bit;
+	int32_t length;   // in frames
+	int32_t channels;
+	int32_t format;      // SampleFormat of the frames in the blob
+	int32_t streamed;    // frames live in the sample's own stream cache file (see sample_stream.h), not here
+	uint64_t dataOffset; // from the start of the blob
+	SampleMarkers markers;
+} SampleCacheEntry;
+
+// a source file counts as unchanged while both of these are
+typedef struct {
+	uint64_t size;
+	int64_t mtime;
+} SampleFileStamp;
+
+/**
+ * One mapped blob holding the decoded frames and metadata of every pooled sample from the last run, so unchanged files
+ * are a memcpy instead of a parse and convert. Nothing in it is referenced once loading is done.
+ */
+typedef struct {
+	SampleStream *blob; // NULL when there is no usable cache
+	const SampleCacheHeader *header;
+	const SampleCacheEntry *entries;
+} SampleCache;
+
+bool getSampleFileStamp(const char *path, SampleFileStamp *stamp);
+void openSampleCache(SampleCache *cache);
+void closeSampleCache(SampleCache *cache);
+const SampleCacheEntry *findSampleCacheEntry(const SampleCache *cache, const char *path, const SampleFileStamp *stamp);
+/**
+ * @return the cached frames in the entry's format, NULL for entries that were streamed.
+ */
+const void *getSampleCacheData(const SampleCache *cache, const SampleCacheEntry *entry);
+/**
+ * @brief Rewrites the blob from the given pool slots. The cache has to be closed first, the file is replaced.
+ */
+bool writeSampleCache(SamplePool *sp, const int *indices, char *const *paths, const SampleFileStamp *stamps, int count);
+
+#endif
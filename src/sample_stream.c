@@ -0,0 +1,341 @@
+#include "sample_stream.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "denormal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define STREAM_PAGE_BYTES 4096
+
+void makeSampleCacheDirectory() {
+#ifdef _WIN32
+	_mkdir(SAMPLE_CACHE_PATH);
+#else
+	if(mkdir(SAMPLE_CACHE_PATH, 0755) != 0 && errno != EEXIST) {
+		perror("Failed to create sample cache directory");
+	}
+#endif
+}
+
+static char *cachePathForSample(const char *name) {
+	// FNV-1a of the full path keeps same-named files from different folders apart
+	uint32_t hash = 2166136261u;
+	for(const char *c = name; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	}
+	const char *base = name;
+	for(const char *c = name; *c; c++) {
+		if(*c == '/' || *c == '\\') base = c + 1;
+	}
+	size_t size = strlen(SAMPLE_CACHE_PATH) + strlen(base) + 16;
+	char *path = (char *)malloc(size);
+	if(!path) return NULL;
+	snprintf(path, size, "%s%08x_%s.f32", SAMPLE_CACHE_PATH, hash, base);
+	return path;
+}
+
+static long long fileSize(const char *path) {
+	struct stat st;
+	if(stat(path, &st) != 0) {
+		return -1;
+	}
+	return (long long)st.st_size;
+}
+
+static bool mapCacheFile(SampleStream *stream) {
+	// the attack is faulted in even if locking it is refused
+	size_t prefaultBytes = stream->pinnedBytes;
+#ifdef _WIN32
+	stream->fileHandle = CreateFileA(stream->path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(stream->fileHandle == INVALID_HANDLE_VALUE) return false;
+	stream->mapHandle = CreateFileMappingA(stream->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!stream->mapHandle) {
+		CloseHandle(stream->fileHandle);
+		return false;
+	}
+	stream->mapping = MapViewOfFile(stream->mapHandle, FILE_MAP_READ, 0, 0, stream->size);
+	if(!stream->mapping) {
+		CloseHandle(stream->mapHandle);
+		CloseHandle(stream->fileHandle);
+		return false;
+	}
+	if(stream->pinnedBytes && !VirtualLock(stream->mapping, stream->pinnedBytes)) {
+		stream->pinnedBytes = 0;
+	}
+#else
+	stream->fd = open(stream->path, O_RDONLY);
+	if(stream->fd < 0) return false;
+	stream->mapping = mmap(NULL, stream->size, PROT_READ, MAP_SHARED, stream->fd, 0);
+	if(stream->mapping == MAP_FAILED) {
+		stream->mapping = NULL;
+		close(stream->fd);
+		return false;
+	}
+	madvise(stream->mapping, stream->pinnedBytes, MADV_WILLNEED);
+	if(mlock(stream->mapping, stream->pinnedBytes) != 0) {
+		// RLIMIT_MEMLOCK is often tiny, resident is still better than nothing
+		stream->pinnedBytes = 0;
+	}
+#endif
+	// fault the attack in now rather than on the first note
+	volatile float sink = 0.0f;
+	for(size_t offset = 0; offset < prefaultBytes; offset += STREAM_PAGE_BYTES) {
+		sink += *(const float *)((const char *)stream->mapping + offset);
+	}
+	(void)sink;
+	return true;
+}
+
+SampleStream *mapSampleStream(const char *path, size_t size, size_t pinnedBytes) {
+	SampleStream *stream = (SampleStream *)malloc(sizeof(SampleStream));
+	if(!stream) {
+		printf("could not allocate memory for sample stream.\n");
+		return NULL;
+	}
+	stream->path = (char *)malloc(strlen(path) + 1);
+	if(!stream->path) {
+		free(stream);
+		return NULL;
+	}
+	strcpy(stream->path, path);
+	stream->size = size;
+	stream->pinnedBytes = pinnedBytes > size ? size : pinnedBytes;
+	stream->mapping = NULL;
+	if(size == 0 || !mapCacheFile(stream)) {
+		free(stream->path);
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+static size_t attackBytes(int length) {
+	return (size_t)(length < STREAM_ATTACK_FRAMES ? length : STREAM_ATTACK_FRAMES) * sizeof(float);
+}
+
+bool beginSampleStream(SampleStreamWriter *writer, const char *name) {
+	makeSampleCacheDirectory();
+	writer->length = 0;
+	writer->file = NULL;
+	writer->path = cachePathForSample(name);
+	if(!writer->path) {
+		return false;
+	}
+	writer->file = fopen(writer->path, "wb");
+	if(!writer->file) {
+		printf("Failed to create sample cache file: %s\n", writer->path);
+		return false;
+	}
+	return true;
+}
+
+bool writeSampleStream(SampleStreamWriter *writer, const float *data, int count) {
+	if(fwrite(data, sizeof(float), count, writer->file) != (size_t)count) {
+		printf("Failed to write sample cache file: %s\n", writer->path);
+		return false;
+	}
+	writer->length += count;
+	return true;
+}
+
+void cancelSampleStream(SampleStreamWriter *writer) {
+	if(writer->file) {
+		fclose(writer->file);
+		writer->file = NULL;
+		// a partial file would pass for a cached stream of the wrong length otherwise
+		remove(writer->path);
+	}
+	free(writer->path);
+	writer->path = NULL;
+}
+
+SampleStream *finishSampleStream(SampleStreamWriter *writer) {
+	bool closed = fclose(writer->file) == 0;
+	writer->file = NULL;
+	SampleStream *stream = NULL;
+	if(closed) {
+		stream = mapSampleStream(writer->path, (size_t)writer->length * sizeof(float), attackBytes(writer->length));
+	} else {
+		printf("Failed to write sample cache file: %s\n", writer->path);
+	}
+	if(!stream) {
+		remove(writer->path);
+	}
+	free(writer->path);
+	writer->path = NULL;
+	return stream;
+}
+
+SampleStream *createSampleStream(const char *name, const float *data, int length) {
+	SampleStreamWriter writer;
+	SampleStream *stream = NULL;
+	if(beginSampleStream(&writer, name)) {
+		if(writeSampleStream(&writer, data, length)) {
+			stream = finishSampleStream(&writer);
+		}
+	}
+	cancelSampleStream(&writer);
+	if(!stream) {
+		printf("Failed to map sample cache for %s\n", name);
+	}
+	return stream;
+}
+
+SampleStream *openCachedSampleStream(const char *name, int length) {
+	char *path = cachePathForSample(name);
+	if(!path) return NULL;
+	SampleStream *stream = NULL;
+	size_t size = (size_t)length * sizeof(float);
+	if(fileSize(path) == (long long)size) {
+		stream = mapSampleStream(path, size, attackBytes(length));
+	}
+	free(path);
+	return stream;
+}
+
+void freeSampleStream(SampleStream *stream) {
+	if(!stream) return;
+#ifdef _WIN32
+	if(stream->pinnedBytes) VirtualUnlock(stream->mapping, stream->pinnedBytes);
+	UnmapViewOfFile(stream->mapping);
+	CloseHandle(stream->mapHandle);
+	CloseHandle(stream->fileHandle);
+#else
+	if(stream->pinnedBytes) munlock(stream->mapping, stream->pinnedBytes);
+	munmap(stream->mapping, stream->size);
+	close(stream->fd);
+#endif
+	free(stream->path);
+	free(stream);
+}
+
+static void sleepMs(int ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void *prefetchThread(void *arg) {
+	SampleStreamer *streamer = (SampleStreamer *)arg;
+	// same FTZ/DAZ mode as the audio thread, the mode does not carry over to new threads
+	setFlushDenormals(true);
+	// last window touched per cursor, so a voice parked in the same place costs nothing
+	const float *lastData[MAX_STREAM_CURSORS] = { 0 };
+	int lastEnd[MAX_STREAM_CURSORS] = { 0 };
+	volatile float sink = 0.0f;
+
+	while(atomic_load_explicit(&streamer->running, memory_order_acquire)) {
+		int count = atomic_load_explicit(&streamer->cursorCount, memory_order_acquire);
+		epochEnter(streamer->epoch, EPOCH_READER_PREFETCH);
+		for(int c = 0; c < count; c++) {
+			StreamCursor *cursor = &streamer->cursors[c];
+			const float *data = atomic_load_explicit(&cursor->data, memory_order_acquire);
+			if(!data) {
+				lastData[c] = NULL;
+				continue;
+			}
+			int length = atomic_load_explicit(&cursor->length, memory_order_relaxed);
+			int position = atomic_load_explicit(&cursor->position, memory_order_relaxed);
+			int start = position < 0 ? 0 : position;
+			int end = start + STREAM_LOOKAHEAD_FRAMES;
+			end = end > length ? length : end;
+			if(data == lastData[c] && start < lastEnd[c] && end <= lastEnd[c]) {
+				continue;
+			}
+			if(data == lastData[c] && start < lastEnd[c]) {
+				start = lastEnd[c];
+			}
+#ifndef _WIN32
+			uintptr_t pageStart = (uintptr_t)(data + start) & ~(uintptr_t)(STREAM_PAGE_BYTES - 1);
+			madvise((void *)pageStart, (uintptr_t)(data + end) - pageStart, MADV_WILLNEED);
+#endif
+			for(int frame = start; frame < end; frame += STREAM_PAGE_BYTES / sizeof(float)) {
+				sink += data[frame];
+			}
+			lastData[c] = data;
+			lastEnd[c] = end;
+		}
+		epochExit(streamer->epoch, EPOCH_READER_PREFETCH);
+		sleepMs(STREAM_PREFETCH_INTERVAL_MS);
+	}
+	(void)sink;
+	return NULL;
+}
+
+SampleStreamer *createSampleStreamer(EpochDomain *epoch) {
+	SampleStreamer *streamer = (SampleStreamer *)malloc(sizeof(SampleStreamer));
+	if(!streamer) {
+		printf("could not allocate memory for sample streamer.\n");
+		return NULL;
+	}
+	for(int i = 0; i < MAX_STREAM_CURSORS; i++) {
+		atomic_init(&streamer->cursors[i].data, NULL);
+		atomic_init(&streamer->cursors[i].length, 0);
+		atomic_init(&streamer->cursors[i].position, 0);
+	}
+	atomic_init(&streamer->cursorCount, 0);
+	atomic_init(&streamer->running, true);
+	streamer->epoch = epoch;
+	streamer->threadStarted = pthread_create(&streamer->thread, NULL, prefetchThread, streamer) == 0;
+	if(!streamer->threadStarted) {
+		printf("WARNING: could not start the sample prefetch thread, streamed samples will fault in on demand.\n");
+	}
+	return streamer;
+}
+
+void freeSampleStreamer(SampleStreamer *streamer) {
+	if(!streamer) return;
+	atomic_store_explicit(&streamer->running, false, memory_order_release);
+	if(streamer->threadStarted) {
+		pthread_join(streamer->thread, NULL);
+	}
+	free(streamer);
+}
+
+int acquireStreamCursor(SampleStreamer *streamer) {
+	if(!streamer) return -1;
+	int cursor = atomic_fetch_add(&streamer->cursorCount, 1);
+	if(cursor >= MAX_STREAM_CURSORS) {
+		atomic_store(&streamer->cursorCount, MAX_STREAM_CURSORS);
+		return -1;
+	}
+	return cursor;
+}
+
+void setStreamCursor(SampleStreamer *streamer, int cursor, const float *data, int length, int position) {
+	if(!streamer || cursor < 0) return;
+	StreamCursor *c = &streamer->cursors[cursor];
+	atomic_store_explicit(&c->length, length, memory_order_relaxed);
+	atomic_store_explicit(&c->position, position, memory_order_relaxed);
+	atomic_store_explicit(&c->data, data, memory_order_release);
+}
+
+void clearStreamCursors(SampleStreamer *streamer, const void *begin, size_t size) {
+	if(!streamer) return;
+	const char *lo = (const char *)begin;
+	int count = atomic_load_explicit(&streamer->cursorCount, memory_order_acquire);
+	for(int c = 0; c < count && c < MAX_STREAM_CURSORS; c++) {
+		const float *data = atomic_load_explicit(&streamer->cursors[c].data, memory_order_acquire);
+		if(data && (const char *)data >= lo && (const char *)data < lo + size) {
+			atomic_compare_exchange_strong(&streamer->cursors[c].data, &data, NULL);
+		}
+	}
+}
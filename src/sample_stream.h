@@ -0,0 +1,106 @@
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "epoch.h"
+#include "settings.h"
+
+// samples at least this big are streamed from disk even when the pool still has room
+#define STREAM_MIN_BYTES (4 * 1024 * 1024)
+// frames kept resident for the note-on, before the prefetcher has had a chance to look at the voice
+#define STREAM_ATTACK_FRAMES 32768
+// how far ahead of a playing voice the prefetcher keeps pages resident
+#define STREAM_LOOKAHEAD_FRAMES 88200
+#define STREAM_PREFETCH_INTERVAL_MS 5
+#define MAX_STREAM_CURSORS (MAX_SEQUENCER_CHANNELS * MAX_VOICES_PER_CHANNEL)
+
+/**
+ * Decoded float32 sample data written to a cache file and mapped read-only. Sample->data points straight into the
+ * mapping so the playback code does not care where the frames live; the OS pages them in (and evicts them) on demand.
+ */
+typedef struct {
+	char *path;
+	void *mapping;
+	size_t size;
+	size_t pinnedBytes;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mapHandle;
+#else
+	int fd;
+#endif
+} SampleStream;
+
+typedef struct {
+	_Atomic(const float *) data; // NULL while the voice is idle
+	atomic_int length;
+	atomic_int position;
+} StreamCursor;
+
+/**
+ * Voices publish where they are reading once per block, the prefetch thread touches the pages ahead of them so the
+ * page faults happen there and not in the audio callback.
+ */
+typedef struct {
+	StreamCursor cursors[MAX_STREAM_CURSORS];
+	atomic_int cursorCount;
+	atomic_bool running;
+	pthread_t thread;
+	bool threadStarted;
+	EpochDomain *epoch; // the owning pool's, mappings are only unmapped once a sweep can no longer see them
+} SampleStreamer;
+
+/**
+ * Fills a cache file a chunk at a time, so a decoder never has to hold the whole sample in memory.
+ */
+typedef struct {
+	char *path;
+	FILE *file;
+	int length; // floats written so far
+} SampleStreamWriter;
+
+// creates SAMPLE_CACHE_PATH if it is not there yet
+void makeSampleCacheDirectory();
+/**
+ * @brief Writes the decoded frames to the cache directory and maps them back, pinning the attack portion.
+ * @return NULL if the cache file could not be written or mapped.
+ */
+SampleStream *createSampleStream(const char *name, const float *data, int length);
+bool beginSampleStream(SampleStreamWriter *writer, const char *name);
+bool writeSampleStream(SampleStreamWriter *writer, const float *data, int count);
+/**
+ * @brief Closes the cache file and maps it like createSampleStream, NULL (and the file removed) on failure.
+ */
+SampleStream *finishSampleStream(SampleStreamWriter *writer);
+void cancelSampleStream(SampleStreamWriter *writer);
+/**
+ * @brief Maps the cache file an earlier createSampleStream wrote for name, NULL if it is missing or the wrong size.
+ */
+SampleStream *openCachedSampleStream(const char *name, int length);
+/**
+ * @brief Maps any existing file read-only, pinning and prefaulting its first pinnedBytes.
+ */
+SampleStream *mapSampleStream(const char *path, size_t size, size_t pinnedBytes);
+void freeSampleStream(SampleStream *stream);
+
+SampleStreamer *createSampleStreamer(EpochDomain *epoch);
+void freeSampleStreamer(SampleStreamer *streamer);
+/**
+ * @brief Hands out a cursor slot for one voice, -1 when all slots are taken (the voice then just isn't prefetched).
+ */
+int acquireStreamCursor(SampleStreamer *streamer);
+/**
+ * @brief Audio thread side: publish the read position of a voice, data NULL marks it idle. Lock-free.
+ */
+void setStreamCursor(SampleStreamer *streamer, int cursor, const float *data, int length, int position);
+/**
+ * @brief Idles every cursor still pointing into [begin, begin + size), for unloading a stream no voice can reach any more.
+ */
+void clearStreamCursors(SampleStreamer *streamer, const void *begin, size_t size);
+
+#endif
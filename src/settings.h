@@ -21,6 +21,8 @@
 #define SETTINGS_PATH "settings.dat"
 #define SONG_FOLDER_PATH "songs/"
 #define SAMPLE_FOLDER_PATH "samples/"
+#define SAMPLE_CACHE_PATH "cache/"
+#define SAMPLE_LOADER_THREADS 4
 
 typedef enum {
 	GLOBAL,
@@ -0,0 +1,51 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// GCC/Clang vector extensions, these lower to SSE on x86 and NEON on the ARM builds
+typedef float v4sf __attribute__((vector_size(16)));
+typedef int v4si __attribute__((vector_size(16)));
+
+#define V4SF_LANES 4
+
+static inline v4sf v4sfSet1(float x) {
+	return (v4sf){ x, x, x, x };
+}
+
+// vector ?: is C++ only, so selects are done through the comparison masks
+static inline v4sf v4sfSelect(v4si mask, v4sf a, v4sf b) {
+	return (v4sf)((mask & (v4si)a) | (~mask & (v4si)b));
+}
+
+static inline v4sf v4sfMin(v4sf a, v4sf b) {
+	return v4sfSelect(a < b, a, b);
+}
+
+static inline v4sf v4sfMax(v4sf a, v4sf b) {
+	return v4sfSelect(a > b, a, b);
+}
+
+static inline float v4sfSum(v4sf v) {
+	return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+// round half away from zero, plain conversion truncates towards zero
+static inline v4sf v4sfRound(v4sf x) {
+	v4sf half = v4sfSelect(x < 0.0f, v4sfSet1(-0.5f), v4sfSet1(0.5f));
+	return __builtin_convertvector(__builtin_convertvector(x + half, v4si), v4sf);
+}
+
+/*
+ * IEEE half to float on plain integer lanes (bits in the low 16 of each), so it needs neither F16C nor _Float16.
+ * Normals get their exponent rebiased on the integer bits and Inf/NaN have it saturated. Half denormals are their
+ * mantissa times 2^-24, converted from the integer so no float denormal is ever an operand (DAZ would read it as 0).
+ */
+static inline v4sf v4sfFromHalf(v4si h) {
+	v4si exponent = h & 0x7c00;
+	v4si o = ((h & 0x7fff) << 13) + ((127 - 15) << 23);
+	o |= (exponent == 0x7c00) & (255 << 23);
+	v4sf denormal = __builtin_convertvector(h & 0x03ff, v4sf) * v4sfSet1(0x1p-24f);
+	v4sf f = v4sfSelect(exponent == 0, denormal, (v4sf)o);
+	return (v4sf)((v4si)f | ((h & 0x8000) << 16));
+}
+
+#endif
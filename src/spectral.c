@@ -0,0 +1,344 @@
+#include "spectral.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "denormal.h"
+#include "fft.h"
+#include "oscillator.h"
+#include "pcm.h"
+#include "spectral_cache.h"
+
+// periodic Hann, its squares add up to exactly 1.5 at a quarter frame hop
+static float analysisWindow[SPECTRAL_FFT_SIZE];
+// the same again with the 1 / N of the inverse transform and the 1 / 1.5 of the overlap folded in
+static float synthesisWindow[SPECTRAL_FFT_SIZE];
+static bool windowReady = false;
+
+void initSpectral() {
+	if(windowReady) {
+		return;
+	}
+	for(int i = 0; i < SPECTRAL_FFT_SIZE; i++) {
+		analysisWindow[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / SPECTRAL_FFT_SIZE));
+		synthesisWindow[i] = analysisWindow[i] / (SPECTRAL_FFT_SIZE * 1.5f);
+	}
+	windowReady = true;
+}
+
+// left channel of the sample as floats, copied under the pool lock so a reload cannot pull the data away mid read
+static float *copySourceFrames(SamplePool *sp, Sample *s, int *length) {
+	float *frames = NULL;
+	*length = 0;
+	pthread_mutex_lock(&sp->lock);
+	const void *data = s->data;
+	if(data && s->length > 0) {
+		frames = (float *)malloc(sizeof(float) * s->length);
+	}
+	if(frames) {
+		for(int i = 0; i < s->length; i++) {
+			frames[i] = loadSampleValue(data, s->format, (size_t)i * s->channels);
+		}
+		*length = s->length;
+	}
+	pthread_mutex_unlock(&sp->lock);
+	return frames;
+}
+
+// false if cancelled before it finished
+static bool analyseFrames(SpectralSource *source, const float *x, int length, float *magnitude, float *phase, int frameCount) {
+	kiss_fft_scalar frame[SPECTRAL_FFT_SIZE];
+	kiss_fft_cpx bins[SPECTRAL_BINS];
+	bool done = true;
+	for(int f = 0; f < frameCount; f++) {
+		if(atomic_load_explicit(&source->cancel, memory_order_relaxed)) {
+			done = false;
+			break;
+		}
+		int begin = f * SPECTRAL_HOP - SPECTRAL_FFT_SIZE / 2;
+		// rotated by half a frame so the phases are measured from the window centre, the bins of one steady partial then
+		// share a phase instead of alternating, and keep sharing it when the pitch shift spreads them out
+		for(int i = 0; i < SPECTRAL_FFT_SIZE; i++) {
+			int index = begin + i;
+			float value = index >= 0 && index < length ? x[index] : 0.0f;
+			frame[(i + SPECTRAL_FFT_SIZE / 2) % SPECTRAL_FFT_SIZE] = value * analysisWindow[i];
+		}
+		kiss_fftr(source->forward, frame, bins);
+		float *m = magnitude + (size_t)f * SPECTRAL_BINS;
+		float *p = phase + (size_t)f * SPECTRAL_BINS;
+		for(int k = 0; k < SPECTRAL_BINS; k++) {
+			m[k] = hypotf(bins[k].r, bins[k].i);
+			p[k] = atan2f(bins[k].i, bins[k].r);
+		}
+	}
+	return done;
+}
+
+static void loadSpectralFrames(SpectralSource *source) {
+	int length = 0;
+	float *x = copySourceFrames(source->pool, source->sample, &length);
+	if(!x) {
+		return;
+	}
+	int frameCount = length / SPECTRAL_HOP + 1;
+	uint64_t hash = hashSpectralContent(x, length);
+	SampleStream *cache = openSpectralCache(hash, SPECTRAL_FFT_SIZE, SPECTRAL_HOP, frameCount, SPECTRAL_BINS);
+	if(cache) {
+		source->cache = cache;
+		source->magnitude = getSpectralCacheMagnitude(cache);
+		source->phase = getSpectralCachePhase(cache);
+	} else {
+		size_t count = (size_t)frameCount * SPECTRAL_BINS;
+		float *frames = (float *)malloc(sizeof(float) * count * 2);
+		if(!frames) {
+			printf("could not allocate memory for spectral analysis of %s.\n", source->sample->name);
+			free(x);
+			return;
+		}
+		if(!analyseFrames(source, x, length, frames, frames + count, frameCount)) {
+			free(frames);
+			free(x);
+			return;
+		}
+		writeSpectralCache(hash, SPECTRAL_FFT_SIZE, SPECTRAL_HOP, frameCount, SPECTRAL_BINS, frames, frames + count);
+		source->frames = frames;
+		source->magnitude = frames;
+		source->phase = frames + count;
+	}
+	free(x);
+	source->frameCount = frameCount;
+	__atomic_store_n(&source->ready, true, __ATOMIC_RELEASE);
+}
+
+static void *spectralAnalysisThread(void *arg) {
+	SpectralSource *source = (SpectralSource *)arg;
+	// the mode is per thread, quiet tails of the sample would otherwise run the transforms on denormals
+	setFlushDenormals(true);
+	loadSpectralFrames(source);
+	releaseFFTPlan(source->forward);
+	source->forward = NULL;
+	return NULL;
+}
+
+SpectralSource *createSpectralSource(SamplePool *sp, Sample *s) {
+	SpectralSource *source = (SpectralSource *)malloc(sizeof(SpectralSource));
+	if(!source) {
+		printf("could not allocate memory for spectral source.\n");
+		return NULL;
+	}
+	source->magnitude = NULL;
+	source->phase = NULL;
+	source->frameCount = 0;
+	source->sampleRate = s ? s->sampleRate : SAMPLE_RATE;
+	source->sample = s;
+	source->pool = sp;
+	source->cache = NULL;
+	source->frames = NULL;
+	source->ready = false;
+	atomic_init(&source->cancel, false);
+	source->workerStarted = false;
+	// the inverse is only run by voices on the audio thread and is shared by every source, the forward plan is the
+	// worker's alone and goes back as soon as the analysis is done
+	source->inverse = acquireFFTPlan(SPECTRAL_FFT_SIZE, FFT_INVERSE, FFT_THREAD_AUDIO);
+	source->forward = s && sp ? acquireFFTPlan(SPECTRAL_FFT_SIZE, FFT_FORWARD, FFT_THREAD_WORKER) : NULL;
+	if(!source->inverse || (s && sp && !source->forward)) {
+		releaseFFTPlan(source->inverse);
+		releaseFFTPlan(source->forward);
+		free(source);
+		return NULL;
+	}
+	if(s && sp) {
+		source->workerStarted = pthread_create(&source->worker, NULL, spectralAnalysisThread, source) == 0;
+		if(!source->workerStarted) {
+			printf("could not start spectral analysis of %s.\n", s->name);
+		}
+	}
+	return source;
+}
+
+void freeSpectralSource(SpectralSource *source) {
+	if(!source) {
+		return;
+	}
+	if(source->workerStarted) {
+		atomic_store(&source->cancel, true);
+		pthread_join(source->worker, NULL);
+	}
+	freeSampleStream(source->cache);
+	free(source->frames);
+	releaseFFTPlan(source->forward);
+	releaseFFTPlan(source->inverse);
+	free(source);
+}
+
+PhaseVocoder *createPhaseVocoder() {
+	PhaseVocoder *pv = (PhaseVocoder *)malloc(sizeof(PhaseVocoder));
+	if(!pv) {
+		printf("could not allocate memory for phase vocoder.\n");
+		return NULL;
+	}
+	startPhaseVocoder(pv, 0.0);
+	return pv;
+}
+
+void freePhaseVocoder(PhaseVocoder *pv) {
+	free(pv);
+}
+
+void startPhaseVocoder(PhaseVocoder *pv, double start) {
+	pv->position = start;
+	pv->primed = false;
+	pv->readyIndex = SPECTRAL_HOP;
+	memset(pv->ola, 0, sizeof(pv->ola));
+	memset(pv->phase, 0, sizeof(pv->phase));
+}
+
+// to [-pi, pi)
+static float wrapPhase(float phase) {
+	const float twoPi = 2.0f * (float)M_PI;
+	return phase - twoPi * floorf(phase / twoPi + 0.5f);
+}
+
+// frames before the first and after the last are silent
+static const float *frameRow(const float *rows, const SpectralSource *source, int frame) {
+	return frame >= 0 && frame < source->frameCount ? rows + frame * SPECTRAL_BINS : NULL;
+}
+
+// the true frequency of bin k in radians per source frame, from how far its phase moved between two frames
+static float binOmega(const float *p0, const float *p1, int k) {
+	float omega = 2.0f * (float)M_PI * k / SPECTRAL_FFT_SIZE;
+	if(p0 && p1) {
+		omega += wrapPhase(p1[k] - p0[k] - omega * SPECTRAL_HOP) / SPECTRAL_HOP;
+	}
+	return omega;
+}
+
+// phase rows are clamped to the source so the frequencies carry on into the silence either side of it
+static int phaseFrame(const SpectralSource *source, int frame) {
+	return frame < 0 ? 0 : (frame >= source->frameCount ? source->frameCount - 1 : frame);
+}
+
+static void synthesizeFrame(PhaseVocoder *pv, const SpectralSource *source, double step, float shift) {
+	double framePosition = pv->position / SPECTRAL_HOP;
+	int f0 = (int)floor(framePosition);
+	float t = (float)(framePosition - f0);
+	const float *m0 = frameRow(source->magnitude, source, f0);
+	const float *m1 = frameRow(source->magnitude, source, f0 + 1);
+
+	if(m0 || m1) {
+		int pf = phaseFrame(source, f0);
+		const float *p0 = frameRow(source->phase, source, pf);
+		const float *p1 = frameRow(source->phase, source, pf + 1);
+		const float *lock = source->phase + phaseFrame(source, (int)floor(framePosition + 0.5)) * SPECTRAL_BINS;
+
+		for(int k = 0; k < SPECTRAL_BINS; k++) {
+			float a = m0 ? m0[k] : 0.0f;
+			float b = m1 ? m1[k] : 0.0f;
+			pv->magnitude[k] = a + (b - a) * t;
+			pv->shifted[k] = 0.0f;
+			pv->locked[k] = pv->phase[k];
+		}
+
+		// each partial is moved as a whole, its peak and the bins around it up to halfway to the next peak, by a whole
+		// number of bins so the shape of its lobe (and so its level) survives the shift. Only the peaks run on their own
+		// accumulated phase, every other bin keeps the analysis phase offset it has to its peak (identity phase
+		// locking). Left to accumulate separately, the bins of one partial drift apart wherever the frequency estimate is
+		// off, at onsets and the edges of the source, and never come back together
+		int peakCount = 0;
+		for(int k = 1; k < SPECTRAL_BINS - 1; k++) {
+			float m = pv->magnitude[k];
+			if(m > pv->magnitude[k - 1] && m >= pv->magnitude[k + 1]) {
+				pv->peaks[peakCount++] = k;
+			}
+		}
+		for(int p = 0; p < peakCount; p++) {
+			int peak = pv->peaks[p];
+			int from = p > 0 ? (pv->peaks[p - 1] + peak) / 2 + 1 : 0;
+			int to = p + 1 < peakCount ? (peak + pv->peaks[p + 1]) / 2 : SPECTRAL_BINS - 1;
+			int offset = (int)lrintf(peak * (shift - 1.0f));
+			if(peak + offset < 0 || peak + offset >= SPECTRAL_BINS) {
+				continue;
+			}
+			float peakPhase = pv->phase[peak + offset];
+			for(int k = from; k <= to; k++) {
+				int j = k + offset;
+				if(j < 0 || j >= SPECTRAL_BINS || pv->magnitude[k] <= pv->shifted[j]) {
+					continue;
+				}
+				pv->shifted[j] = pv->magnitude[k];
+				pv->locked[j] = peakPhase + lock[k] - lock[peak];
+				pv->fromBin[j] = k;
+			}
+		}
+		for(int j = 0; j < SPECTRAL_BINS; j++) {
+			pv->spectrum[j].r = pv->shifted[j] * cosf(pv->locked[j]);
+			pv->spectrum[j].i = pv->shifted[j] * sinf(pv->locked[j]);
+		}
+
+		// then every bin moves on to where the next frame picks up, the silent ones too so a partial that starts on
+		// them lines up with the source. advance turns omega, in radians per source frame, into the phase the shifted
+		// bin moves through in one synthesis hop
+		float advance = shift * SPECTRAL_HOP;
+		for(int j = 0; j < SPECTRAL_BINS; j++) {
+			int k = (int)lrintf(j / shift);
+			k = pv->shifted[j] > 0.0f ? pv->fromBin[j] : (k < SPECTRAL_BINS ? k : SPECTRAL_BINS - 1);
+			pv->phase[j] = wrapPhase(pv->locked[j] + binOmega(p0, p1, k) * advance);
+		}
+
+		kiss_fftri(source->inverse, pv->spectrum, pv->frame);
+		// rotated back, see createSpectralSource
+		const int half = SPECTRAL_FFT_SIZE / 2;
+		for(int i = 0; i < half; i++) {
+			pv->ola[i] += pv->frame[i + half] * synthesisWindow[i];
+		}
+		for(int i = half; i < SPECTRAL_FFT_SIZE; i++) {
+			pv->ola[i] += pv->frame[i - half] * synthesisWindow[i];
+		}
+	}
+
+	// no later frame reaches the first hop, so it is done
+	memcpy(pv->ready, pv->ola, sizeof(pv->ready));
+	memmove(pv->ola, pv->ola + SPECTRAL_HOP, sizeof(float) * (SPECTRAL_FFT_SIZE - SPECTRAL_HOP));
+	memset(pv->ola + SPECTRAL_FFT_SIZE - SPECTRAL_HOP, 0, sizeof(float) * SPECTRAL_HOP);
+	pv->readyIndex = 0;
+	pv->position += step * SPECTRAL_HOP;
+}
+
+void renderPhaseVocoder(PhaseVocoder *pv, const SpectralSource *source, double step, float shift, float *out, int count) {
+	if(!source || !__atomic_load_n(&source->ready, __ATOMIC_ACQUIRE) || source->frameCount == 0 || shift <= 0.0f) {
+		memset(out, 0, count * sizeof(float));
+		return;
+	}
+
+	if(!pv->primed) {
+		// the hop handed out after the fourth frame is the first complete one, and it starts half a frame before that
+		// frame's centre. The first frame is placed so that lands on the start position, and the phases are taken from
+		// the analysis there, so an unshifted note opens just like the source
+		pv->position += SPECTRAL_HOP * (2.0 - 3.0 * step);
+		int pf = phaseFrame(source, (int)floor(pv->position / SPECTRAL_HOP));
+		const float *p0 = source->phase + pf * SPECTRAL_BINS;
+		const float *p1 = frameRow(source->phase, source, pf + 1);
+		float offset = (float)(pv->position - (double)pf * SPECTRAL_HOP);
+		for(int k = 0; k < SPECTRAL_BINS; k++) {
+			pv->phase[k] = wrapPhase(p0[k] + binOmega(p0, p1, k) * offset);
+		}
+		for(int i = 0; i < 3; i++) {
+			synthesizeFrame(pv, source, step, shift);
+		}
+		pv->readyIndex = SPECTRAL_HOP;
+		pv->primed = true;
+	}
+
+	for(int done = 0; done < count;) {
+		if(pv->readyIndex == SPECTRAL_HOP) {
+			synthesizeFrame(pv, source, step, shift);
+		}
+		int n = SPECTRAL_HOP - pv->readyIndex;
+		n = n < count - done ? n : count - done;
+		memcpy(out + done, pv->ready + pv->readyIndex, n * sizeof(float));
+		pv->readyIndex += n;
+		done += n;
+	}
+}
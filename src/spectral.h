@@ -0,0 +1,90 @@
+#ifndef SPECTRAL_H
+#define SPECTRAL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "kiss_fftr.h"
+#include "sample.h"
+#include "sample_stream.h"
+
+#define SPECTRAL_FFT_SIZE 2048
+#define SPECTRAL_BINS (SPECTRAL_FFT_SIZE / 2 + 1)
+// analysis and synthesis hop, a quarter frame so the squared Hann windows overlap-add to a constant
+#define SPECTRAL_HOP (SPECTRAL_FFT_SIZE / 4)
+#define SPECTRAL_MAX_SPEED 4.0f
+#define SPECTRAL_MAX_PITCH 24.0f // semitones either way
+
+/**
+ * STFT of a sample, shared by all voices of a spectral instrument. Frame f is centred on source frame f * hop, so the
+ * analysis is paid once and a voice only runs the inverse transform for what it plays.
+ *
+ * The frames come from the spectral cache when the sample has been analysed before, otherwise a worker thread works
+ * them out and writes the cache. Either way that happens off the calling thread, voices stay silent until ready is set.
+ */
+typedef struct {
+	const float *magnitude; // frameCount rows of SPECTRAL_BINS
+	const float *phase;
+	int frameCount;
+	float sampleRate; // of the analysed sample
+	kiss_fftr_cfg inverse;
+	kiss_fftr_cfg forward; // held by the worker until it finishes
+	Sample *sample;
+	SamplePool *pool;
+	SampleStream *cache; // mapping the frames live in when they came from the cache
+	float *frames;       // when they did not, magnitude then phase
+	bool ready;          // released by the worker once the fields above are final
+	atomic_bool cancel;
+	pthread_t worker;
+	bool workerStarted;
+} SpectralSource;
+
+/**
+ * A voice's resynthesis state. Each hop one frame is built from the source at the read position, inverse transformed
+ * and overlap-added, after which the oldest hop of the accumulator can no longer change and is handed out.
+ */
+typedef struct {
+	double position; // source frame the next synthesis frame is centred on
+	bool primed;
+	float phase[SPECTRAL_BINS];
+	float ola[SPECTRAL_FFT_SIZE];
+	float ready[SPECTRAL_HOP];
+	int readyIndex;
+	// scratch for building a frame
+	float magnitude[SPECTRAL_BINS]; // of the source at the read position
+	int peaks[SPECTRAL_BINS];
+	float shifted[SPECTRAL_BINS];   // magnitudes after the pitch shift
+	float locked[SPECTRAL_BINS];    // and their phases
+	int fromBin[SPECTRAL_BINS];     // source bin each shifted bin was moved from
+	kiss_fft_cpx spectrum[SPECTRAL_BINS];
+	kiss_fft_scalar frame[SPECTRAL_FFT_SIZE];
+} PhaseVocoder;
+
+/**
+ * @brief Builds the window table, safe to call repeatedly. Must have run before a source is analysed.
+ */
+void initSpectral();
+/**
+ * @brief Starts loading or analysing the sample's left channel at its own rate, and returns straight away. Not
+ *        realtime safe.
+ */
+SpectralSource *createSpectralSource(SamplePool *sp, Sample *s);
+/**
+ * @brief Stops the worker if it is still running.
+ */
+void freeSpectralSource(SpectralSource *source);
+PhaseVocoder *createPhaseVocoder();
+void freePhaseVocoder(PhaseVocoder *pv);
+/**
+ * @param start source frame the output should begin at.
+ */
+void startPhaseVocoder(PhaseVocoder *pv, double start);
+/**
+ * @brief Renders count frames into out (overwritten). Past the end of the source the output is silent.
+ * @param step source frames the read position moves per output frame, 0 freezes it.
+ * @param shift output over source frequency ratio, which includes any difference between the two rates.
+ */
+void renderPhaseVocoder(PhaseVocoder *pv, const SpectralSource *source, double step, float shift, float *out, int count);
+
+#endif
@@ -0,0 +1,95 @@
+#include "spectral_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static void spectralCachePath(char *path, size_t size, uint64_t contentHash, int fftSize, int hop) {
+	snprintf(path, size, "%sstft_%016llx_%d_%d.bin", SAMPLE_CACHE_PATH, (unsigned long long)contentHash, fftSize, hop);
+}
+
+static size_t spectralCacheSize(int frameCount, int bins) {
+	return sizeof(SpectralCacheHeader) + (size_t)frameCount * bins * sizeof(float) * 2;
+}
+
+uint64_t hashSpectralContent(const float *data, int length) {
+	uint64_t hash = 14695981039346656037ull;
+	const uint8_t *bytes = (const uint8_t *)data;
+	for(size_t i = 0; i < (size_t)length * sizeof(float); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+SampleStream *openSpectralCache(uint64_t contentHash, int fftSize, int hop, int frameCount, int bins) {
+	char path[256];
+	spectralCachePath(path, sizeof(path), contentHash, fftSize, hop);
+	size_t size = spectralCacheSize(frameCount, bins);
+	struct stat st;
+	if(stat(path, &st) != 0 || (size_t)st.st_size != size) {
+		return NULL;
+	}
+	// pinned whole, voices jump around in it and a page fault on the audio thread is a dropout
+	SampleStream *cache = mapSampleStream(path, size, size);
+	if(!cache) {
+		return NULL;
+	}
+	const SpectralCacheHeader *header = (const SpectralCacheHeader *)cache->mapping;
+	bool valid = memcmp(header->magic, SPECTRAL_CACHE_MAGIC, 4) == 0 && header->version == SPECTRAL_CACHE_VERSION;
+	valid = valid && header->contentHash == contentHash && header->fftSize == fftSize && header->hop == hop;
+	valid = valid && header->frameCount == frameCount && header->bins == bins;
+	if(!valid) {
+		printf("WARNING: ignoring invalid spectral cache %s\n", path);
+		freeSampleStream(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+const float *getSpectralCacheMagnitude(const SampleStream *cache) {
+	return (const float *)((const char *)cache->mapping + sizeof(SpectralCacheHeader));
+}
+
+const float *getSpectralCachePhase(const SampleStream *cache) {
+	const SpectralCacheHeader *header = (const SpectralCacheHeader *)cache->mapping;
+	return getSpectralCacheMagnitude(cache) + (size_t)header->frameCount * header->bins;
+}
+
+bool writeSpectralCache(uint64_t contentHash, int fftSize, int hop, int frameCount, int bins, const float *magnitude, const float *phase) {
+	char path[256];
+	char tmpPath[260];
+	spectralCachePath(path, sizeof(path), contentHash, fftSize, hop);
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+	SpectralCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SPECTRAL_CACHE_MAGIC, 4);
+	header.version = SPECTRAL_CACHE_VERSION;
+	header.contentHash = contentHash;
+	header.fftSize = fftSize;
+	header.hop = hop;
+	header.frameCount = frameCount;
+	header.bins = bins;
+
+	// written next to the final name and renamed over it, same as the sample cache
+	makeSampleCacheDirectory();
+	FILE *file = fopen(tmpPath, "wb");
+	bool ok = file != NULL;
+	if(ok) {
+		size_t count = (size_t)frameCount * bins;
+		ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(magnitude, sizeof(float), count, file) == count;
+		ok = ok && fwrite(phase, sizeof(float), count, file) == count;
+		ok = fclose(file) == 0 && ok;
+	}
+	if(ok) {
+		remove(path);
+		ok = rename(tmpPath, path) == 0;
+	}
+	if(!ok) {
+		printf("Failed to write spectral cache %s\n", path);
+		remove(tmpPath);
+	}
+	return ok;
+}
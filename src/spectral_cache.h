@@ -0,0 +1,40 @@
+#ifndef SPECTRAL_CACHE_H
+#define SPECTRAL_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sample_stream.h"
+#include "settings.h"
+
+#define SPECTRAL_CACHE_MAGIC "SPXF"
+#define SPECTRAL_CACHE_VERSION 1
+
+/**
+ * One file per analysed sample, named after everything that decides its contents. The header is followed by the
+ * magnitude rows, then the phase rows, so a mapping of the file can be read in place.
+ */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t contentHash;
+	int32_t fftSize;
+	int32_t hop;
+	int32_t frameCount;
+	int32_t bins;
+} SpectralCacheHeader;
+
+/**
+ * @brief FNV-1a over the analysed frames themselves, so a sample only hits the cache while its audio is unchanged.
+ */
+uint64_t hashSpectralContent(const float *data, int length);
+/**
+ * @brief Maps and pins the cached analysis for this key.
+ * @return NULL if there is none or it does not match.
+ */
+SampleStream *openSpectralCache(uint64_t contentHash, int fftSize, int hop, int frameCount, int bins);
+const float *getSpectralCacheMagnitude(const SampleStream *cache);
+const float *getSpectralCachePhase(const SampleStream *cache);
+bool writeSpectralCache(uint64_t contentHash, int fftSize, int hop, int frameCount, int bins, const float *magnitude, const float *phase);
+
+#endif
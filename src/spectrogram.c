@@ -3,7 +3,8 @@
 #include <math.h>
 
 void initSpectro(Spectro *sp, int fftSize, int framesPerBuffer, int toAverage, float imageScale) {
-	initFFT(&sp->fft, fftSize, framesPerBuffer, toAverage);
+	initFFT(&sp->fft, fftSize, framesPerBuffer, toAverage, true, false, FFT_THREAD_AUDIO);
+	sp->prevRowCount = 0;
 	sp->enabled = true;
 	sp->imageWriteIndex = 0;
 	sp->imageScale = imageScale;
@@ -15,12 +16,18 @@ void initSpectro(Spectro *sp, int fftSize, int framesPerBuffer, int toAverage, f
 }
 
 void updateSpectroImageData(Spectro *sp) {
-	if(sp->fft.prevRowCount < sp->fft.rowCount) { // there's new data to write
+	// every row below the acquired count is complete, the oldest are overwritten once maxRows more have come in
+	unsigned int rowCount = atomic_load_explicit(&sp->fft.rowCount, memory_order_acquire);
+	if(sp->prevRowCount != rowCount) { // there's new data to write
+		if(rowCount - sp->prevRowCount > (unsigned int)sp->fft.maxRows / 2) {
+			sp->prevRowCount = rowCount - sp->fft.maxRows / 2;
+		}
 		Color *col = (Color *)sp->specImage.data;
-		for(int r = sp->fft.prevRowCount; r < sp->fft.rowCount; r++) {
+		for(unsigned int r = sp->prevRowCount; r != rowCount; r++) {
+			const float *vals = sp->fft.vals + (r % sp->fft.maxRows) * sp->fft.freqCount;
 			for(int c = 0; c < sp->fft.freqCount; c++) {
 				const double pi = 3.14159265358979;
-				float tmpCol = sp->fft.vals[r * sp->fft.freqCount + c] * pi;
+				float tmpCol = vals[c] * pi;
 				col[sp->imageWriteIndex + sp->imageWidth * c] = (Color){
 					(int)(200.0f * fabs(sin(5.0f / 2.0f * tmpCol))),
 					//(int)(200.0f * sin(tmpCol)),
@@ -34,7 +41,7 @@ void updateSpectroImageData(Spectro *sp) {
 				sp->imageWriteIndex -= sp->imageWidth;
 			}
 		}
-		sp->fft.prevRowCount = sp->fft.rowCount;
+		sp->prevRowCount = rowCount;
 		UnloadTexture(sp->specTexture);
 		sp->specTexture = LoadTextureFromImage(sp->specImage);
 	}
@@ -44,6 +51,6 @@ void drawSpectro(Spectro *sp) {
 	DrawTexturePro(sp->specTexture, (Rectangle){ 0, 0, sp->imageWidth, sp->imageHeight }, sp->textureDestination, (Vector2){ 0, 0 }, 0.0f, WHITE);
 	DrawLine(sp->textureDestination.x + 1 + sp->imageWriteIndex * 4, sp->textureDestination.y, sp->textureDestination.x + 1 + sp->imageWriteIndex * 4, sp->textureDestination.y + sp->imageHeight, RED);
 	char debugData[255];
-	sprintf(debugData, "Window: %s, writeIndex: %i, rowcount: %i", sp->fft.windowFuncName, sp->imageWriteIndex, sp->fft.rowCount);
+	sprintf(debugData, "Window: %s, writeIndex: %i, rowcount: %u", sp->fft.windowFuncName, sp->imageWriteIndex, atomic_load_explicit(&sp->fft.rowCount, memory_order_relaxed));
 	DrawText(debugData, 14, SCREEN_H - 14, 12, WHITE);
 }
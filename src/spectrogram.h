@@ -19,6 +19,7 @@ typedef struct {
 	Rectangle textureDestination;
 	Texture specTexture;
 	Fft fft;
+	unsigned int prevRowCount; // rows of fft already drawn
 } Spectro;
 
 void initSpectro(Spectro *sp, int fftSize, int framesPerBuffer, int toAverage, float imageScale);
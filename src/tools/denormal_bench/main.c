@@ -0,0 +1,110 @@
+// Times the decaying tail of each filter after a single impulse, with and without flush-to-zero.
+// Once the feedback states drift into the subnormal range every multiply takes the slow path on most CPUs,
+// which is the CPU spike we see when notes ring out.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "filters.h"
+#include "denormal.h"
+
+#define BENCH_VOICES 4
+#define BENCH_BLOCKS 4000
+#define BENCH_WARMUP_BLOCKS 8 // skip the audible part of the decay, time only the tail
+
+typedef enum {
+	BENCH_BIQUAD,
+	BENCH_SVF,
+	BENCH_WDF,
+	BENCH_COUNT
+} BenchFilter;
+
+static const char *benchNames[BENCH_COUNT] = { "biquad lanes", "svf lanes", "wdf clipper" };
+static const FilterType benchTypes[BENCH_COUNT] = { secondOrderLPF, svfLPF, wdfDiodeClipper };
+
+static double nowSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double runTail(BenchFilter bench, int *subnormalBlocks) {
+	static float left[BENCH_VOICES][PA_BUFFER_SIZE];
+	static float right[BENCH_VOICES][PA_BUFFER_SIZE];
+	static float cutoff[BENCH_VOICES][PA_BUFFER_SIZE];
+	Filter *filters[BENCH_VOICES];
+	float *l[BENCH_VOICES];
+	float *r[BENCH_VOICES];
+	float *c[BENCH_VOICES];
+	double elapsed = 0.0;
+
+	for(int v = 0; v < BENCH_VOICES; v++) {
+		filters[v] = createFilter(kTransposeCanonical, secondOrderLPF, 1000.0f, 4.0f);
+		setFilterParameters(filters[v], benchTypes[bench], 1000.0f + v * 250.0f, 4.0f);
+		l[v] = left[v];
+		r[v] = right[v];
+		c[v] = cutoff[v];
+		for(int i = 0; i < PA_BUFFER_SIZE; i++) {
+			cutoff[v][i] = filters[v]->freq;
+		}
+	}
+
+	*subnormalBlocks = 0;
+	for(int b = 0; b < BENCH_BLOCKS; b++) {
+		for(int v = 0; v < BENCH_VOICES; v++) {
+			memset(left[v], 0, sizeof(left[v]));
+			memset(right[v], 0, sizeof(right[v]));
+			if(b == 0) {
+				left[v][0] = 1.0f;
+				right[v][0] = 1.0f;
+			}
+		}
+
+		double start = nowSeconds();
+		switch(bench) {
+			case BENCH_SVF:
+				processSvfLanes(filters, l, r, c, BENCH_VOICES, PA_BUFFER_SIZE);
+				break;
+			case BENCH_WDF:
+				processWdfLanes(filters, l, r, BENCH_VOICES, PA_BUFFER_SIZE);
+				break;
+			case BENCH_BIQUAD:
+			default:
+				processFilterLanes(filters, l, r, BENCH_VOICES, PA_BUFFER_SIZE);
+				break;
+		}
+		if(b >= BENCH_WARMUP_BLOCKS) {
+			elapsed += nowSeconds() - start;
+		}
+
+		float last = left[0][PA_BUFFER_SIZE - 1];
+		if(last != 0.0f && fabsf(last) < 1.175494351e-38f) {
+			(*subnormalBlocks)++;
+		}
+	}
+
+	for(int v = 0; v < BENCH_VOICES; v++) {
+		free(filters[v]->biquad);
+		free(filters[v]);
+	}
+	return elapsed;
+}
+
+int main(void) {
+	double samples = (double)(BENCH_BLOCKS - BENCH_WARMUP_BLOCKS) * PA_BUFFER_SIZE * BENCH_VOICES;
+	printf("%i voices, %i blocks of %i frames per run\n\n", BENCH_VOICES, BENCH_BLOCKS, PA_BUFFER_SIZE);
+	printf("%-14s %-6s %12s %14s\n", "filter", "ftz", "ns/sample", "subnormal blks");
+	for(int bench = 0; bench < BENCH_COUNT; bench++) {
+		for(int ftz = 0; ftz < 2; ftz++) {
+			if(!setFlushDenormals(ftz) && ftz) {
+				printf("flush-to-zero not supported on this target\n");
+				return 1;
+			}
+			int subnormalBlocks = 0;
+			double elapsed = runTail(bench, &subnormalBlocks);
+			printf("%-14s %-6s %12.2f %14i\n", benchNames[bench], ftz ? "on" : "off", elapsed * 1e9 / samples, subnormalBlocks);
+		}
+	}
+	setFlushDenormals(false);
+	return 0;
+}
@@ -270,7 +270,7 @@ int main(void) {
 	gui_setup();
 
 	SamplePool *sp = createSamplePool();
-	loadSamplesfromDirectory("./", sp);
+	loadSamplesfromDirectory("./", sp, NULL, NULL, NULL);
 	if(sp->sampleCount <= 0) {
 		printf("NO WAVS!\n");
 		return -1;
@@ -119,21 +119,27 @@ void i_remove_gui_element_from_list(GuiElementList *l, unsigned int index) {
 }
 
 void push_frame_to_history(float frame, DrawBufferCollection *dbc, int buffer_id) {
-	dbc->buffer[buffer_id * SA_HIST_LEN + dbc->buffer_write_indx[buffer_id]] = frame;
-	dbc->buffer_write_indx[buffer_id]++;
-	if(dbc->buffer_write_indx[buffer_id] >= SA_HIST_LEN) {
-		dbc->buffer_write_indx[buffer_id] -= SA_HIST_LEN;
+	unsigned int indx = atomic_load_explicit(&dbc->buffer_write_indx[buffer_id], memory_order_relaxed);
+	dbc->buffer[buffer_id * SA_HIST_LEN + indx] = frame;
+	indx++;
+	if(indx >= SA_HIST_LEN) {
+		indx -= SA_HIST_LEN;
 	}
+	atomic_store_explicit(&dbc->buffer_write_indx[buffer_id], indx, memory_order_release);
 }
 
 void draw_buffer(DrawBufferCollection *dbc, int buffer_id, Rectangle bounds, Color c) {
 	DrawRectangleLinesEx(bounds, 1, c);
 	float x_scale = bounds.width / SA_HIST_LEN;
 	float y_scale = bounds.height / 2.0;
+	const float *buffer = &dbc->buffer[buffer_id * SA_HIST_LEN];
+	unsigned int oldest = atomic_load_explicit(&dbc->buffer_write_indx[buffer_id], memory_order_acquire);
 	for(int i = 0; i < SA_HIST_LEN - 1; i++) {
+		float a = buffer[(oldest + i) % SA_HIST_LEN];
+		float b = buffer[(oldest + i + 1) % SA_HIST_LEN];
 		DrawLineEx(
-		  (Vector2){ bounds.x + x_scale * i, bounds.y + y_scale + (dbc->buffer[buffer_id * SA_HIST_LEN + i] * y_scale) },
-		  (Vector2){ bounds.x + x_scale * (i + 1), bounds.y + y_scale + (dbc->buffer[buffer_id * SA_HIST_LEN + i + 1] * y_scale) },
+		  (Vector2){ bounds.x + x_scale * i, bounds.y + y_scale + (a * y_scale) },
+		  (Vector2){ bounds.x + x_scale * (i + 1), bounds.y + y_scale + (b * y_scale) },
 		  1,
 		  c);
 	}
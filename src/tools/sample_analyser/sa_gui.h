@@ -3,6 +3,7 @@
 
 #include "raylib.h"
 #include "sa_audio.h"
+#include <stdatomic.h>
 #include <stdint.h>
 
 #define SA_MAX_GUI_ELEMENTS 1024
@@ -14,8 +15,10 @@ typedef void (*ClickCB)(void *self, Vector2 mouse_xy);
 typedef void (*DrawCB)(void *self);
 
 typedef struct DrawBufferCollection DrawBufferCollection;
+// buffer 0 is written by the audio callback. A frame is stored before its write index is released, and draw_buffer
+// acquires the index and draws oldest to newest from it
 struct DrawBufferCollection {
-	unsigned int buffer_write_indx[SA_HIST_C];
+	atomic_uint buffer_write_indx[SA_HIST_C];
 	float buffer[SA_HIST_LEN * SA_HIST_C];
 };
 
@@ -1,7 +1,4 @@
 #include "voice.h"
-#include "fft.h"
-#include "kiss_fft.h"
-#include "kiss_fftr.h"
 #include "notes.h"
 #include "blit_synth.h"
 #include "modsystem.h"
@@ -47,7 +44,7 @@ void freeVoiceManager(VoiceManager *vm) {
 	free(vm);
 }
 
-void freeVoice(Voice *v) { // TO-DO: free grain
+void freeVoice(Voice *v) {
 	freeModList(v->modList);
 	freeParamList(v->paramList);
 	freeParameter(v->volume);
@@ -63,8 +60,8 @@ void freeVoice(Voice *v) { // TO-DO: free grain
 				freeOperator(v->vd.fm.operators[i]);
 			}
 			break;
-		case VOICE_TYPE_SAMPLE:
-			freeSample(v->vd.sampler.sample);
+		case VOICE_TYPE_SPECTRAL:
+			freePhaseVocoder(v->vd.spectral.pv);
 			break;
 		case VOICE_TYPE_BLEP:
 		default:
@@ -83,11 +80,10 @@ OutVal generateFM(Voice *currentVoice, float phaseIncrement, float frequency) {
 
 OutVal generateSample(Voice *currentVoice, float phaseIncrement, float frequency) {
 	OutVal out;
-	int sampleIndex = getParameterValueAsInt(currentVoice->instrumentRef->id.sampler.sampleIndex);
-	bool loop = getParameterValueAsInt(currentVoice->instrumentRef->id.sampler.loopSample);
-	out.L = getSampleValueFwd(currentVoice->vd.sampler.samplePool->samples[sampleIndex], &currentVoice->vd.sampler.samplePosition, phaseIncrement, loop);
-	out.L *= 0.5;
-	out.R = out.L;
+	SamplerVoiceData *sv = &currentVoice->vd.sampler;
+	out.L = sv->blockL[sv->blockIndex] * 0.5f;
+	out.R = sv->blockR[sv->blockIndex] * 0.5f;
+	sv->blockIndex++;
 	return out;
 }
 
@@ -114,23 +110,19 @@ OutVal generateBlep(Voice *currentVoice, float phaseIncrement, float frequency)
 
 OutVal generateSpectral(Voice *currentVoice, float phaseIncrement, float frequency) {
 	OutVal out;
-	currentVoice->vd.spectral.samplePosition += phaseIncrement;
-	int spFloor = (int)currentVoice->vd.spectral.samplePosition;
-	int spCeil = spFloor + 1;
-	spCeil = spCeil > currentVoice->vd.spectral.spectralDataSize ? spFloor : spCeil;
-	float frac = currentVoice->vd.spectral.samplePosition - spFloor;
-	out.L = currentVoice->vd.spectral.spectralData[spFloor];
-	out.L *= 0.5;
+	SpectralVoiceData *sv = &currentVoice->vd.spectral;
+	out.L = sv->block[sv->blockIndex] * 0.5f;
 	out.R = out.L;
+	sv->blockIndex++;
 	return out;
 }
 
 OutVal generateGranular(Voice *currentVoice, float phaseIncrement, float frequency) {
 	OutVal out;
-	printf("ERROR: stub generate func.\n\n");
-	out.L = 0;
-	out.L *= 0.5;
+	GranularVoiceData *gv = &currentVoice->vd.granular;
+	out.L = gv->block[gv->blockIndex] * 0.5f;
 	out.R = out.L;
+	gv->blockIndex++;
 	return out;
 }
 
@@ -151,12 +143,198 @@ OutVal generateVoice(VoiceManager *vm, Voice *currentVoice, float phaseIncrement
 	out = currentVoice->generate(currentVoice, phaseIncrement, frequency);
 
 	float pan = getParameterValue(currentVoice->instrumentRef->panning);
-	// out.L = currentVoice->filter->biquad->processSample(currentVoice->filter->biquad, out.L);
 	out.R *= pan;
 	out.L *= 1.0 - pan;
 	return out;
 }
 
+static void renderSamplerBlock(Voice *voice, int subCount, int factor) {
+	SamplerVoiceData *sv = &voice->vd.sampler;
+	SamplerInstrumentData *id = &voice->instrumentRef->id.sampler;
+	SamplePlayback pb;
+	pb.type = (SamplePlaybackType)getParameterValueAsInt(id->playbackType);
+	pb.loop = getParameterValueAsInt(id->loopSample);
+	pb.loopStart = getParameterValueAsInt(id->loopStartIndex);
+	pb.loopEnd = getParameterValueAsInt(id->loopEndIndex) + 1; // the parameter holds the last looped frame
+	renderSampleBlock(sv->sample, &sv->playhead, &pb, sv->step / factor, &sv->kernel, sv->blockL, sv->blockR, subCount);
+	sv->blockIndex = 0;
+	// crushed at the oversampled rate, so the decimator takes the edge off the hold images like it does for everything else
+	float rate = getParameterValue(id->sampleRate);
+	float crushRate = rate < SAMPLE_RATE ? rate / ((float)SAMPLE_RATE * factor) : 1.0f;
+	processBitcrusher(&sv->crusher, sv->blockL, sv->blockR, subCount, getParameterValue(id->bitDepth), crushRate, getParameterValueAsInt(id->dither));
+}
+
+// the grain parameters are read once per block, modulation reaches them through the voice copies a block late
+static void renderGranularBlock(Voice *voice, int subCount, int factor) {
+	GranularVoiceData *gv = &voice->vd.granular;
+	GranularInstrumentData *id = &voice->instrumentRef->id.granular;
+	setParameterBaseValue(gv->density, getParameterValue(id->density));
+	setParameterBaseValue(gv->grainMs, getParameterValue(id->grainMs));
+	setParameterBaseValue(gv->position, getParameterValue(id->position));
+	setParameterBaseValue(gv->pitch, getParameterValue(id->pitch));
+	setParameterBaseValue(gv->spray, getParameterValue(id->spray));
+	GrainSettings gs;
+	float ratio = gv->ratio * powf(2.0f, getParameterValue(gv->pitch) / 12.0f);
+	setGrainSettings(&gs, id->source, getParameterValue(gv->density), getParameterValue(gv->grainMs), getParameterValue(gv->position), getParameterValue(gv->spray), ratio, (float)SAMPLE_RATE * factor);
+	renderGrainCloud(&gv->cloud, id->source, &gs, gv->block, subCount);
+	gv->blockIndex = 0;
+}
+
+// speed only moves the read position and the note only moves the pitch, so either can change without the other
+static void renderSpectralBlock(Voice *voice, int subCount, int factor) {
+	SpectralVoiceData *sv = &voice->vd.spectral;
+	SpectralInstrumentData *id = &voice->instrumentRef->id.spectral;
+	float rate = (float)SAMPLE_RATE * factor;
+	float sourceRate = id->source ? id->source->sampleRate : SAMPLE_RATE;
+	double step = getParameterValue(id->speed) * sourceRate / rate;
+	float shift = sv->ratio * powf(2.0f, getParameterValue(id->pitch) / 12.0f) * sourceRate / rate;
+	renderPhaseVocoder(sv->pv, id->source, step, shift, sv->block, subCount);
+	sv->blockIndex = 0;
+}
+
+void renderVoiceBlock(VoiceManager *vm, Voice *voice, float *outL, float *outR, int frameCount, bool running) {
+	Oversampler *os = &voice->oversampler;
+	setOversamplingMode(os, getParameterValueAsInt(voice->instrumentRef->oversampling));
+	int factor = os->factor;
+	float subL[OS_MAX_FACTOR];
+	float subR[OS_MAX_FACTOR];
+	float baseCutoff = getParameterValue(voice->instrumentRef->filterCutoff);
+	if(voice->type == VOICE_TYPE_SAMPLE) {
+		renderSamplerBlock(voice, frameCount * factor, factor);
+	} else if(voice->type == VOICE_TYPE_GRAIN) {
+		renderGranularBlock(voice, frameCount * factor, factor);
+	} else if(voice->type == VOICE_TYPE_SPECTRAL) {
+		renderSpectralBlock(voice, frameCount * factor, factor);
+	}
+
+	for(int i = 0; i < frameCount; i++) {
+		setParameterBaseValue(voice->filterCutoff, baseCutoff);
+		// modulators are stepped at the base rate, the envelope dt is fixed to 1 / PA_SR
+		processModulations(voice->paramList, voice->modList, 1.0f / SAMPLE_RATE);
+		voice->cutoffBuffer[i] = getParameterValue(voice->filterCutoff);
+		bool finished = false;
+		if(!voice->envelope[0]->isTriggered) {
+			setParameterValue(voice->volume, 1.0f);
+			setParameterBaseValue(voice->volume, 1.0f);
+			voice->active = 0;
+			finished = true;
+		}
+
+		float phaseIncrement = 0.0f;
+		float freq = 0.0f;
+		if(voice->note[0] != OFF) {
+			freq = noteFrequencies[voice->note[0]][voice->note[1]];
+			setParameterBaseValue(voice->frequency, freq);
+			setParameterValue(voice->frequency, freq);
+			phaseIncrement = freq / SAMPLE_RATE;
+		}
+
+		// generators derive their per-call step from phaseIncrement / frequency, so scaling both runs them at the higher rate
+		float subIncrement = phaseIncrement / factor;
+		float subFreq = freq / factor;
+		for(int s = 0; s < factor; s++) {
+			OutVal sub = generateVoice(vm, voice, subIncrement, subFreq);
+			subL[s] = sub.L;
+			subR[s] = sub.R;
+			if(running) {
+				voice->leftPhase = fmodf(voice->leftPhase + subIncrement, 1.0f);
+				voice->rightPhase = fmodf(voice->rightPhase + subIncrement, 1.0f);
+			}
+		}
+		decimateFrame(os, subL, subR, &outL[i], &outR[i]);
+
+		float volume = getParameterValue(voice->volume);
+		outL[i] *= volume;
+		outR[i] *= volume;
+		if(running) {
+			voice->samplesElapsed++;
+		}
+
+		if(finished) {
+			resetOversampler(os);
+			for(int j = i + 1; j < frameCount; j++) {
+				outL[j] = 0.0f;
+				outR[j] = 0.0f;
+				voice->cutoffBuffer[j] = voice->cutoffBuffer[i];
+			}
+			break;
+		}
+	}
+
+	if(voice->type == VOICE_TYPE_SAMPLE && voice->vd.sampler.streamCursor >= 0) {
+		SamplePool *sp = voice->vd.sampler.samplePool;
+		Sample *sample = voice->vd.sampler.sample;
+		// streamed samples are always stored as float
+		const float *streamed = voice->active && sample && sample->stream ? (const float *)sample->data : NULL;
+		// the prefetcher works in floats, stereo frames take two
+		int channels = sample ? sample->channels : 1;
+		setStreamCursor(sp->streamer, voice->vd.sampler.streamCursor, streamed, sample ? sample->length * channels : 0, (int)voice->vd.sampler.playhead.position * channels);
+	}
+}
+
+static void flushFilterLanes(FilterType type, Filter **filters, float **left, float **right, float **cutoff, int laneCount, int frameCount) {
+	if(isSvfFilterType(type)) {
+		processSvfLanes(filters, left, right, cutoff, laneCount, frameCount);
+	} else if(type == wdfDiodeClipper) {
+		processWdfLanes(filters, left, right, laneCount, frameCount);
+	} else {
+		processFilterLanes(filters, left, right, laneCount, frameCount);
+	}
+}
+
+void renderChannelBlock(VoiceManager *vm, int channel, float *outL, float *outR, int frameCount, bool running) {
+	Instrument *inst = vm->instruments[channel];
+	int filterSelection = getParameterValueAsInt(inst->filterType);
+	float resonance = getParameterValue(inst->filterResonance);
+	int rendered[MAX_VOICES_PER_CHANNEL];
+	int renderedCount = 0;
+	Filter *laneFilters[BIQUAD_LANES];
+	float *laneL[BIQUAD_LANES];
+	float *laneR[BIQUAD_LANES];
+	float *laneCutoff[BIQUAD_LANES];
+	int laneCount = 0;
+	FilterType filterType = (FilterType)(filterSelection - 1);
+
+	for(int v = 0; v < vm->voiceCount[channel]; v++) {
+		Voice *voice = vm->voicePools[channel][v];
+		if(!voice->active) {
+			continue;
+		}
+		renderVoiceBlock(vm, voice, vm->voiceBufferL[v], vm->voiceBufferR[v], frameCount, running);
+		rendered[renderedCount++] = v;
+
+		if(filterSelection <= 0 || !voice->filter) {
+			continue;
+		}
+		// the SVF follows the modulated cutoff every sample, the biquads pick it up once per block
+		smoothFilterParameters(voice->filter, filterType, voice->cutoffBuffer[frameCount - 1], resonance);
+		laneFilters[laneCount] = voice->filter;
+		laneL[laneCount] = vm->voiceBufferL[v];
+		laneR[laneCount] = vm->voiceBufferR[v];
+		laneCutoff[laneCount] = voice->cutoffBuffer;
+		laneCount++;
+		if(laneCount == BIQUAD_LANES) {
+			flushFilterLanes(filterType, laneFilters, laneL, laneR, laneCutoff, laneCount, frameCount);
+			laneCount = 0;
+		}
+	}
+	if(laneCount > 0) {
+		flushFilterLanes(filterType, laneFilters, laneL, laneR, laneCutoff, laneCount, frameCount);
+	}
+
+	if(!running) {
+		return;
+	}
+	for(int r = 0; r < renderedCount; r++) {
+		float *voiceL = vm->voiceBufferL[rendered[r]];
+		float *voiceR = vm->voiceBufferR[rendered[r]];
+		for(int i = 0; i < frameCount; i++) {
+			outL[i] += voiceL[i];
+			outR[i] += voiceR[i];
+		}
+	}
+}
+
 void initVoicePool(VoiceManager *vm, int channelIndex, int voiceCount, Instrument *inst) {
 	if(channelIndex >= MAX_SEQUENCER_CHANNELS || channelIndex < 0) {
 		printf("out of bounds!\n");
@@ -210,6 +388,20 @@ void incrementSampleParam(Parameter *sampleIndex, float delta) {
 	index += (int)delta;
 }
 
+// the playback ratio only changes with the note, so the step scale and kernel are worked out here rather than per sample
+static void prepareSamplerNote(Voice *voice) {
+	SamplerVoiceData *sv = &voice->vd.sampler;
+	Instrument *inst = voice->instrumentRef;
+	sv->sample = sv->samplePool->samples[getParameterValueAsInt(inst->id.sampler.sampleIndex)];
+	sv->step = 0.0;
+	if(voice->note[0] != OFF) {
+		sv->step = noteFrequencies[voice->note[0]][voice->note[1]] / SAMPLE_ROOT_FREQ * sv->sample->sampleRate / SAMPLE_RATE;
+	}
+	int factor = getOversamplingFactor(getParameterValueAsInt(inst->oversampling));
+	sv->kernel = getResampleKernel(getParameterValueAsInt(inst->id.sampler.interpolation), sv->step / factor);
+	startSamplePlayhead(&sv->playhead, sv->sample, getParameterValueAsInt(inst->id.sampler.playbackType));
+}
+
 void triggerVoice(Voice *voice, int note[NOTE_INFO_SIZE]) {
 	voice->note[0] = note[0];
 	voice->note[1] = note[1];
@@ -217,9 +409,25 @@ void triggerVoice(Voice *voice, int note[NOTE_INFO_SIZE]) {
 	voice->rightPhase = 0.0f;
 	voice->samplesElapsed = 0;
 	voice->active = 1;
+	if(voice->filter) {
+		resetFilter(voice->filter);
+	}
 	for(int e = 0; e < voice->envCount; e++) {
 		triggerEnvelope(voice->envelope[e]);
 	}
+	if(voice->type == VOICE_TYPE_SAMPLE) {
+		prepareSamplerNote(voice);
+	} else if(voice->type == VOICE_TYPE_GRAIN) {
+		GranularVoiceData *gv = &voice->vd.granular;
+		gv->ratio = voice->note[0] != OFF ? noteFrequencies[voice->note[0]][voice->note[1]] / SAMPLE_ROOT_FREQ : 0.0f;
+		resetGrainCloud(&gv->cloud);
+	} else if(voice->type == VOICE_TYPE_SPECTRAL) {
+		SpectralVoiceData *sv = &voice->vd.spectral;
+		SpectralSource *source = voice->instrumentRef->id.spectral.source;
+		sv->ratio = voice->note[0] != OFF ? noteFrequencies[voice->note[0]][voice->note[1]] / SAMPLE_ROOT_FREQ : 0.0f;
+		double length = source && source->sample ? source->sample->length : 0.0;
+		startPhaseVocoder(sv->pv, getParameterValue(voice->instrumentRef->id.spectral.position) * length);
+	}
 }
 
 void initialize_voice(Voice *voice, Instrument *inst) {
@@ -234,6 +442,7 @@ void initialize_voice(Voice *voice, Instrument *inst) {
 	voice->samplesElapsed = 0;
 	voice->active = 0;
 	voice->volume = createParameter(voice->paramList, "volume", 1.0f, 0.0f, 1.0f);
+	voice->filterCutoff = createParameter(voice->paramList, "cutoff", getParameterValue(inst->filterCutoff), FILTER_MIN_FREQ, FILTER_MAX_FREQ);
 	voice->type = inst->voiceType;
 	// printf("active: %i\n", voice->active);
 	voice->envCount = inst->envelopeCount;
@@ -261,8 +470,13 @@ void initialize_voice(Voice *voice, Instrument *inst) {
 
 		case VOICE_TYPE_SAMPLE:
 			voice->vd.sampler.sample = inst->id.sampler.sample;
-			voice->vd.sampler.samplePosition = 0.0f; // Initialize sample position
 			voice->vd.sampler.samplePool = inst->id.sampler.sp;
+			voice->vd.sampler.step = 0.0;
+			voice->vd.sampler.kernel = getResampleKernel(RESAMPLE_LINEAR, 1.0);
+			voice->vd.sampler.blockIndex = 0;
+			initBitcrusher(&voice->vd.sampler.crusher);
+			startSamplePlayhead(&voice->vd.sampler.playhead, voice->vd.sampler.sample, SPT_FORWARD);
+			voice->vd.sampler.streamCursor = acquireStreamCursor(inst->id.sampler.sp->streamer);
 			addModulation(voice->paramList, &voice->envelope[0]->base, voice->volume, 1.0f, MO_MUL);
 			voice->generate = generateSample;
 			break;
@@ -281,18 +495,30 @@ void initialize_voice(Voice *voice, Instrument *inst) {
 			voice->generate = generateFM;
 			break;
 		case VOICE_TYPE_GRAIN:
-			voice->vd.granular.granularProcessor = createGranularProcessor(inst->id.sampler.sample);
+			voice->vd.granular.density = createParameter(voice->paramList, "density", getParameterValue(inst->id.granular.density), 0.0f, GRAIN_MAX_DENSITY);
+			voice->vd.granular.grainMs = createParameter(voice->paramList, "grain ms", getParameterValue(inst->id.granular.grainMs), GRAIN_MIN_MS, GRAIN_MAX_MS);
+			voice->vd.granular.position = createParameter(voice->paramList, "position", getParameterValue(inst->id.granular.position), 0.0f, 1.0f);
+			voice->vd.granular.pitch = createParameter(voice->paramList, "pitch", getParameterValue(inst->id.granular.pitch), -GRAIN_MAX_PITCH, GRAIN_MAX_PITCH);
+			voice->vd.granular.spray = createParameter(voice->paramList, "spray", getParameterValue(inst->id.granular.spray), 0.0f, 1.0f);
+			voice->vd.granular.cloud.seed = (uint32_t)rand() | 1u; // voices of one instrument should not spray in step
+			resetGrainCloud(&voice->vd.granular.cloud);
+			voice->vd.granular.ratio = 1.0f;
+			voice->vd.granular.blockIndex = 0;
+			addModulation(voice->paramList, &voice->envelope[0]->base, voice->volume, 1.0f, MO_MUL);
 			voice->generate = generateGranular;
 			break;
 		case VOICE_TYPE_SPECTRAL:
-			voice->vd.spectral.sample = inst->id.sampler.sample;
-			voice->vd.spectral.samplePosition = 0.0f; // Initialize sample position
+			voice->vd.spectral.pv = createPhaseVocoder();
+			voice->vd.spectral.ratio = 1.0f;
+			voice->vd.spectral.blockIndex = 0;
 			addModulation(voice->paramList, &voice->envelope[0]->base, voice->volume, 1.0f, MO_MUL);
 			voice->generate = generateSpectral;
+			break;
 		default:
 			break;
 	}
-	voice->filter = createFilter(kTransposeCanonical, secondOrderLPF, 250.0f, 10.0f);
+	voice->filter = createFilter(kTransposeCanonical, secondOrderLPF, getParameterValue(inst->filterCutoff), getParameterValue(inst->filterResonance));
+	initOversampler(&voice->oversampler, getParameterValueAsInt(inst->oversampling));
 }
 
 void initDefaultFmPreset(Preset *p) {
@@ -457,14 +683,16 @@ void init_instrument(Instrument **instrument, VoiceType vt, SamplePool *samplePo
 			(*instrument)->lfoCount = 0;
 			(*instrument)->id.sampler.sp = samplePool;
 			(*instrument)->id.sampler.sample = samplePool->samples[0];
-			(*instrument)->id.sampler.getSampleValue = getSampleValueFwd;
-			(*instrument)->id.sampler.bitDepth = createParameterEx((*instrument)->paramList, "bitdepth", 24.0f, 8.0f, 24.0f, 1.0f, 4.0f);
-			(*instrument)->id.sampler.sampleRate = createParameterEx((*instrument)->paramList, "bitrate", 44100.0f, 2000.0f, 44100.0f, 100.0f, 1000.0f);
+			(*instrument)->id.sampler.bitDepth = createParameterEx((*instrument)->paramList, "bitdepth", BITCRUSH_MAX_BITS, 8.0f, BITCRUSH_MAX_BITS, 1.0f, 4.0f);
+			(*instrument)->id.sampler.sampleRate = createParameterEx((*instrument)->paramList, "bitrate", SAMPLE_RATE, 2000.0f, SAMPLE_RATE, 100.0f, 1000.0f);
+			(*instrument)->id.sampler.dither = createParameterEx((*instrument)->paramList, "dither", 0, 0, 1.0f, 1.0f, 1.0f);
 			(*instrument)->id.sampler.sampleIndex = createParameterPro((*instrument)->paramList, "sample", 0, 0, (float)samplePool->sampleCount - 1, 1.0f, 10.0f, *instrument, updateSampleReferences);
 			(*instrument)->id.sampler.loopSample = createParameterEx((*instrument)->paramList, "loop", 0, 0, 1.0, 1.0f, 1.0f);
-			(*instrument)->id.sampler.playbackType = createParameterPro((*instrument)->paramList, "playback", 0, 0, (float)SPT_COUNT, 1.0f, 10.0f, *instrument, setSamplePlaybackFunction);
+			(*instrument)->id.sampler.playbackType = createParameterEx((*instrument)->paramList, "playback", SPT_FORWARD, SPT_FORWARD, (float)SPT_COUNT - 1, 1.0f, 1.0f);
 			(*instrument)->id.sampler.loopStartIndex = createParameterEx((*instrument)->paramList, "loop start", 0, 0, (float)samplePool->samples[0]->length, 100.0f, 1000.0f);
 			(*instrument)->id.sampler.loopEndIndex = createParameterEx((*instrument)->paramList, "loop end", (float)samplePool->samples[0]->length - 1.0f, 1.0f, (float)samplePool->samples[0]->length, 100.0f, 1000.0f);
+			(*instrument)->id.sampler.interpolation = createParameterEx((*instrument)->paramList, "interp", RESAMPLE_SINC8, RESAMPLE_LINEAR, (float)RESAMPLE_MODE_COUNT - 1, 1.0f, 1.0f);
+			initResampler();
 			break;
 		case VOICE_TYPE_FM:
 			(*instrument)->envelopeCount = 4;
@@ -479,34 +707,31 @@ void init_instrument(Instrument **instrument, VoiceType vt, SamplePool *samplePo
 			break;
 		case VOICE_TYPE_GRAIN:
 			(*instrument)->id.granular.sample = samplePool->samples[2];
+			(*instrument)->id.granular.source = createGranularSource((*instrument)->id.granular.sample);
+			(*instrument)->id.granular.density = createParameterEx((*instrument)->paramList, "density", 20.0f, 1.0f, GRAIN_MAX_DENSITY, 1.0f, 10.0f);
+			(*instrument)->id.granular.grainMs = createParameterEx((*instrument)->paramList, "grain ms", 80.0f, GRAIN_MIN_MS, GRAIN_MAX_MS, 1.0f, 10.0f);
+			(*instrument)->id.granular.position = createParameterEx((*instrument)->paramList, "position", 0.25f, 0.0f, 1.0f, 0.01f, 0.1f);
+			(*instrument)->id.granular.pitch = createParameterEx((*instrument)->paramList, "pitch", 0.0f, -GRAIN_MAX_PITCH, GRAIN_MAX_PITCH, 1.0f, 12.0f);
+			(*instrument)->id.granular.spray = createParameterEx((*instrument)->paramList, "spray", 0.05f, 0.0f, 1.0f, 0.01f, 0.1f);
+			initGranular();
 			(*instrument)->envelopeCount = 1;
 			break;
 		case VOICE_TYPE_SPECTRAL:
 			(*instrument)->envelopeCount = 1;
 			(*instrument)->lfoCount = 0;
 			(*instrument)->id.spectral.sample = samplePool->samples[1];
-			(*instrument)->id.spectral.playbackSpeed = createParameterEx((*instrument)->paramList, "playbackSpeed", 0.5f, 0.0f, 1.0f, 0.01f, 0.1f);
-			Fft fft;
-			int fftSize = 2048;
-			initFFT(&fft, fftSize, 256, 5, false, true);
-			float sampleFreq = 261.625;
-			float phaseInc = sampleFreq / SAMPLE_RATE;
-			for(int i = 0; i < samplePool->samples[0]->length; i++) {
-				float spos = (float)i;
-				float s = getSampleValueFwd(samplePool->samples[1], &spos, phaseInc, 0);
-				s *= 0.5;
-				pushFrameToFFT(&fft, s);
-				processFFTData(&fft);
-			}
-			(*instrument)->id.spectral.spectralDataSize = fft.rowCount * fft.fftSize;
-			(*instrument)->id.spectral.spectralData = calloc(fft.rowCount * fft.fftSize / 4, sizeof(float));
-			kiss_fftr_cfg icfg = kiss_fftr_alloc(fftSize, 1, 0, 0);
-			for(int i = 0; i < fft.rowCount / 4; i++) {
-				kiss_fftri(icfg, &fft.cpxvals[i * fft.freqCount * 4], &(*instrument)->id.spectral.spectralData[i * fft.fftSize]);
-			}
+			(*instrument)->id.spectral.speed = createParameterEx((*instrument)->paramList, "speed", 1.0f, 0.0f, SPECTRAL_MAX_SPEED, 0.01f, 0.1f);
+			(*instrument)->id.spectral.pitch = createParameterEx((*instrument)->paramList, "pitch", 0.0f, -SPECTRAL_MAX_PITCH, SPECTRAL_MAX_PITCH, 1.0f, 12.0f);
+			(*instrument)->id.spectral.position = createParameterEx((*instrument)->paramList, "position", 0.0f, 0.0f, 1.0f, 0.01f, 0.1f);
+			initSpectral();
+			(*instrument)->id.spectral.source = createSpectralSource(samplePool, (*instrument)->id.spectral.sample);
 			break;
 	}
 	(*instrument)->panning = createParameterEx((*instrument)->paramList, "panning", 0.5f, 0.0f, 1.0f, 0.01f, 0.1f);
+	(*instrument)->oversampling = createParameterEx((*instrument)->paramList, "oversample", OS_OFF, OS_OFF, (float)OS_COUNT - 1, 1.0f, 1.0f);
+	(*instrument)->filterType = createParameterEx((*instrument)->paramList, "filter", 0.0f, 0.0f, (float)filter_count, 1.0f, 1.0f);
+	(*instrument)->filterCutoff = createParameterEx((*instrument)->paramList, "cutoff", 2000.0f, FILTER_MIN_FREQ, FILTER_MAX_FREQ, 10.0f, 500.0f);
+	(*instrument)->filterResonance = createParameterEx((*instrument)->paramList, "resonance", 0.707f, FILTER_MIN_Q, 10.0f, 0.05f, 0.5f);
 	(*instrument)->detuneVoiceCount = createParameterEx((*instrument)->paramList, "detuneVoices", 4.0f, 0.0f, MAX_DETUNE, 1.0f, 1.0f);
 	(*instrument)->detuneRange = createParameterEx((*instrument)->paramList, "detuneAmt", 10.0f, 1.0f, 100.0f, 1.00f, 10.0f);
 	(*instrument)->detuneSpread = createParameterEx((*instrument)->paramList, "detuneSpread", 10.0f, 0.0f, 50.0f, 1.0f, 5.0f);
@@ -516,6 +741,9 @@ void init_instrument(Instrument **instrument, VoiceType vt, SamplePool *samplePo
 	}
 
 	(*instrument)->voiceType = vt;
+	if(vt == VOICE_TYPE_SAMPLE) {
+		updateSampleReferences(*instrument);
+	}
 }
 
 void updateSampleReferences(void *instrument) {
@@ -532,103 +760,18 @@ void updateSampleReferences(void *instrument) {
 
 	int spidx = getParameterValueAsInt(i->id.sampler.sampleIndex);
 	i->id.sampler.sample = i->id.sampler.sp->samples[spidx];
-	setParameterBaseValue(i->id.sampler.loopStartIndex, 0);
-	setParameterValue(i->id.sampler.loopStartIndex, 0);
+	// a loop stored in the file's smpl chunk wins over the whole-sample default
+	SampleMarkers *markers = &i->id.sampler.sample->markers;
+	float loopStart = markers->loopEnd > 0 ? markers->loopStart : 0;
+	float loopEnd = markers->loopEnd > 0 ? markers->loopEnd - 1.0 : i->id.sampler.sample->length - 1.0;
 	setParameterMaxValue(i->id.sampler.loopStartIndex, i->id.sampler.sample->length);
 	setParameterMaxValue(i->id.sampler.loopEndIndex, i->id.sampler.sample->length);
-	setParameterBaseValue(i->id.sampler.loopEndIndex, i->id.sampler.sample->length - 1.0);
-	setParameterValue(i->id.sampler.loopEndIndex, i->id.sampler.sample->length - 1.0);
-}
-
-void setSamplePlaybackFunction(void *instrument) {
-	Instrument *i = (Instrument *)instrument;
-
-	if(!instrument) {
-		printf("ERROR: NULL instrument pointer.\n");
-		return;
-	}
-	if(i->voiceType != VOICE_TYPE_SAMPLE) {
-		printf("ERROR: voice type is not SAMPLE: %i\n", i->voiceType);
-		return;
-	}
-
-	int selectedPlaybackType = getParameterValueAsInt(i->id.sampler.playbackType);
-	switch(selectedPlaybackType) {
-		case SPT_REVERSE:
-		case SPT_REVERSE_PINGPONG:
-			i->id.sampler.getSampleValue = getSampleValueRev;
-			break;
-		default:
-		case SPT_FORWARD:
-		case SPT_FORWARD_PINGPONG:
-			i->id.sampler.getSampleValue = getSampleValueFwd;
-			break;
+	setParameterBaseValue(i->id.sampler.loopStartIndex, loopStart);
+	setParameterValue(i->id.sampler.loopStartIndex, loopStart);
+	setParameterBaseValue(i->id.sampler.loopEndIndex, loopEnd);
+	setParameterValue(i->id.sampler.loopEndIndex, loopEnd);
+	if(markers->loopEnd > 0) {
+		setParameterBaseValue(i->id.sampler.loopSample, 1.0f);
+		setParameterValue(i->id.sampler.loopSample, 1.0f);
 	}
 }
-
-GranularProcessor *createGranularProcessor(Sample *s) {
-	GranularProcessor *gp = (GranularProcessor *)malloc(sizeof(GranularProcessor));
-	if(!gp) return NULL;
-	gp->paramList = createParamList();
-	if(!gp->paramList) {
-		free(gp);
-		return NULL;
-	}
-	gp->modList = createModList();
-	if(!gp->modList) {
-		free(gp->paramList);
-		free(gp);
-		return NULL;
-	}
-	gp->grainVelocity = createParameter(gp->paramList, "gVel", 0.333f, 0.001f, 100.0f);
-	gp->volume = createParameter(gp->paramList, "gVol", 1.0f, 0.0f, 1.0f);
-	gp->writeHead = 0;
-	gp->mainEnv = createAD(gp->paramList, gp->modList, 0.05, 10.5, "gEnv");
-	gp->sample = s;
-	for(int i = 0; i < GRAIN_WINDOW_SIZE; i++) {
-		gp->grainWindow[i] = sin(((float)i / GRAIN_WINDOW_SIZE) * TWO_PI);
-		gp->windowIndex[i] = 0;
-	}
-	for(int i = 0; i < GRAIN_COUNT; i++) {
-		float startPos = rand() * GRANULAR_BUFFER_SIZE / 4.0;
-		gp->grainStartPos[i] = createParameter(gp->paramList, "gPos", rand() * GRANULAR_BUFFER_SIZE / 4.0, 0.0f, (float)GRANULAR_BUFFER_SIZE);
-		gp->grainReadPos[i] = startPos;
-	}
-
-	return gp;
-}
-
-OutVal granularProcess(GranularProcessor *gp, float phaseIncrement) {
-	OutVal result = { 0.0f, 0.0f };
-
-	for(int i = 0; i < GRAIN_COUNT; i++) {
-		float adjusted_phaseinc_sample = phaseIncrement * (SAMPLE_RATE / (float)gp->sample->sampleRate);
-		gp->grainReadPos[i] += adjusted_phaseinc_sample;
-		gp->windowIndex[i] += phaseIncrement;
-
-		if(gp->windowIndex[i] >= GRAIN_WINDOW_SIZE) {
-			gp->windowIndex[i] -= GRAIN_WINDOW_SIZE;
-		}
-
-		if(gp->grainReadPos[i] >= gp->sample->length) {
-			gp->grainReadPos[i] -= gp->sample->length;
-		}
-
-		int indexFloor = (int)gp->grainReadPos[i];
-		int sIndexCeil = (indexFloor + 1) % gp->sample->length; // Wrap around at the end
-		int wIndexFloor = gp->windowIndex[i];
-		int wIndexCeil = (wIndexFloor + 1) % GRAIN_WINDOW_SIZE; // Wrap around at the end
-		float frac = gp->grainReadPos[i] - indexFloor;
-
-		// Perform linear interpolation between indexFloor and indexCeil
-		float windowVal = gp->grainWindow[wIndexFloor] * (1.0f - frac) + gp->grainWindow[wIndexCeil] * frac;
-		float value = gp->sample->data[indexFloor] * (1.0f - frac) + gp->sample->data[sIndexCeil] * frac;
-
-		result.L += value * windowVal;
-	}
-
-	result.L /= GRAIN_COUNT; // Normalize by the number of grains
-	result.R = result.L;
-
-	return result;
-}
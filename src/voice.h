@@ -10,6 +10,10 @@
 #include "blit_synth.h"
 #include "filters.h"
 #include "fft.h"
+#include "oversampler.h"
+#include "distortion.h"
+#include "granular.h"
+#include "spectral.h"
 
 #define MAX_LFOS 8
 #define MAX_ENVELOPES 6
@@ -40,36 +44,17 @@ typedef struct {
 	float R;
 } OutVal;
 
-#define GRANULAR_BUFFER_SIZE 441000 // 10 seconds
-#define GRAIN_COUNT 16
-#define GRAIN_WINDOW_SIZE 1024
-
 typedef struct Voice Voice;
 typedef OutVal (*GenerateSample)(Voice *currentVoice, float phaseIncrement, float frequency);
 
-typedef struct {
-	ParamList *paramList;
-	ModList *modList;
-	float buffer[GRANULAR_BUFFER_SIZE];
-	float grainWindow[GRAIN_WINDOW_SIZE];
-	int windowIndex[GRAIN_WINDOW_SIZE];
-	int writeHead;
-	Parameter *grainStartPos[GRAIN_COUNT];
-	float grainReadPos[GRAIN_COUNT];
-	Parameter *grainVelocity;
-	Parameter *grainMs;
-	Parameter *volume;
-	Sample *sample;
-	Envelope *mainEnv;
-	Envelope *grainEnvs[GRAIN_COUNT];
-
-} GranularProcessor;
-
-GranularProcessor *createGranularProcessor(Sample *s);
-OutVal granularProcess(GranularProcessor *gp, float phaseIncrement);
-
 typedef struct {
 	Sample *sample;
+	GranularSource *source;
+	Parameter *density; // grains per second
+	Parameter *grainMs;
+	Parameter *position; // 0 to 1 across the source
+	Parameter *pitch;    // semitones on top of the note
+	Parameter *spray;    // random start spread, fraction of the source
 } GranularInstrumentData;
 
 typedef struct {
@@ -92,10 +77,10 @@ typedef struct {
 
 typedef struct {
 	Sample *sample;
-	Parameter *playbackSpeed;
-	SamplePool *sp;
-	float *spectralData;
-	int spectralDataSize;
+	SpectralSource *source;
+	Parameter *speed; // time stretch, independent of the pitch
+	Parameter *pitch;
+	Parameter *position;
 } SpectralInstrumentData;
 
 typedef struct {
@@ -111,14 +96,15 @@ typedef struct {
 typedef struct {
 	Sample *sample;
 	SamplePool *sp;
-	Parameter *bitDepth;
-	Parameter *sampleRate;
+	Parameter *bitDepth;   // crusher resolution, BITCRUSH_MAX_BITS is off
+	Parameter *sampleRate; // crusher rate in Hz, SAMPLE_RATE is off
+	Parameter *dither;
 	Parameter *loopSample;
 	Parameter *sampleIndex;
 	Parameter *playbackType;
 	Parameter *loopStartIndex;
 	Parameter *loopEndIndex;
-	GetSampleFunc getSampleValue;
+	Parameter *interpolation; // ResampleMode
 } SamplerInstrumentData;
 
 typedef struct {
@@ -150,6 +136,10 @@ typedef struct {
 	Parameter *detuneRange;
 	Parameter *detuneSpread;
 	Parameter *panning;
+	Parameter *oversampling;
+	Parameter *filterType; // 0 bypasses the voice filters, otherwise FilterType + 1
+	Parameter *filterCutoff;
+	Parameter *filterResonance;
 	PresetBank *presetBank;
 	Parameter *selectedPresetIndex;
 	union {
@@ -170,20 +160,37 @@ typedef struct {
 } FmVoiceData;
 
 typedef struct {
-	Sample *sample;
-	float *spectralData;
-	float samplePosition;
-	int spectralDataSize;
+	PhaseVocoder *pv;
+	float ratio; // note frequency over SAMPLE_ROOT_FREQ
+	float block[PA_BUFFER_SIZE * OS_MAX_FACTOR];
+	int blockIndex;
 } SpectralVoiceData;
 
 typedef struct {
 	Sample *sample;
-	float samplePosition; // Position in the sample data
+	SamplePlayhead playhead;
+	double step;           // sample frames per output frame, fixed for the note
+	ResampleKernel kernel; // chosen at note on from the playback ratio
 	SamplePool *samplePool;
+	int streamCursor; // prefetch slot in samplePool->streamer, -1 if none was free
+	// the whole block is rendered up front by renderSampleBlock, generateSample just hands out the sub-samples
+	float blockL[PA_BUFFER_SIZE * OS_MAX_FACTOR];
+	float blockR[PA_BUFFER_SIZE * OS_MAX_FACTOR];
+	int blockIndex;
+	Bitcrusher crusher;
 } SamplerVoiceData;
 
 typedef struct {
-	GranularProcessor *granularProcessor;
+	GrainCloud cloud;
+	float ratio; // note frequency over SAMPLE_ROOT_FREQ
+	// per voice copies of the instrument's grain parameters, so voice modulators can reach them
+	Parameter *density;
+	Parameter *grainMs;
+	Parameter *position;
+	Parameter *pitch;
+	Parameter *spray;
+	float block[PA_BUFFER_SIZE * OS_MAX_FACTOR]; // rendered up front like the sampler's
+	int blockIndex;
 } GranularVoiceData;
 
 struct Voice {
@@ -212,6 +219,9 @@ struct Voice {
 		GranularVoiceData granular;
 	} vd;
 	Filter *filter;
+	Parameter *filterCutoff;               // modulation destination, based on the instrument cutoff
+	float cutoffBuffer[PA_BUFFER_SIZE];    // modulated cutoff per frame of the current block
+	Oversampler oversampler;
 };
 
 typedef enum {
@@ -230,6 +240,9 @@ typedef struct {
 	WavetablePool *wavetablePool;
 	SamplePool *samplePool;
 	AllocationBehaviour voiceAllocation[MAX_SEQUENCER_CHANNELS];
+	// per-voice render targets for one channel block, reused channel to channel
+	float voiceBufferL[MAX_VOICES_PER_CHANNEL][PA_BUFFER_SIZE];
+	float voiceBufferR[MAX_VOICES_PER_CHANNEL][PA_BUFFER_SIZE];
 } VoiceManager;
 
 VoiceManager *createVoiceManager(Settings *settings, SamplePool *sp, WavetablePool *wtp, PresetBank *pb);
@@ -240,6 +253,17 @@ void freeVoiceManager(VoiceManager *vm);
 Voice *getFreeVoice(VoiceManager *vm, int seqChannel);
 void triggerVoice(Voice *voice, int note[NOTE_INFO_SIZE]);
 OutVal generateVoice(VoiceManager *vm, Voice *currentVoice, float phaseIncrement, float frequency);
+/**
+ * @brief Renders frameCount frames of an active voice at the base sample rate, running the generator at the
+ * instrument's oversampling factor and decimating back down. Volume is applied, the output is not mixed.
+ * @param running when false the voice is rendered but its phase and elapsed sample count are held (transport stopped).
+ */
+void renderVoiceBlock(VoiceManager *vm, Voice *voice, float *outL, float *outR, int frameCount, bool running);
+/**
+ * @brief Renders every active voice of a channel, runs their filters BIQUAD_LANES voices at a time and adds the
+ * result to outL/outR (only while running). frameCount must not exceed PA_BUFFER_SIZE.
+ */
+void renderChannelBlock(VoiceManager *vm, int channel, float *outL, float *outR, int frameCount, bool running);
 
 void initDefaultFmPreset(Preset *p);
 void applyInstrumentPreset(Instrument *instrument, Preset p);
@@ -251,6 +275,5 @@ void initialize_voice(Voice *voice, Instrument *inst);
 void initInstDefaults(Instrument *i);
 void init_instrument(Instrument **instrument, VoiceType vt, SamplePool *samplePool, PresetBank *pb);
 void initInstrumentFromPreset(Instrument **instrument, SamplePool *samplePool, Preset p);
-void setSamplePlaybackFunction(void *instrument);
 void updateSampleReferences(void *instrument);
 #endif // VOICE_H
@@ -0,0 +1,248 @@
+#include "wdf.h"
+
+#include <math.h>
+#include <stdio.h>
+
+void initWdfCircuit(WdfCircuit *c, float sampleRate) {
+	c->leafCount = 0;
+	c->adaptorCount = 0;
+	c->nodeCount = 0;
+	c->root = -1;
+	c->diodeIs = WDF_DIODE_IS;
+	c->diodeVt = WDF_DIODE_VT;
+	c->diodeLogTerm = 0.0f;
+	c->sampleRate = sampleRate;
+	for(int i = 0; i < WDF_MAX_NODES; i++) {
+		c->nodeToLeaf[i] = -1;
+		c->nodeToAdaptor[i] = -1;
+		c->resistance[i] = 1.0f;
+		c->up[i] = 0.0f;
+		c->down[i] = 0.0f;
+	}
+}
+
+static float leafResistance(WdfCircuit *c, WdfLeaf *leaf) {
+	switch(leaf->type) {
+		case WDF_CAPACITOR:
+			return 1.0f / (2.0f * c->sampleRate * leaf->value);
+		case WDF_INDUCTOR:
+			return 2.0f * c->sampleRate * leaf->value;
+		case WDF_RESISTOR:
+		case WDF_RESISTIVE_SOURCE:
+		default:
+			return leaf->value;
+	}
+}
+
+static void adaptResistances(WdfCircuit *c) {
+	for(int i = 0; i < c->adaptorCount; i++) {
+		WdfAdaptor *ad = &c->adaptors[i];
+		float ra = c->resistance[ad->childA];
+		float rb = c->resistance[ad->childB];
+		if(ad->type == WDF_SERIES) {
+			c->resistance[ad->port] = ra + rb;
+			ad->gamma = ra / (ra + rb);
+		} else {
+			c->resistance[ad->port] = (ra * rb) / (ra + rb);
+			ad->gamma = rb / (ra + rb);
+		}
+	}
+	if(c->root >= 0) {
+		c->diodeLogTerm = logf(c->resistance[c->root] * c->diodeIs / c->diodeVt);
+	}
+}
+
+static int addLeaf(WdfCircuit *c, WdfNodeType type, float value) {
+	if(c->nodeCount >= WDF_MAX_NODES) {
+		printf("error: WDF circuit is full, node not added.\n");
+		return -1;
+	}
+	int node = c->nodeCount++;
+	WdfLeaf *leaf = &c->leaves[c->leafCount];
+	leaf->type = type;
+	leaf->slot = node;
+	leaf->value = value;
+	leaf->state = 0.0f;
+	c->nodeToLeaf[node] = c->leafCount++;
+	c->resistance[node] = leafResistance(c, leaf);
+	return node;
+}
+
+static int addAdaptor(WdfCircuit *c, WdfNodeType type, int childA, int childB) {
+	if(c->nodeCount >= WDF_MAX_NODES) {
+		printf("error: WDF circuit is full, adaptor not added.\n");
+		return -1;
+	}
+	if(childA < 0 || childB < 0 || childA >= c->nodeCount || childB >= c->nodeCount || childA == childB) {
+		printf("error: invalid WDF adaptor children %i, %i.\n", childA, childB);
+		return -1;
+	}
+	int node = c->nodeCount++;
+	WdfAdaptor *ad = &c->adaptors[c->adaptorCount];
+	ad->type = type;
+	ad->childA = childA;
+	ad->childB = childB;
+	ad->port = node;
+	c->nodeToAdaptor[node] = c->adaptorCount++;
+	adaptResistances(c);
+	return node;
+}
+
+int wdfAddResistor(WdfCircuit *c, float ohms) {
+	return addLeaf(c, WDF_RESISTOR, ohms);
+}
+
+int wdfAddCapacitor(WdfCircuit *c, float farads) {
+	return addLeaf(c, WDF_CAPACITOR, farads);
+}
+
+int wdfAddInductor(WdfCircuit *c, float henries) {
+	return addLeaf(c, WDF_INDUCTOR, henries);
+}
+
+int wdfAddResistiveSource(WdfCircuit *c, float ohms) {
+	return addLeaf(c, WDF_RESISTIVE_SOURCE, ohms);
+}
+
+int wdfAddSeries(WdfCircuit *c, int childA, int childB) {
+	return addAdaptor(c, WDF_SERIES, childA, childB);
+}
+
+int wdfAddParallel(WdfCircuit *c, int childA, int childB) {
+	return addAdaptor(c, WDF_PARALLEL, childA, childB);
+}
+
+void wdfSetRootDiodePair(WdfCircuit *c, int child, float saturationCurrent, float thermalVoltage) {
+	if(child < 0 || child >= c->nodeCount) {
+		printf("error: invalid WDF root %i.\n", child);
+		return;
+	}
+	c->root = child;
+	c->diodeIs = saturationCurrent;
+	c->diodeVt = thermalVoltage;
+	adaptResistances(c);
+}
+
+void wdfSetValue(WdfCircuit *c, int node, float value) {
+	if(node < 0 || node >= c->nodeCount || c->nodeToLeaf[node] < 0) {
+		return;
+	}
+	WdfLeaf *leaf = &c->leaves[c->nodeToLeaf[node]];
+	if(leaf->value == value) {
+		return;
+	}
+	leaf->value = value;
+	c->resistance[node] = leafResistance(c, leaf);
+	adaptResistances(c);
+}
+
+void wdfSetSourceVoltage(WdfCircuit *c, int node, float volts) {
+	c->leaves[c->nodeToLeaf[node]].state = volts;
+}
+
+void wdfReset(WdfCircuit *c) {
+	for(int i = 0; i < c->leafCount; i++) {
+		c->leaves[i].state = 0.0f;
+	}
+	for(int i = 0; i < c->nodeCount; i++) {
+		c->up[i] = 0.0f;
+		c->down[i] = 0.0f;
+	}
+}
+
+// omega4 from D'Angelo, Gabrielli & Turchet, "Fast Approximation of the Lambert W Function for Virtual Analog Modelling"
+float wrightOmega(float x) {
+	float y;
+	if(x < -3.341459552768620f) {
+		y = 0.0f;
+	} else if(x < 8.0f) {
+		y = 0.6313183464296682f + x * (0.3631952663804445f + x * (0.04775931364975583f + x * -0.001314293149877800f));
+	} else {
+		y = x - logf(x);
+	}
+	return y - (y - expf(x - y)) / (y + 1.0f);
+}
+
+static float reflectDiodePair(WdfCircuit *c, float a) {
+	float lambda = a < 0.0f ? -1.0f : 1.0f;
+	float lambdaAOverVt = lambda * a / c->diodeVt;
+	return a - 2.0f * lambda * c->diodeVt * (wrightOmega(c->diodeLogTerm + lambdaAOverVt) - wrightOmega(c->diodeLogTerm - lambdaAOverVt));
+}
+
+void wdfProcessSample(WdfCircuit *c) {
+	float *up = c->up;
+	float *down = c->down;
+
+	for(int i = 0; i < c->leafCount; i++) {
+		WdfLeaf *leaf = &c->leaves[i];
+		switch(leaf->type) {
+			case WDF_CAPACITOR:
+			case WDF_RESISTIVE_SOURCE:
+				up[leaf->slot] = leaf->state;
+				break;
+			case WDF_INDUCTOR:
+				up[leaf->slot] = -leaf->state;
+				break;
+			case WDF_RESISTOR:
+			default:
+				up[leaf->slot] = 0.0f;
+				break;
+		}
+	}
+
+	for(int i = 0; i < c->adaptorCount; i++) {
+		WdfAdaptor *ad = &c->adaptors[i];
+		float a1 = up[ad->childA];
+		float a2 = up[ad->childB];
+		up[ad->port] = ad->type == WDF_SERIES ? -(a1 + a2) : ad->gamma * a1 + (1.0f - ad->gamma) * a2;
+	}
+
+	down[c->root] = reflectDiodePair(c, up[c->root]);
+
+	for(int i = c->adaptorCount - 1; i >= 0; i--) {
+		WdfAdaptor *ad = &c->adaptors[i];
+		float a1 = up[ad->childA];
+		float a2 = up[ad->childB];
+		float a3 = down[ad->port];
+		if(ad->type == WDF_SERIES) {
+			float sum = a1 + a2 + a3;
+			down[ad->childA] = a1 - ad->gamma * sum;
+			down[ad->childB] = a2 - (1.0f - ad->gamma) * sum;
+		} else {
+			float b3 = up[ad->port];
+			down[ad->childA] = a3 + b3 - a1;
+			down[ad->childB] = a3 + b3 - a2;
+		}
+	}
+
+	for(int i = 0; i < c->leafCount; i++) {
+		WdfLeaf *leaf = &c->leaves[i];
+		if(leaf->type == WDF_CAPACITOR || leaf->type == WDF_INDUCTOR) {
+			leaf->state = down[leaf->slot];
+		}
+	}
+}
+
+float wdfVoltage(WdfCircuit *c, int node) {
+	return 0.5f * (c->up[node] + c->down[node]);
+}
+
+#define DIODE_CLIPPER_CAPACITANCE 47.0e-9f
+
+void initDiodeClipper(DiodeClipper *dc, float sampleRate, float cutoff) {
+	initWdfCircuit(&dc->circuit, sampleRate);
+	dc->source = wdfAddResistiveSource(&dc->circuit, 1.0f / (2.0f * M_PI * cutoff * DIODE_CLIPPER_CAPACITANCE));
+	dc->capacitor = wdfAddCapacitor(&dc->circuit, DIODE_CLIPPER_CAPACITANCE);
+	int parallel = wdfAddParallel(&dc->circuit, dc->source, dc->capacitor);
+	wdfSetRootDiodePair(&dc->circuit, parallel, WDF_DIODE_IS, WDF_DIODE_VT);
+}
+
+void setDiodeClipperCutoff(DiodeClipper *dc, float cutoff) {
+	wdfSetValue(&dc->circuit, dc->source, 1.0f / (2.0f * M_PI * cutoff * DIODE_CLIPPER_CAPACITANCE));
+}
+
+float processDiodeClipper(DiodeClipper *dc, float x) {
+	wdfSetSourceVoltage(&dc->circuit, dc->source, x);
+	wdfProcessSample(&dc->circuit);
+	return wdfVoltage(&dc->circuit, dc->capacitor);
+}
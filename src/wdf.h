@@ -0,0 +1,92 @@
+#ifndef WDF_H
+#define WDF_H
+
+#include <stdbool.h>
+
+#define WDF_MAX_NODES 16
+
+// 1N4148, with the emission coefficient folded into the thermal voltage
+#define WDF_DIODE_IS 2.52e-9f
+#define WDF_DIODE_VT (0.02585f * 1.752f)
+
+typedef enum {
+	WDF_RESISTOR,
+	WDF_CAPACITOR,
+	WDF_INDUCTOR,
+	WDF_RESISTIVE_SOURCE,
+	WDF_SERIES,
+	WDF_PARALLEL,
+	WDF_NODE_TYPE_COUNT
+} WdfNodeType;
+
+typedef struct {
+	WdfNodeType type;
+	int slot;    // wave slot of the port facing the parent adaptor
+	float value; // ohms / farads / henries
+	float state; // reactive elements: previous incident wave, sources: the source voltage
+} WdfLeaf;
+
+typedef struct {
+	WdfNodeType type; // WDF_SERIES or WDF_PARALLEL
+	int childA;
+	int childB;
+	int port;    // the adapted port facing the parent, its reflected wave does not depend on its incident one
+	float gamma; // series: R_A / (R_A + R_B), parallel: G_A / (G_A + G_B)
+} WdfAdaptor;
+
+/**
+ * The adaptor tree is flattened as it is built: every node owns the wave slot of its upward port and nodes can only
+ * reference already created children, so creation order is a valid bottom-up order. A sample is one forward pass
+ * over the leaves and adaptors, the root nonlinearity, and one reverse pass over the adaptors, indices only.
+ */
+typedef struct {
+	WdfLeaf leaves[WDF_MAX_NODES];
+	WdfAdaptor adaptors[WDF_MAX_NODES];
+	int nodeToLeaf[WDF_MAX_NODES]; // -1 for adaptors
+	int nodeToAdaptor[WDF_MAX_NODES];
+	int leafCount;
+	int adaptorCount;
+	int nodeCount;
+	float resistance[WDF_MAX_NODES]; // port resistance per slot
+	float up[WDF_MAX_NODES];         // reflected waves travelling towards the root
+	float down[WDF_MAX_NODES];       // incident waves travelling towards the leaves
+	int root;
+	float diodeIs;
+	float diodeVt;
+	float diodeLogTerm; // log(R * Is / Vt) for the root port, refreshed whenever the tree is re-adapted
+	float sampleRate;
+} WdfCircuit;
+
+typedef struct {
+	WdfCircuit circuit;
+	int source;    // input voltage in series with the cutoff resistor
+	int capacitor; // across the diode pair, its voltage is the output
+} DiodeClipper;
+
+void initWdfCircuit(WdfCircuit *c, float sampleRate);
+int wdfAddResistor(WdfCircuit *c, float ohms);
+int wdfAddCapacitor(WdfCircuit *c, float farads);
+int wdfAddInductor(WdfCircuit *c, float henries);
+int wdfAddResistiveSource(WdfCircuit *c, float ohms);
+int wdfAddSeries(WdfCircuit *c, int childA, int childB);
+int wdfAddParallel(WdfCircuit *c, int childA, int childB);
+/**
+ * @brief Terminates the tree with an antiparallel diode pair, solved explicitly with the Wright omega function.
+ */
+void wdfSetRootDiodePair(WdfCircuit *c, int child, float saturationCurrent, float thermalVoltage);
+/**
+ * @brief Changes a component value and re-adapts the port resistances/scattering coefficients above it.
+ */
+void wdfSetValue(WdfCircuit *c, int node, float value);
+void wdfSetSourceVoltage(WdfCircuit *c, int node, float volts);
+void wdfReset(WdfCircuit *c);
+void wdfProcessSample(WdfCircuit *c);
+float wdfVoltage(WdfCircuit *c, int node);
+
+float wrightOmega(float x);
+
+void initDiodeClipper(DiodeClipper *dc, float sampleRate, float cutoff);
+void setDiodeClipperCutoff(DiodeClipper *dc, float cutoff);
+float processDiodeClipper(DiodeClipper *dc, float x);
+
+#endif
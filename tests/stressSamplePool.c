@@ -0,0 +1,99 @@
+#include "sample.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Runs a reader thread (standing in for the audio callback) against random
+ * load, unload and reload calls plus compaction on the main thread.
+ * Build and run with `make stress`, or under a sanitizer with
+ * `make stress STRESS_FLAGS=-fsanitize=address` / `-fsanitize=thread`.
+ */
+
+#define STRESS_SAMPLES 20
+#define STRESS_ROUNDS 400
+#define STRESS_FRAMES 400000
+
+static SamplePool *pool;
+static atomic_bool running;
+static atomic_long badReads;
+static long reads;
+
+static void *readerThread(void *arg) {
+	(void)arg;
+	while(atomic_load_explicit(&running, memory_order_acquire)) {
+		epochEnter(&pool->epoch, EPOCH_READER_AUDIO);
+		size_t count = __atomic_load_n(&pool->sampleCount, __ATOMIC_ACQUIRE);
+		for(size_t i = 0; i < count; i++) {
+			float position = 0.0f;
+			for(int k = 0; k < 64; k++) {
+				float v = getSampleValueFwd(pool->samples[i], &position, 0.01f, 1);
+				if(isnan(v) || fabsf(v) > 1.0f) {
+					atomic_fetch_add(&badReads, 1);
+				}
+			}
+			reads++;
+		}
+		epochExit(&pool->epoch, EPOCH_READER_AUDIO);
+		usleep(100);
+	}
+	return NULL;
+}
+
+int main() {
+	pool = createSamplePool();
+	float *data = malloc(sizeof(float) * STRESS_FRAMES);
+	if(!pool || !data) {
+		printf("could not set up the sample pool stress test.\n");
+		return 1;
+	}
+	for(int i = 0; i < STRESS_FRAMES; i++) {
+		data[i] = (i & 1) ? 0.5f : -0.5f;
+	}
+	for(int i = 0; i < STRESS_SAMPLES; i++) {
+		loadSample(pool, "stress", data, 16, 44100, STRESS_FRAMES, 1);
+	}
+
+	atomic_init(&running, true);
+	atomic_init(&badReads, 0);
+	pthread_t reader;
+	pthread_create(&reader, NULL, readerThread, NULL);
+
+	srand(1234);
+	for(int r = 0; r < STRESS_ROUNDS; r++) {
+		int index = rand() % STRESS_SAMPLES;
+		if(rand() & 1) {
+			unloadSample(pool, index);
+		} else {
+			reloadSample(pool, index, "reloaded", data, 16, 44100, STRESS_FRAMES / (1 + rand() % 4), 1);
+		}
+		maintainSamplePool(pool);
+		if(r % 50 == 0) {
+			loadSample(pool, "extra", data, 16, 44100, STRESS_FRAMES, 1);
+		}
+	}
+	// let the reclamation catch up with the last retirements
+	for(int i = 0; i < 10; i++) {
+		maintainSamplePool(pool);
+		usleep(1000);
+	}
+
+	atomic_store_explicit(&running, false, memory_order_release);
+	pthread_join(reader, NULL);
+
+	int slabs = 0;
+	for(int i = 0; i < MAX_SAMPLE_SLABS; i++) {
+		if(pool->slabs[i].data) {
+			slabs++;
+		}
+	}
+	long bad = atomic_load(&badReads);
+	printf("reads: %li, bad reads: %li, live bytes: %zu, slabs: %i, samples: %zu\n", reads, bad, pool->memoryUsed, slabs, pool->sampleCount);
+
+	freeSamplePool(pool);
+	free(data);
+	return bad == 0 ? 0 : 1;
+}